@@ -5,14 +5,53 @@
 #include <time.h>
 #include <immintrin.h> // Include for SIMD
 #include <omp.h>       // For OpenMP parallelism
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "../kernel/attention.h"
+#include "../kernel/kv_cache.h"
+#include "../kernel/sampling.h"
+#include "../kernel/quant.h"
+#include "../kernel/half.h"
+#include "../utils/checkpoint.h"
+#include "../utils/philox.h"
+#include "../utils/spsc_queue.h"
 
 #define EPSILON 1e-5
-#define EMBEDDING_SIZE 768                    // GPT-2 base model embedding size
-#define NUM_BLOCKS 12                         // Number of transformer blocks in GPT-2 base model
-#define NUM_HEADS 12                          // Number of attention heads
-#define HEAD_DIM (EMBEDDING_SIZE / NUM_HEADS) // Dimension of each attention head
-#define VOCAB_SIZE 50257                      // GPT-2 vocabulary size
+#define MODEL_CONFIG "small"                  // Random-weight model size: small, medium, large or xl (--model overrides)
 #define MAX_POSITION_EMBEDDINGS 1024          // Maximum sequence length
+#define EOS_TOKEN 50256                       // GPT-2 end-of-text token
+#define TIE_EMBEDDINGS 1                      // Logits projection reads wte instead of a separate matrix
+#define KV_CACHE_TYPE KV_FLOAT32              // KV_INT8 stores the KV cache as int8 with per-token, per-head scales, KV_FLOAT16 / KV_BFLOAT16 as 16-bit floats
+#define WEIGHT_QUANT QUANT_NONE               // QUANT_INT8 / QUANT_INT4 store the block linear weights quantized
+#define LOGITS_QUANT QUANT_NONE               // Same for the logits projection (an extra copy when tied to wte)
+#define WEIGHT_QUANT_GROUP 0                  // Inputs per scale: 0 for one per output channel, or 32/64/128
+#define WEIGHT_HALF HALF_NONE                 // HALF_FP16 / HALF_BF16 store wte and the linear weights not quantized above as 16-bit floats
+#ifndef ACTIVATION_INT8
+#define ACTIVATION_INT8 0                     // 1 runs QUANT_INT8 block linears as int8 x int8 GEMMs on per-token quantized inputs
+#endif
+#define INIT_SEED 42                          // Philox key for random weights
+#define INIT_CHUNK 65536                      // Elements generated per parallel initialization task
+#define LINEAR_TILE_ROWS 4                    // Token rows that share each weight row in the fp32 GEMM
+#define SCHEDULER_MAX_BATCH 8                 // Sequences run together in one scheduler step
+#define KV_POOL_SEQUENCES SCHEDULER_MAX_BATCH // Full-length sequences the shared KV pool can hold; memory is only touched as blocks are used
+#define PREFILL_CHUNK 256                     // Prompt tokens per forward; the scheduler spends at most this many per step
+#define DRAFT_BLOCKS 4                        // Leading blocks that make up the early-exit draft model of speculative decoding
+#define SPECULATIVE_TOKENS 4                  // Tokens the draft proposes per verification forward
+#define BEAM_LENGTH_PENALTY 1.0f              // Finished beams are ranked by log-probability / length^penalty
+#define PREFIX_CACHE 1                        // 1 keeps full prompt KV blocks for reuse by later prompts with the same prefix
+#define SERVER_QUEUE_SIZE 256                 // Parsed requests waiting for the compute thread
+#define SERVER_MAX_PENDING 64                 // Connections whose request line is still being read
+#define SERVER_LINE_LENGTH 16384              // Longest request line
+#define LAZY_INIT 0                           // 1 defers generating block weights until the block first runs
 
 // Assuming MatmulType is defined elsewhere
 typedef enum
@@ -21,6 +60,62 @@ typedef enum
     MATMUL_THREADED
 } MatmulType;
 
+// Model dimensions, chosen at run time
+typedef struct
+{
+    const char *name;
+    int embeddingSize;
+    int numBlocks; // transformer blocks
+    int numHeads;  // attention heads
+    int headDim;   // embeddingSize / numHeads
+    int vocabSize;
+} GPT2Config;
+
+// The released GPT-2 sizes. All of them use 64-wide heads, and their widths are the ones the
+// kernels below have constant-folded copies for.
+static const GPT2Config GPT2_CONFIGS[] = {
+    {"small", 768, 12, 12, 64, 50257},
+    {"medium", 1024, 24, 16, 64, 50257},
+    {"large", 1280, 36, 20, 64, 50257},
+    {"xl", 1600, 48, 25, 64, 50257},
+};
+#define NUM_GPT2_CONFIGS (int)(sizeof(GPT2_CONFIGS) / sizeof(GPT2_CONFIGS[0]))
+
+// Run `call(size)` with size as a literal when it is a GPT-2 model width or MLP width, so every
+// case inlines its own copy of the kernel with constant trip counts; other sizes take the
+// generic copy
+#define DISPATCH_WIDTH(size, call) \
+    switch (size)                   \
+    {                               \
+    case 768:                       \
+        call(768);                  \
+        break;                      \
+    case 1024:                      \
+        call(1024);                 \
+        break;                      \
+    case 1280:                      \
+        call(1280);                 \
+        break;                      \
+    case 1600:                      \
+        call(1600);                 \
+        break;                      \
+    case 3072:                      \
+        call(3072);                 \
+        break;                      \
+    case 4096:                      \
+        call(4096);                 \
+        break;                      \
+    case 5120:                      \
+        call(5120);                 \
+        break;                      \
+    case 6400:                      \
+        call(6400);                 \
+        break;                      \
+    default:                        \
+        call(size);                 \
+        break;                      \
+    }
+
 // Define the necessary data structures
 typedef struct
 {
@@ -41,8 +136,12 @@ typedef struct
 {
     float **weights; // weights[fcOutputSize][fcInputSize]
     float *biases;   // biases[fcOutputSize]
+    QuantizedMatrix *quantized; // quantized weights used instead of `weights` when set
+    HalfMatrix *half;           // 16-bit weights used instead of `weights` when set
     int fcInputSize;
     int fcOutputSize;
+    uint64_t init_stream; // Philox stream of the random weights
+    int pending;          // weights are allocated but not yet generated (LAZY_INIT)
 } LinearLayer;
 
 typedef struct
@@ -58,22 +157,129 @@ typedef struct
 {
     float **wpe; // Positional embeddings
     float **wte; // Token embeddings
+    HalfMatrix *wte_half; // 16-bit token embeddings used instead of wte when set
     BlockWeights *blocks;
-    LinearLayer logits_mlp;
+    GPT2Config config;
+    int numBlocks;          // blocks run by the forward pass; a draft view runs only the first few
+    LinearLayer logits_mlp; // logits_mlp.weights aliases wte when tied
+    int tied_embeddings;
+    Checkpoint *checkpoint; // non-NULL when the weights point into a memory-mapped checkpoint
 } GPT2Weights;
 
+// Called for every generated token; returning non-zero stops generation
+typedef int (*TokenCallback)(int token, int index, void *userData);
+
+typedef struct
+{
+    int num_generated;
+    double time_to_first_token; // seconds from the call to the first token (prefill + sampling)
+    double mean_token_latency;  // seconds per token after the first
+    double tokens_per_second;   // decode throughput after the first token
+} GenerationStats;
+
+typedef struct
+{
+    int rounds;   // verification forwards of the main model
+    int drafted;  // tokens proposed by the draft
+    int accepted; // proposed tokens the main model agreed with
+} SpeculativeStats;
+
+typedef struct
+{
+    float score;     // length-normalized log-probability of the returned sequence
+    int peak_blocks; // most distinct KV blocks held at once by all beams together
+} BeamStats;
+
+// Rows [start, start + length) of a batched step belong to one sequence, which attends over
+// its own cache (or over those rows alone when cache is NULL)
+typedef struct
+{
+    KVCache *cache;
+    int start;
+    int length;
+} BatchSegment;
+
+// Called once when a request leaves the scheduler
+typedef void (*FinishCallback)(int id, const GenerationStats *stats, void *userData);
+
+// One request of the continuous-batching scheduler
+typedef struct
+{
+    int id;
+    int *history;     // prompt followed by the generated tokens
+    int promptLength;
+    int maxNewTokens;
+    int generated;
+    int preemptions; // times its KV blocks were taken back; it then recomputes history on readmission
+    SamplerConfig sampler;
+    KVCache *cache;
+    TokenCallback callback;
+    FinishCallback finish;
+    void *userData;
+    double submit_time;
+    double first_token_time;
+} Sequence;
+
+// Keeps a running batch of up to maxBatch sequences. Every step admits waiting requests in
+// arrival order while the KV pool can hold their prompts, runs one forward over all of them
+// (prompt chunks for new sequences, one token for the others) and retires finished ones.
+// With a prefix cache on the pool, new sequences only prefill the part of the prompt that
+// is not cached. When the pool cannot hold the next rows, the most recently admitted
+// sequences are preempted: their blocks are freed and they go back to the front of the
+// queue, to recompute their prompt and generated tokens once there is room again.
+typedef struct
+{
+    GPT2Weights weights;
+    KVBlockPool *pool;
+    int maxBatch;
+    Sequence **waiting; // FIFO of requests not yet admitted
+    int numWaiting;
+    int waitingCapacity;
+    Sequence **running;
+    int numRunning;
+    int nextId;
+    int prefillChunk;  // prompt rows per step, shared by all prefilling sequences
+    long promptTokens; // prompt tokens admitted, and how many of them the prefix cache supplied
+    long reusedTokens;
+    int preemptions;
+} Scheduler;
+
 // Function prototypes
-float *linear(float *fcInput, float **weights, float *biases, int fcInputSize, int fcOutputSize);
-float **scaled_dot_product_attention(float **Q, float **K, float **V, int seqLength, int depth);
+static float *linear(float *fcInput, float **weights, float *biases, int fcInputSize, int fcOutputSize);
 float **matrix_add(float **x, float **y, int numRow, int numCol);
 float **norm(float **x, int seqLength, int features);
 float *gelu(float *x, int size);
-float **block(float **x, int seqLength, int embeddingSize, BlockWeights weights);
-float *model(int *tokens, int seqLength, GPT2Weights weights);
+QuantizedActivations *activations_for(LinearLayer *layer, float **inputs, int numInputs);
+float **linear_batch(LinearLayer *layer, float **inputs, int numInputs);
+float **linear_rows(LinearLayer *layer, float **inputs, int numInputs, const QuantizedActivations *quantizedInputs);
+float **block(float **x, int numRows, const GPT2Config *config, BlockWeights weights, const BatchSegment *segments, int numSegments, int layer);
+void materialize_block(BlockWeights *weights);
+float **forward_rows(int *tokens, GPT2Weights weights, const BatchSegment *segments, int numSegments);
+float **forward_batch(int *tokens, GPT2Weights weights, const BatchSegment *segments, int numSegments);
+float *forward(int *tokens, int seqLength, GPT2Weights weights, KVCache *cache);
+float *prefill(int *tokens, int seqLength, GPT2Weights weights, KVCache *cache, int chunkSize);
+float *model(int *tokens, int seqLength, GPT2Weights weights, KVCache *cache);
+void select_tokens(float **hidden, int numRows, GPT2Weights weights, TokenSelector *selectors);
+int next_token(float *hidden, GPT2Weights weights, SamplerConfig *sampler, int *history, int historyLength);
 int *positions_for(int *tokens, int seqLength, int past_length);
+int generate(int *prompt, int promptLength, int maxNewTokens, SamplerConfig sampler, GPT2Weights weights, KVCache *cache,
+             TokenCallback callback, void *userData, GenerationStats *stats);
+int generate_speculative(int *prompt, int promptLength, int maxNewTokens, SamplerConfig sampler, GPT2Weights weights, KVCache *cache,
+                         GPT2Weights draft, KVCache *draftCache, int numDraft, TokenCallback callback, void *userData,
+                         GenerationStats *stats, SpeculativeStats *speculative);
+int beam_search(int *prompt, int promptLength, int maxNewTokens, int numBeams, GPT2Weights weights, KVBlockPool *pool,
+                int *output, BeamStats *stats);
+Scheduler *scheduler_create(GPT2Weights weights, KVBlockPool *pool, int maxBatch);
+int scheduler_submit(Scheduler *scheduler, const int *prompt, int promptLength, int maxNewTokens, SamplerConfig sampler,
+                     TokenCallback callback, FinishCallback finish, void *userData);
+int scheduler_step(Scheduler *scheduler);
+void scheduler_free(Scheduler *scheduler);
+int load_weights(const char *path, GPT2Weights *weights);
+int save_weights(GPT2Weights *weights, const char *path);
+void free_weights(GPT2Weights *weights);
 
 // SIMD optimized linear layer function
-float *linear(float *fcInput, float **weights, float *biases, int fcInputSize, int fcOutputSize)
+static float *linear(float *fcInput, float **weights, float *biases, int fcInputSize, int fcOutputSize)
 {
     float *output = (float *)malloc(fcOutputSize * sizeof(float));
 
@@ -98,58 +304,6 @@ float *linear(float *fcInput, float **weights, float *biases, int fcInputSize, i
     return output;
 }
 
-// Function to compute the scaled dot product attention with blocking
-float **scaled_dot_product_attention(float **Q, float **K, float **V, int seqLength, int depth)
-{
-    float **output = (float **)malloc(seqLength * sizeof(float *));
-    for (int i = 0; i < seqLength; i++)
-    {
-        output[i] = (float *)malloc(seqLength * sizeof(float)); // Assuming square matrix for simplicity
-    }
-
-    float scale_factor = 1.0f / sqrt((float)depth);
-
-    int block_size = 64;
-
-    // Process blocks in parallel
-#pragma omp parallel for collapse(2) schedule(dynamic)
-    for (int bi = 0; bi < seqLength; bi += block_size)
-    {
-        for (int bj = 0; bj < seqLength; bj += block_size)
-        {
-            for (int i = bi; i < bi + block_size && i < seqLength; i++)
-            {
-                for (int j = bj; j < bj + block_size && j < seqLength; j++)
-                {
-                    __m128 sum = _mm_setzero_ps(); // Initialize sum to zero
-
-                    // Perform the dot product over depth dimension in chunks of 4 using SIMD
-                    for (int k_idx = 0; k_idx < depth; k_idx += 4)
-                    {
-                        // Load Q and K vectors (4 floats at a time)
-                        __m128 q_vals = _mm_load_ps(&Q[i][k_idx]);
-                        __m128 k_vals = _mm_load_ps(&K[j][k_idx]);
-
-                        // Compute Q * K^T for each chunk of 4 values
-                        __m128 mul_res = _mm_mul_ps(q_vals, k_vals);
-                        sum = _mm_add_ps(sum, mul_res);
-                    }
-
-                    // Sum up the partial results in the SIMD register
-                    float sum_scalar[4];
-                    _mm_store_ps(sum_scalar, sum);
-                    float dot_product = sum_scalar[0] + sum_scalar[1] + sum_scalar[2] + sum_scalar[3];
-
-                    dot_product *= scale_factor;
-                    output[i][j] = dot_product;
-                }
-            }
-        }
-    }
-
-    return output;
-}
-
 // SIMD optimized matrix add function
 float **matrix_add(float **x, float **y, int numRow, int numCol)
 {
@@ -178,6 +332,31 @@ float **matrix_add(float **x, float **y, int numRow, int numCol)
     return result;
 }
 
+// Layer normalization of one row; norm passes features as a literal through DISPATCH_WIDTH
+static inline void norm_row(const float *x, float *normalized, int features)
+{
+    // Compute mean and variance
+    float mean = 0.0;
+    for (int j = 0; j < features; j++)
+    {
+        mean += x[j];
+    }
+    mean /= features;
+
+    float variance = 0.0;
+    for (int j = 0; j < features; j++)
+    {
+        variance += (x[j] - mean) * (x[j] - mean);
+    }
+    variance /= features;
+
+    // Normalize
+    for (int j = 0; j < features; j++)
+    {
+        normalized[j] = (x[j] - mean) / sqrt(variance + EPSILON);
+    }
+}
+
 // Implement layer normalization
 float **norm(float **x, int seqLength, int features)
 {
@@ -185,26 +364,9 @@ float **norm(float **x, int seqLength, int features)
     for (int i = 0; i < seqLength; i++)
     {
         normalized[i] = (float *)malloc(features * sizeof(float));
-        // Compute mean and variance
-        float mean = 0.0;
-        for (int j = 0; j < features; j++)
-        {
-            mean += x[i][j];
-        }
-        mean /= features;
-
-        float variance = 0.0;
-        for (int j = 0; j < features; j++)
-        {
-            variance += (x[i][j] - mean) * (x[i][j] - mean);
-        }
-        variance /= features;
-
-        // Normalize
-        for (int j = 0; j < features; j++)
-        {
-            normalized[i][j] = (x[i][j] - mean) / sqrt(variance + EPSILON);
-        }
+#define NORM_ROW(size) norm_row(x[i], normalized[i], size)
+        DISPATCH_WIDTH(features, NORM_ROW)
+#undef NORM_ROW
     }
     return normalized;
 }
@@ -229,6 +391,7 @@ float *gelu(float *x, int size)
 // Function to compute positions
 int *positions_for(int *tokens, int seqLength, int past_length)
 {
+    (void)tokens; // positions depend only on where the rows start
     int *positions = (int *)malloc(seqLength * sizeof(int));
     for (int i = 0; i < seqLength; i++)
     {
@@ -237,9 +400,114 @@ int *positions_for(int *tokens, int seqLength, int past_length)
     return positions;
 }
 
-// Implement the transformer block with multi-head attention
-float **block(float **x, int seqLength, int embeddingSize, BlockWeights weights)
+// outputs[t][i] = w * inputs[t] + bias for every input row, with w output row i of a linear
+// layer. Tiles of LINEAR_TILE_ROWS inputs share each weight vector; linear_batch passes
+// inputSize as a literal through DISPATCH_WIDTH so the standard widths get constant trip counts.
+static inline void linear_batch_row(const float *w, float bias, float **inputs, int numInputs, int inputSize, float **outputs, int i)
+{
+    for (int t0 = 0; t0 < numInputs; t0 += LINEAR_TILE_ROWS)
+    {
+        int n = (numInputs - t0 < LINEAR_TILE_ROWS) ? numInputs - t0 : LINEAR_TILE_ROWS;
+        float sums[LINEAR_TILE_ROWS] = {0.0f};
+        int j = 0;
+#if defined(__AVX2__) && defined(__FMA__)
+        __m256 acc[LINEAR_TILE_ROWS];
+        for (int t = 0; t < LINEAR_TILE_ROWS; t++)
+        {
+            acc[t] = _mm256_setzero_ps();
+        }
+        for (; j + 8 <= inputSize; j += 8)
+        {
+            __m256 wv = _mm256_loadu_ps(&w[j]);
+            for (int t = 0; t < n; t++)
+            {
+                acc[t] = _mm256_fmadd_ps(wv, _mm256_loadu_ps(&inputs[t0 + t][j]), acc[t]);
+            }
+        }
+        for (int t = 0; t < n; t++)
+        {
+            float lanes[8];
+            _mm256_storeu_ps(lanes, acc[t]);
+            sums[t] = lanes[0] + lanes[1] + lanes[2] + lanes[3] + lanes[4] + lanes[5] + lanes[6] + lanes[7];
+        }
+#endif
+        for (; j < inputSize; j++)
+        {
+            for (int t = 0; t < n; t++)
+            {
+                sums[t] += w[j] * inputs[t0 + t][j];
+            }
+        }
+        for (int t = 0; t < n; t++)
+        {
+            outputs[t0 + t][i] = sums[t] + bias;
+        }
+    }
+}
+
+// fp32 GEMM over a batch of token rows: outputs[t] = weights * inputs[t] + biases. Each weight
+// row is read once per tile of LINEAR_TILE_ROWS inputs, so a decode step over many sequences
+// costs about one pass over the weights instead of one per sequence.
+float **linear_batch(LinearLayer *layer, float **inputs, int numInputs)
+{
+    int inputSize = layer->fcInputSize;
+    float **outputs = (float **)malloc(numInputs * sizeof(float *));
+    for (int t = 0; t < numInputs; t++)
+    {
+        outputs[t] = (float *)malloc(layer->fcOutputSize * sizeof(float));
+    }
+
+    // The width is dispatched per output row, inside the parallel loop, so every specialised
+    // copy is inlined into the loop body the compiler outlines for the threads
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < layer->fcOutputSize; i++)
+    {
+#define LINEAR_BATCH_ROW(size) linear_batch_row(layer->weights[i], layer->biases[i], inputs, numInputs, size, outputs, i)
+        DISPATCH_WIDTH(inputSize, LINEAR_BATCH_ROW)
+#undef LINEAR_BATCH_ROW
+    }
+    return outputs;
+}
+
+// Quantize inputs once per token when the layer runs as an int8 x int8 GEMM, else NULL
+QuantizedActivations *activations_for(LinearLayer *layer, float **inputs, int numInputs)
 {
+    if (!ACTIVATION_INT8 || layer->quantized == NULL || layer->quantized->type != QUANT_INT8)
+    {
+        return NULL;
+    }
+    return quantize_activations(inputs, numInputs, layer->fcInputSize);
+}
+
+// Apply a linear layer to every input row, with one GEMM over all rows when quantized.
+// quantizedInputs (from activations_for, may be NULL) selects the integer GEMM when the layer
+// itself is QUANT_INT8; layers sharing the inputs can be stored differently, since a
+// checkpoint may quantize some of them offline and not others.
+float **linear_rows(LinearLayer *layer, float **inputs, int numInputs, const QuantizedActivations *quantizedInputs)
+{
+    if (quantizedInputs != NULL && layer->quantized != NULL && layer->quantized->type == QUANT_INT8)
+    {
+        return linear_int8_gemm(quantizedInputs, layer->quantized, layer->biases);
+    }
+    if (layer->quantized != NULL)
+    {
+        return linear_quantized_rows(inputs, numInputs, layer->quantized, layer->biases);
+    }
+    if (layer->half != NULL)
+    {
+        return linear_half_rows(inputs, numInputs, layer->half, layer->biases);
+    }
+    return linear_batch(layer, inputs, numInputs);
+}
+
+// Implement the transformer block with multi-head attention. x holds the new positions of one
+// or more sequences, and segments say which rows belong to which. The linear layers run as one
+// GEMM over all rows; attention runs per sequence: with a cache the segment's K/V rows are
+// appended to this layer and it attends over every cached position, otherwise over its rows alone.
+float **block(float **x, int numRows, const GPT2Config *config, BlockWeights weights, const BatchSegment *segments, int numSegments, int layer)
+{
+    int embeddingSize = config->embeddingSize;
+
     // Extract weights
     LinearLayer q_mlp = weights.q_mlp;
     LinearLayer k_mlp = weights.k_mlp;
@@ -248,95 +516,72 @@ float **block(float **x, int seqLength, int embeddingSize, BlockWeights weights)
     LinearLayer second_block_MLP = weights.second_block_MLP;
 
     // Apply layer normalization to x
-    float **normalized_x = norm(x, seqLength, embeddingSize);
-
-    // Allocate memory for Q, K, V
-    float **Q = (float **)malloc(seqLength * sizeof(float *));
-    float **K = (float **)malloc(seqLength * sizeof(float *));
-    float **V = (float **)malloc(seqLength * sizeof(float *));
-    for (int i = 0; i < seqLength; i++)
+    float **normalized_x = norm(x, numRows, embeddingSize);
+
+    // Compute Q, K, V for every position; int8 projections share one quantized input
+    QuantizedActivations *quantized_x = activations_for(&q_mlp, normalized_x, numRows);
+    float **Q = linear_rows(&q_mlp, normalized_x, numRows, quantized_x);
+    float **K = linear_rows(&k_mlp, normalized_x, numRows, quantized_x);
+    float **V = linear_rows(&v_mlp, normalized_x, numRows, quantized_x);
+    quantized_activations_free(quantized_x);
+
+    // Apply fused causal attention over all heads at once. Every head reads its headDim-wide
+    // slice of Q, K, V in place and writes its output directly into the same slice of `a`.
+    float **a = (float **)malloc(numRows * sizeof(float *));
+    for (int i = 0; i < numRows; i++)
     {
-        Q[i] = linear(normalized_x[i], q_mlp.weights, q_mlp.biases, q_mlp.fcInputSize, q_mlp.fcOutputSize);
-        K[i] = linear(normalized_x[i], k_mlp.weights, k_mlp.biases, k_mlp.fcInputSize, k_mlp.fcOutputSize);
-        V[i] = linear(normalized_x[i], v_mlp.weights, v_mlp.biases, v_mlp.fcInputSize, v_mlp.fcOutputSize);
+        a[i] = (float *)malloc(embeddingSize * sizeof(float));
     }
 
-    // Reshape Q, K, V for multi-head attention
-    // Q_heads[NUM_HEADS][seqLength][HEAD_DIM]
-    float ***Q_heads = (float ***)malloc(NUM_HEADS * sizeof(float **));
-    float ***K_heads = (float ***)malloc(NUM_HEADS * sizeof(float **));
-    float ***V_heads = (float ***)malloc(NUM_HEADS * sizeof(float **));
-    for (int h = 0; h < NUM_HEADS; h++)
+    for (int s = 0; s < numSegments; s++)
     {
-        Q_heads[h] = (float **)malloc(seqLength * sizeof(float *));
-        K_heads[h] = (float **)malloc(seqLength * sizeof(float *));
-        V_heads[h] = (float **)malloc(seqLength * sizeof(float *));
-        for (int i = 0; i < seqLength; i++)
+        KVCache *cache = segments[s].cache;
+        int start = segments[s].start;
+        int length = segments[s].length;
+        if (cache != NULL)
         {
-            Q_heads[h][i] = (float *)malloc(HEAD_DIM * sizeof(float));
-            K_heads[h][i] = (float *)malloc(HEAD_DIM * sizeof(float));
-            V_heads[h][i] = (float *)malloc(HEAD_DIM * sizeof(float));
-            // Copy the corresponding slice from Q, K, V
-            memcpy(Q_heads[h][i], &Q[i][h * HEAD_DIM], HEAD_DIM * sizeof(float));
-            memcpy(K_heads[h][i], &K[i][h * HEAD_DIM], HEAD_DIM * sizeof(float));
-            memcpy(V_heads[h][i], &V[i][h * HEAD_DIM], HEAD_DIM * sizeof(float));
+            // Attend over the cached positions followed by the new ones, read through the block table
+            kv_cache_append(cache, layer, &K[start], &V[start], length);
+            paged_attention(&Q[start], cache, layer, &a[start], length, cache->length + length, config->numHeads, config->headDim, 1);
         }
-    }
-
-    // Apply attention on each head
-    float ***head_outputs = (float ***)malloc(NUM_HEADS * sizeof(float **));
-
-    // TODO: Implement multihead attention here
-    // Hint: it should only take around three lines of code
-    for (int h = 0; h < NUM_HEADS; h++)
-    {
-        // Apply scaled dot-product attention for each head
-        head_outputs[h] = scaled_dot_product_attention(Q_heads[h], K_heads[h], V_heads[h], seqLength, HEAD_DIM);
-    }
-
-    // Concatenate the outputs from all heads
-    float **a = (float **)malloc(seqLength * sizeof(float *));
-    for (int i = 0; i < seqLength; i++)
-    {
-        a[i] = (float *)malloc(embeddingSize * sizeof(float));
-        for (int h = 0; h < NUM_HEADS; h++)
+        else
         {
-            memcpy(&a[i][h * HEAD_DIM], head_outputs[h][i], HEAD_DIM * sizeof(float));
+            multi_head_attention(&Q[start], &K[start], &V[start], &a[start], length, length, config->numHeads, config->headDim, 1);
         }
     }
 
     // Add residual connection
-    float **x_added = matrix_add(x, a, seqLength, embeddingSize);
+    float **x_added = matrix_add(x, a, numRows, embeddingSize);
 
     // Apply layer normalization
-    float **normalized_x_added = norm(x_added, seqLength, embeddingSize);
-
-    // Allocate memory for m
-    float **m = (float **)malloc(seqLength * sizeof(float *));
+    float **normalized_x_added = norm(x_added, numRows, embeddingSize);
 
-    for (int i = 0; i < seqLength; i++)
+    // First layer of MLP with GeLU activation
+    QuantizedActivations *quantized_in = activations_for(&first_block_MLP, normalized_x_added, numRows);
+    float **first_mlp_out = linear_rows(&first_block_MLP, normalized_x_added, numRows, quantized_in);
+    quantized_activations_free(quantized_in);
+    for (int i = 0; i < numRows; i++)
     {
-        // TODO: Implement the two layer MLP here
-        // Hint: it should only take around five lines of code
-        // Hint: it should be first_block_MLP followed by gelu, and then second_block_MLP
-
-        // First layer of MLP with GeLU activation
-        float *first_mlp_out = linear(normalized_x_added[i], first_block_MLP.weights, first_block_MLP.biases,
-                                      first_block_MLP.fcInputSize, first_block_MLP.fcOutputSize);
-        float *gelu_out = gelu(first_mlp_out, first_block_MLP.fcOutputSize);
-        free(first_mlp_out);
+        float *gelu_out = gelu(first_mlp_out[i], first_block_MLP.fcOutputSize);
+        free(first_mlp_out[i]);
+        first_mlp_out[i] = gelu_out;
+    }
 
-        // Second layer of MLP
-        m[i] = linear(gelu_out, second_block_MLP.weights, second_block_MLP.biases,
-                      second_block_MLP.fcInputSize, second_block_MLP.fcOutputSize);
-        free(gelu_out);
+    // Second layer of MLP
+    QuantizedActivations *quantized_hidden = activations_for(&second_block_MLP, first_mlp_out, numRows);
+    float **m = linear_rows(&second_block_MLP, first_mlp_out, numRows, quantized_hidden);
+    quantized_activations_free(quantized_hidden);
+    for (int i = 0; i < numRows; i++)
+    {
+        free(first_mlp_out[i]);
     }
+    free(first_mlp_out);
 
     // Add residual connection
-    float **output = matrix_add(x_added, m, seqLength, embeddingSize);
+    float **output = matrix_add(x_added, m, numRows, embeddingSize);
 
     // Free allocated memory
-    for (int i = 0; i < seqLength; i++)
+    for (int i = 0; i < numRows; i++)
     {
         free(normalized_x[i]);
         free(Q[i]);
@@ -354,45 +599,58 @@ float **block(float **x, int seqLength, int embeddingSize, BlockWeights weights)
     free(m);
     free(x_added);
 
-    // Free memory for heads
-    for (int h = 0; h < NUM_HEADS; h++)
+    // Free the concatenated attention output
+    for (int i = 0; i < numRows; i++)
     {
-        for (int i = 0; i < seqLength; i++)
-        {
-            free(Q_heads[h][i]);
-            free(K_heads[h][i]);
-            free(V_heads[h][i]);
-            free(head_outputs[h][i]);
-        }
-        free(Q_heads[h]);
-        free(K_heads[h]);
-        free(V_heads[h]);
-        free(head_outputs[h]);
+        free(a[i]);
     }
-    free(Q_heads);
-    free(K_heads);
-    free(V_heads);
-    free(head_outputs);
+    free(a);
 
     return output;
 }
 
-// Implement the model function with positional embeddings
-float *model(int *tokens, int seqLength, GPT2Weights weights)
+// Run the transformer over one step of a batch of sequences. Segment s feeds its `length`
+// tokens, stored from tokens[start], after the ones already in its cache: a whole prompt for
+// prefill, one token per decode step. Returns the final hidden state of every row, or NULL if
+// a sequence would exceed MAX_POSITION_EMBEDDINGS or its cache cannot grow.
+float **forward_rows(int *tokens, GPT2Weights weights, const BatchSegment *segments, int numSegments)
 {
     // Compute positions
-    int past_length = 0; // Assuming no past tokens for simplicity
-    int *positions = positions_for(tokens, seqLength, past_length);
+    int numRows = segments[numSegments - 1].start + segments[numSegments - 1].length;
+    int *positions = (int *)malloc(numRows * sizeof(int));
+    for (int s = 0; s < numSegments; s++)
+    {
+        KVCache *cache = segments[s].cache;
+        int past_length = (cache != NULL) ? cache->length : 0;
+        if (past_length + segments[s].length > MAX_POSITION_EMBEDDINGS ||
+            (cache != NULL && kv_cache_reserve(cache, past_length + segments[s].length) != 0))
+        {
+            free(positions);
+            return NULL; // KV pool exhausted
+        }
+        int *segment_positions = positions_for(&tokens[segments[s].start], segments[s].length, past_length);
+        memcpy(&positions[segments[s].start], segment_positions, segments[s].length * sizeof(int));
+        free(segment_positions);
+    }
 
     // Initialize h with embeddings
-    float **h = (float **)malloc(seqLength * sizeof(float *));
-    for (int i = 0; i < seqLength; i++)
+    int embeddingSize = weights.config.embeddingSize;
+    float **h = (float **)malloc(numRows * sizeof(float *));
+    for (int i = 0; i < numRows; i++)
     {
-        h[i] = (float *)malloc(EMBEDDING_SIZE * sizeof(float));
+        h[i] = (float *)malloc(embeddingSize * sizeof(float));
         // Get word embeddings and add positional embeddings
-        for (int j = 0; j < EMBEDDING_SIZE; j++)
+        if (weights.wte_half != NULL)
         {
-            h[i][j] = weights.wte[tokens[i]][j] + weights.wpe[positions[i]][j];
+            embedding_half(weights.wte_half, tokens[i], h[i]);
+        }
+        else
+        {
+            memcpy(h[i], weights.wte[tokens[i]], embeddingSize * sizeof(float));
+        }
+        for (int j = 0; j < embeddingSize; j++)
+        {
+            h[i][j] += weights.wpe[positions[i]][j];
         }
     }
 
@@ -400,11 +658,12 @@ float *model(int *tokens, int seqLength, GPT2Weights weights)
     free(positions);
 
     // Pass through transformer blocks
-    for (int i = 0; i < NUM_BLOCKS; i++)
+    for (int i = 0; i < weights.numBlocks; i++)
     {
-        float **new_h = block(h, seqLength, EMBEDDING_SIZE, weights.blocks[i]);
+        materialize_block(&weights.blocks[i]);
+        float **new_h = block(h, numRows, &weights.config, weights.blocks[i], segments, numSegments, i);
         // Free previous h
-        for (int j = 0; j < seqLength; j++)
+        for (int j = 0; j < numRows; j++)
         {
             free(h[j]);
         }
@@ -412,174 +671,2079 @@ float *model(int *tokens, int seqLength, GPT2Weights weights)
         h = new_h;
     }
 
-    // Get logits for the last token
-    LinearLayer logits_mlp = weights.logits_mlp;
-    float *logits = linear(h[seqLength - 1], logits_mlp.weights, logits_mlp.biases, logits_mlp.fcInputSize, logits_mlp.fcOutputSize);
+    // The new positions are now part of every layer's cache
+    for (int s = 0; s < numSegments; s++)
+    {
+        if (segments[s].cache != NULL)
+        {
+            kv_cache_commit(segments[s].cache, segments[s].length);
+        }
+    }
+    return h;
+}
 
-    // Free h
-    for (int i = 0; i < seqLength; i++)
+// forward_rows keeping only the final hidden state of the last token of every segment
+float **forward_batch(int *tokens, GPT2Weights weights, const BatchSegment *segments, int numSegments)
+{
+    float **h = forward_rows(tokens, weights, segments, numSegments);
+    if (h == NULL)
+    {
+        return NULL;
+    }
+    int numRows = segments[numSegments - 1].start + segments[numSegments - 1].length;
+    float **last = (float **)malloc(numSegments * sizeof(float *));
+    for (int s = 0; s < numSegments; s++)
+    {
+        int end = segments[s].start + segments[s].length - 1;
+        last[s] = h[end];
+        h[end] = NULL;
+    }
+    for (int i = 0; i < numRows; i++)
     {
         free(h[i]);
     }
     free(h);
 
-    return logits;
+    return last;
 }
 
-void initialize_linear_layer(LinearLayer *layer, int inputSize, int outputSize)
+// Run the transformer over seqLength tokens following the ones already in the cache (the whole
+// prompt for prefill, one token per decode step) and return the final hidden state of the last
+// token. Pass a NULL cache to run a stateless forward over the tokens alone.
+float *forward(int *tokens, int seqLength, GPT2Weights weights, KVCache *cache)
 {
-    layer->fcInputSize = inputSize;
-    layer->fcOutputSize = outputSize;
-    layer->weights = (float **)malloc(outputSize * sizeof(float *));
-    layer->biases = (float *)malloc(outputSize * sizeof(float));
-    for (int i = 0; i < outputSize; i++)
+    BatchSegment segment = {cache, 0, seqLength};
+    float **hidden = forward_batch(tokens, weights, &segment, 1);
+    if (hidden == NULL)
     {
-        layer->weights[i] = (float *)malloc(inputSize * sizeof(float));
-        layer->biases[i] = 0.0f; // Initialize biases to zero
-        for (int j = 0; j < inputSize; j++)
-        {
-            layer->weights[i][j] = ((float)rand() / RAND_MAX) * 0.02f - 0.01f; // Random weights between -0.01 and 0.01
-        }
+        return NULL;
     }
+    float *last = hidden[0];
+    free(hidden);
+    return last;
 }
 
-GPT2Weights initialize_weights()
+// Run a prompt through the model chunkSize tokens at a time, each chunk attending to the ones
+// before it through the cache. Activations and attention scores scale with the chunk rather
+// than the prompt. Returns the final hidden state of the last token, or NULL.
+float *prefill(int *tokens, int seqLength, GPT2Weights weights, KVCache *cache, int chunkSize)
 {
-    // Initialize GPT2Weights
-    GPT2Weights weights;
-
-    // Initialize token embeddings (wte)
-    weights.wte = (float **)malloc(VOCAB_SIZE * sizeof(float *));
-    for (int i = 0; i < VOCAB_SIZE; i++)
+    if (cache == NULL || chunkSize <= 0)
     {
-        weights.wte[i] = (float *)malloc(EMBEDDING_SIZE * sizeof(float));
-        for (int j = 0; j < EMBEDDING_SIZE; j++)
-        {
-            weights.wte[i][j] = ((float)rand() / RAND_MAX) * 0.02f - 0.01f; // Random values between -0.01 and 0.01
-        }
+        return forward(tokens, seqLength, weights, cache);
     }
-
-    // Initialize positional embeddings (wpe)
-    weights.wpe = (float **)malloc(MAX_POSITION_EMBEDDINGS * sizeof(float *));
-    for (int i = 0; i < MAX_POSITION_EMBEDDINGS; i++)
+    float *hidden = NULL;
+    for (int start = 0; start < seqLength; start += chunkSize)
     {
-        weights.wpe[i] = (float *)malloc(EMBEDDING_SIZE * sizeof(float));
-        for (int j = 0; j < EMBEDDING_SIZE; j++)
+        free(hidden);
+        int length = (seqLength - start < chunkSize) ? seqLength - start : chunkSize;
+        hidden = forward(tokens + start, length, weights, cache);
+        if (hidden == NULL)
         {
-            weights.wpe[i][j] = ((float)rand() / RAND_MAX) * 0.02f - 0.01f;
+            break;
         }
     }
+    return hidden;
+}
 
-    weights.blocks = (BlockWeights *)malloc(NUM_BLOCKS * sizeof(BlockWeights));
-    for (int b = 0; b < NUM_BLOCKS; b++)
+// Implement the model function with positional embeddings: the full logits of the last token
+float *model(int *tokens, int seqLength, GPT2Weights weights, KVCache *cache)
+{
+    float *last = forward(tokens, seqLength, weights, cache);
+    if (last == NULL)
     {
-        // Initialize Q, K, V linear layers using the helper function
-        initialize_linear_layer(&weights.blocks[b].q_mlp, EMBEDDING_SIZE, EMBEDDING_SIZE);
-        initialize_linear_layer(&weights.blocks[b].k_mlp, EMBEDDING_SIZE, EMBEDDING_SIZE);
-        initialize_linear_layer(&weights.blocks[b].v_mlp, EMBEDDING_SIZE, EMBEDDING_SIZE);
-
-        // Initialize MLP layers
-        int mlpHiddenSize = EMBEDDING_SIZE * 4; // MLP hidden size is typically 4x the embedding size
-        initialize_linear_layer(&weights.blocks[b].first_block_MLP, EMBEDDING_SIZE, mlpHiddenSize);
-        initialize_linear_layer(&weights.blocks[b].second_block_MLP, mlpHiddenSize, EMBEDDING_SIZE);
+        return NULL;
     }
 
-    // Initialize logits_mlp
-    initialize_linear_layer(&weights.logits_mlp, EMBEDDING_SIZE, VOCAB_SIZE);
+    // Get logits for the last token
+    LinearLayer logits_mlp = weights.logits_mlp;
+    float *logits = (logits_mlp.quantized != NULL) ? linear_quantized(last, logits_mlp.quantized, logits_mlp.biases)
+                    : (logits_mlp.half != NULL)    ? linear_half(last, logits_mlp.half, logits_mlp.biases)
+                                                   : linear(last, logits_mlp.weights, logits_mlp.biases, logits_mlp.fcInputSize, logits_mlp.fcOutputSize);
+    free(last);
 
-    printf("GPT-2 Weights initialization complete.\n");
-    return weights;
+    return logits;
 }
 
-// Function to free a LinearLayer
-void free_linear_layer(LinearLayer *layer)
+// Fused logits projection and token selection over the hidden states of numRows sequences.
+// The vocabSize logits are never written out, and the projection weights are streamed once
+// for the whole batch. Every selector must be initialized with its sequence's sampler.
+void select_tokens(float **hidden, int numRows, GPT2Weights weights, TokenSelector *selectors)
 {
-    for (int i = 0; i < layer->fcOutputSize; i++)
+    LinearLayer logits_mlp = weights.logits_mlp;
+    if (logits_mlp.quantized != NULL)
     {
-        free(layer->weights[i]);
+        linear_select_quantized_rows(hidden, numRows, logits_mlp.quantized, logits_mlp.biases, selectors);
+    }
+    else if (logits_mlp.half != NULL)
+    {
+        linear_select_half_rows(hidden, numRows, logits_mlp.half, logits_mlp.biases, selectors);
+    }
+    else
+    {
+        linear_select_rows(hidden, numRows, logits_mlp.weights, logits_mlp.biases, logits_mlp.fcInputSize, logits_mlp.fcOutputSize, selectors);
     }
-    free(layer->weights);
-    free(layer->biases);
 }
 
-// Function to free GPT2Weights
-void free_weights(GPT2Weights *weights)
+// Pick the next token straight from the last hidden state
+int next_token(float *hidden, GPT2Weights weights, SamplerConfig *sampler, int *history, int historyLength)
 {
-    // Free token embeddings
-    for (int i = 0; i < VOCAB_SIZE; i++)
-    {
-        free(weights->wte[i]);
-    }
-    free(weights->wte);
+    TokenSelector selector;
+    selector_init(&selector, sampler, weights.config.vocabSize, history, historyLength);
+    select_tokens(&hidden, 1, weights, &selector);
+    int token = selector_sample(&selector, sampler);
+    selector_free(&selector);
+    return token;
+}
 
-    // Free positional embeddings
-    for (int i = 0; i < MAX_POSITION_EMBEDDINGS; i++)
+// Autoregressive generation: prefill the prompt into the cache, then decode one token per step
+// until maxNewTokens, the end-of-text token, a full cache, or the callback asks to stop.
+// Every token is streamed to the callback as soon as it is sampled. Returns the number of tokens generated.
+int generate(int *prompt, int promptLength, int maxNewTokens, SamplerConfig sampler, GPT2Weights weights, KVCache *cache,
+             TokenCallback callback, void *userData, GenerationStats *stats)
+{
+    double start = omp_get_wtime();
+    double first_token_time = start;
+    int generated = 0;
+
+    // Prompt and generated tokens, for the repetition penalty
+    int *history = (int *)malloc((promptLength + maxNewTokens) * sizeof(int));
+    memcpy(history, prompt, promptLength * sizeof(int));
+
+    // Prefill: the prompt in chunks of PREFILL_CHUNK tokens, minus any prefix already in the prefix cache
+    KVPrefixCache *prefix = cache->pool->prefix;
+    int reused = (prefix != NULL) ? kv_prefix_lookup(prefix, cache, prompt, promptLength) : 0;
+    float *hidden = prefill(prompt + reused, promptLength - reused, weights, cache, PREFILL_CHUNK);
+    if (hidden != NULL && prefix != NULL)
     {
-        free(weights->wpe[i]);
+        kv_prefix_insert(prefix, cache, prompt, promptLength);
     }
-    free(weights->wpe);
 
-    // Free transformer blocks
-    for (int b = 0; b < NUM_BLOCKS; b++)
+    while (hidden != NULL && generated < maxNewTokens)
     {
-        // Free Q, K, V linear layers
-        free_linear_layer(&weights->blocks[b].q_mlp);
-        free_linear_layer(&weights->blocks[b].k_mlp);
-        free_linear_layer(&weights->blocks[b].v_mlp);
+        int token = next_token(hidden, weights, &sampler, history, promptLength + generated);
+        free(hidden);
+        hidden = NULL;
+        history[promptLength + generated] = token;
 
-        // Free MLP layers
-        free_linear_layer(&weights->blocks[b].first_block_MLP);
-        free_linear_layer(&weights->blocks[b].second_block_MLP);
+        if (generated == 0)
+        {
+            first_token_time = omp_get_wtime();
+        }
+        generated++;
+
+        if (callback != NULL && callback(token, generated - 1, userData) != 0)
+        {
+            break;
+        }
+        if (token == EOS_TOKEN || generated == maxNewTokens)
+        {
+            break;
+        }
+
+        // Decode: only the new token goes through the blocks
+        hidden = forward(&token, 1, weights, cache);
     }
-    free(weights->blocks);
+    free(hidden);
+    free(history);
 
-    // Free logits_mlp
-    free_linear_layer(&weights->logits_mlp);
+    if (stats != NULL)
+    {
+        double end = omp_get_wtime();
+        stats->num_generated = generated;
+        stats->time_to_first_token = first_token_time - start;
+        stats->mean_token_latency = (generated > 1) ? (end - first_token_time) / (generated - 1) : 0.0;
+        stats->tokens_per_second = (generated > 1) ? (generated - 1) / (end - first_token_time) : 0.0;
+    }
+    return generated;
 }
 
-// Test case
-int main()
+// Speculative decoding. The draft model proposes up to numDraft tokens one at a time, then the
+// main model scores the last token and all proposals in one forward. Token i is drawn with the
+// sampler state plain decoding would use for it, by both models, so the main model's choice
+// matches the draft whenever the two distributions agree under that draw. Proposals are
+// accepted up to the first mismatch, where the main model's own token is taken instead (or
+// an extra one after a fully accepted round), and the rejected positions are rolled back from
+// both caches. The result is the sequence generate() produces, in fewer main-model forwards.
+int generate_speculative(int *prompt, int promptLength, int maxNewTokens, SamplerConfig sampler, GPT2Weights weights, KVCache *cache,
+                         GPT2Weights draft, KVCache *draftCache, int numDraft, TokenCallback callback, void *userData,
+                         GenerationStats *stats, SpeculativeStats *speculative)
 {
-    // Seed the random number generator
-    srand(42);
-
-    // Define sequence length and tokens
-    // int seqLength = 5;
-    // int tokens[] = {10, 20, 30, 40, 50}; // Example token IDs
-
-    int seqLength = 16;
-    int tokens[16];
-    for (int i = 0; i < 16; i++)
+    double start = omp_get_wtime();
+    double first_token_time = start;
+    SpeculativeStats counts = {0, 0, 0};
+    int generated = 0;
+
+    // Prompt, emitted tokens and the proposals of the current round
+    int *history = (int *)malloc((promptLength + maxNewTokens + numDraft) * sizeof(int));
+    memcpy(history, prompt, promptLength * sizeof(int));
+    SamplerConfig *configs = (SamplerConfig *)malloc((numDraft + 1) * sizeof(SamplerConfig));
+    TokenSelector *selectors = (TokenSelector *)malloc((numDraft + 1) * sizeof(TokenSelector));
+
+    // Prefill the main model, which samples the first token; the draft catches up lazily
+    KVPrefixCache *prefix = cache->pool->prefix;
+    int reused = (prefix != NULL) ? kv_prefix_lookup(prefix, cache, prompt, promptLength) : 0;
+    float *hidden = prefill(prompt + reused, promptLength - reused, weights, cache, PREFILL_CHUNK);
+    int stop = (hidden == NULL);
+    if (!stop)
     {
-        tokens[i] = rand() % 10000;
+        if (prefix != NULL)
+        {
+            kv_prefix_insert(prefix, cache, prompt, promptLength);
+        }
+        int token = next_token(hidden, weights, &sampler, history, promptLength);
+        free(hidden);
+        history[promptLength] = token;
+        first_token_time = omp_get_wtime();
+        generated = 1;
+        stop = (callback != NULL && callback(token, 0, userData) != 0) || token == EOS_TOKEN;
     }
 
-    GPT2Weights weights = initialize_weights();
+    while (!stop && generated < maxNewTokens)
+    {
+        // history[length - 1] is the last emitted token, in neither cache yet. A round emits
+        // at most k + 1 tokens and feeds k + 1 rows to the main model.
+        int length = promptLength + generated;
+        int k = numDraft;
+        k = (k < maxNewTokens - generated - 1) ? k : maxNewTokens - generated - 1;
+        k = (k < MAX_POSITION_EMBEDDINGS - length) ? k : MAX_POSITION_EMBEDDINGS - length;
+        if (k < 0)
+        {
+            break; // the cache is full
+        }
 
-    clock_t start = clock();
+        // Draft: feed what the draft cache is missing, then propose k tokens. configs[j] is the
+        // sampler state for token j of the round.
+        configs[0] = sampler;
+        for (int j = 0; j < k; j++)
+        {
+            int from = draftCache->length;
+            float *draftHidden = prefill(&history[from], length + j - from, draft, draftCache, PREFILL_CHUNK);
+            if (draftHidden == NULL)
+            {
+                k = j;
+                break;
+            }
+            configs[j + 1] = configs[j];
+            TokenSelector selector;
+            selector_init(&selector, &configs[j + 1], weights.config.vocabSize, history, length + j);
+            select_tokens(&draftHidden, 1, draft, &selector);
+            history[length + j] = selector_sample(&selector, &configs[j + 1]);
+            selector_free(&selector);
+            free(draftHidden);
+        }
 
-    // Run the model
-    float *logits = model(tokens, seqLength, weights);
+        // Verify: one main forward over the last token and the k proposals, and one batched
+        // selection over its k + 1 rows
+        BatchSegment segment = {cache, 0, k + 1};
+        float **rows = forward_rows(&history[length - 1], weights, &segment, 1);
+        if (rows == NULL)
+        {
+            break;
+        }
+        for (int j = 0; j <= k; j++)
+        {
+            selector_init(&selectors[j], &configs[j], weights.config.vocabSize, history, length + j);
+        }
+        select_tokens(rows, k + 1, weights, selectors);
 
-    // Find the token with the highest logit value
-    int max_index = 0;
-    float max_value = logits[0];
-    for (int i = 1; i < VOCAB_SIZE; i++)
-    {
-        if (logits[i] > max_value)
+        int accepted = 0;
+        int token = -1;
+        for (int j = 0; j <= k; j++)
+        {
+            if (token < 0)
+            {
+                int choice = selector_sample(&selectors[j], &configs[j]);
+                if (j < k && choice == history[length + j])
+                {
+                    accepted++;
+                }
+                else
+                {
+                    token = choice;
+                    sampler = configs[j];
+                }
+            }
+            selector_free(&selectors[j]);
+            free(rows[j]);
+        }
+        free(rows);
+        history[length + accepted] = token;
+        counts.rounds++;
+        counts.drafted += k;
+        counts.accepted += accepted;
+
+        // Keep the last token and the accepted proposals in both caches
+        kv_cache_truncate(cache, length + accepted);
+        kv_cache_truncate(draftCache, length + accepted);
+
+        // Emit the accepted proposals and the main model's token
+        for (int j = 0; j <= accepted && !stop; j++)
         {
-            max_value = logits[i];
-            max_index = i;
+            int emitted = history[length + j];
+            generated++;
+            stop = (callback != NULL && callback(emitted, generated - 1, userData) != 0) || emitted == EOS_TOKEN;
         }
     }
+    free(selectors);
+    free(configs);
+    free(history);
+
+    if (stats != NULL)
+    {
+        double end = omp_get_wtime();
+        stats->num_generated = generated;
+        stats->time_to_first_token = first_token_time - start;
+        stats->mean_token_latency = (generated > 1) ? (end - first_token_time) / (generated - 1) : 0.0;
+        stats->tokens_per_second = (generated > 1) ? (generated - 1) / (end - first_token_time) : 0.0;
+    }
+    if (speculative != NULL)
+    {
+        *speculative = counts;
+    }
+    return generated;
+}
 
-    printf("Predicted next token ID: %d\n", max_index);
+// One hypothesis of beam search: its generated tokens, the last of which is not yet in cache
+typedef struct
+{
+    int *tokens;
+    int length;
+    float logprob;
+    KVCache *cache;
+} Beam;
 
-    clock_t end = clock();
-    double time_taken = ((double)(end - start)) / CLOCKS_PER_SEC;
-    printf("Prediction completed in %.4f seconds.\n", time_taken);
+static float beam_score(const Beam *beam)
+{
+    return beam->logprob / powf((float)beam->length, BEAM_LENGTH_PENALTY);
+}
 
-    free(logits);
+// Number of distinct pool blocks in the block tables of the beams
+static int beam_blocks(const Beam *beams, int numBeams, unsigned char *seen, int poolBlocks)
+{
+    memset(seen, 0, poolBlocks);
+    int count = 0;
+    for (int b = 0; b < numBeams; b++)
+    {
+        for (int i = 0; i < beams[b].cache->numBlocks; i++)
+        {
+            int block = beams[b].cache->blockTable[i];
+            count += !seen[block];
+            seen[block] = 1;
+        }
+    }
+    return count;
+}
+
+// Beam search over numBeams hypotheses. The prompt is prefilled once and every beam forks the
+// KV cache of its parent, so beams share the blocks of their common history and only copy the
+// partly filled block they write into. Each step runs one forward over the last token of every
+// beam and one batched top-k selection over all of them. A beam ending in the end-of-text token
+// is finished; the search stops when numBeams beams have finished, after maxNewTokens tokens,
+// or when the cache is full. The best finished beam is written to output[maxNewTokens].
+// Returns its length, or -1 if the prompt does not fit in the cache.
+int beam_search(int *prompt, int promptLength, int maxNewTokens, int numBeams, GPT2Weights weights, KVBlockPool *pool,
+                int *output, BeamStats *stats)
+{
+    KVCache *root = kv_cache_create(pool);
+    KVPrefixCache *prefix = pool->prefix;
+    int reused = (prefix != NULL) ? kv_prefix_lookup(prefix, root, prompt, promptLength) : 0;
+    float *hidden = prefill(prompt + reused, promptLength - reused, weights, root, PREFILL_CHUNK);
+    if (hidden == NULL)
+    {
+        kv_cache_free(root);
+        return -1;
+    }
+    if (prefix != NULL)
+    {
+        kv_prefix_insert(prefix, root, prompt, promptLength);
+    }
+
+    Beam *beams = (Beam *)malloc(numBeams * sizeof(Beam));
+    Beam *next = (Beam *)malloc(numBeams * sizeof(Beam));
+    Beam best = {(int *)malloc(maxNewTokens * sizeof(int)), 0, 0.0f, NULL};
+    int numFinished = 0;
+    int peak = root->numBlocks;
+    unsigned char *seen = (unsigned char *)malloc(pool->numBlocks);
+
+    TokenSelector *selectors = (TokenSelector *)malloc(numBeams * sizeof(TokenSelector));
+    int *candidateTokens = (int *)malloc(numBeams * numBeams * sizeof(int));
+    float *candidateLogprobs = (float *)malloc(numBeams * numBeams * sizeof(float));
+    int *candidateCounts = (int *)malloc(numBeams * sizeof(int));
+    float **hiddenRows = (float **)malloc(numBeams * sizeof(float *));
+    BatchSegment *segments = (BatchSegment *)malloc(numBeams * sizeof(BatchSegment));
+    int *lastTokens = (int *)malloc(numBeams * sizeof(int));
+
+    // Step 0 expands the prompt's single hypothesis, later steps every live beam
+    int numBeamsLive = 0;
+    int numParents = 1;
+    Beam rootBeam = {NULL, 0, 0.0f, root};
+    Beam *parents = &rootBeam;
+    hiddenRows[0] = hidden;
+
+    for (int step = 0; step < maxNewTokens; step++)
+    {
+        // Top numBeams continuations of every parent, from one batched projection
+        for (int p = 0; p < numParents; p++)
+        {
+            selector_init_top_k(&selectors[p], numBeams);
+        }
+        select_tokens(hiddenRows, numParents, weights, selectors);
+        for (int p = 0; p < numParents; p++)
+        {
+            candidateCounts[p] = selector_top_k(&selectors[p], &candidateTokens[p * numBeams], &candidateLogprobs[p * numBeams]);
+            selector_free(&selectors[p]);
+            free(hiddenRows[p]);
+        }
+
+        // Pick the best numBeams live extensions over all parents; an extension ending in the
+        // end-of-text token finishes instead, and replaces the best finished beam if it scores higher
+        int numNext = 0;
+        int numChosen = 0;
+        int *taken = (int *)calloc(numParents * numBeams, sizeof(int));
+        while (numNext < numBeams)
+        {
+            int choice = -1;
+            float choiceLogprob = -INFINITY;
+            for (int p = 0; p < numParents; p++)
+            {
+                for (int c = 0; c < candidateCounts[p]; c++)
+                {
+                    float logprob = parents[p].logprob + candidateLogprobs[p * numBeams + c];
+                    if (!taken[p * numBeams + c] && logprob > choiceLogprob)
+                    {
+                        choice = p * numBeams + c;
+                        choiceLogprob = logprob;
+                    }
+                }
+            }
+            if (choice < 0 || numChosen++ == 2 * numBeams)
+                break;
+            taken[choice] = 1;
+
+            Beam *parent = &parents[choice / numBeams];
+            Beam extended = {(int *)malloc(maxNewTokens * sizeof(int)), parent->length + 1, choiceLogprob, NULL};
+            memcpy(extended.tokens, parent->tokens, parent->length * sizeof(int));
+            extended.tokens[parent->length] = candidateTokens[choice];
+            if (candidateTokens[choice] == EOS_TOKEN)
+            {
+                if (numFinished++ == 0 || beam_score(&extended) > beam_score(&best))
+                {
+                    free(best.tokens);
+                    best = extended;
+                }
+                else
+                {
+                    free(extended.tokens);
+                }
+                continue;
+            }
+            extended.cache = kv_cache_fork(parent->cache);
+            next[numNext++] = extended;
+        }
+        free(taken);
+
+        // The parents' references go; blocks still used by a child stay
+        for (int p = 0; p < numParents; p++)
+        {
+            kv_cache_free(parents[p].cache);
+            free(parents[p].tokens);
+        }
+        Beam *swap = beams;
+        beams = next;
+        next = swap;
+        numBeamsLive = numNext;
+        parents = beams;
+        numParents = numBeamsLive;
+
+        int cacheFull = numBeamsLive > 0 && beams[0].cache->length >= MAX_POSITION_EMBEDDINGS;
+        if (numBeamsLive == 0 || numFinished >= numBeams || step + 1 == maxNewTokens || cacheFull)
+        {
+            break;
+        }
+
+        // Feed every beam's new token in one batched forward
+        for (int b = 0; b < numBeamsLive; b++)
+        {
+            lastTokens[b] = beams[b].tokens[beams[b].length - 1];
+            segments[b].cache = beams[b].cache;
+            segments[b].start = b;
+            segments[b].length = 1;
+        }
+        float **rows = forward_batch(lastTokens, weights, segments, numBeamsLive);
+        int used = beam_blocks(beams, numBeamsLive, seen, pool->numBlocks);
+        peak = (used > peak) ? used : peak;
+        if (rows == NULL)
+        {
+            break; // pool exhausted; finish with what the beams hold
+        }
+        memcpy(hiddenRows, rows, numBeamsLive * sizeof(float *));
+        free(rows);
+    }
+
+    // Unfinished beams compete with the finished ones
+    for (int b = 0; b < numBeamsLive; b++)
+    {
+        kv_cache_free(beams[b].cache);
+        beams[b].cache = NULL;
+        if (numFinished++ == 0 || beam_score(&beams[b]) > beam_score(&best))
+        {
+            free(best.tokens);
+            best = beams[b];
+        }
+        else
+        {
+            free(beams[b].tokens);
+        }
+    }
+
+    int length = best.length;
+    memcpy(output, best.tokens, length * sizeof(int));
+    if (stats != NULL)
+    {
+        stats->score = (length > 0) ? beam_score(&best) : 0.0f;
+        stats->peak_blocks = peak;
+    }
+    free(best.tokens);
+    free(beams);
+    free(next);
+    free(selectors);
+    free(candidateTokens);
+    free(candidateLogprobs);
+    free(candidateCounts);
+    free(hiddenRows);
+    free(segments);
+    free(lastTokens);
+    free(seen);
+    return length;
+}
+
+Scheduler *scheduler_create(GPT2Weights weights, KVBlockPool *pool, int maxBatch)
+{
+    Scheduler *scheduler = (Scheduler *)calloc(1, sizeof(Scheduler));
+    scheduler->weights = weights;
+    scheduler->pool = pool;
+    scheduler->maxBatch = maxBatch;
+    scheduler->prefillChunk = PREFILL_CHUNK;
+    scheduler->running = (Sequence **)malloc(maxBatch * sizeof(Sequence *));
+    return scheduler;
+}
+
+// Add a sequence to the back of the waiting queue, or to the front
+static void queue_sequence(Scheduler *scheduler, Sequence *seq, int front)
+{
+    if (scheduler->numWaiting == scheduler->waitingCapacity)
+    {
+        scheduler->waitingCapacity = scheduler->waitingCapacity ? scheduler->waitingCapacity * 2 : 16;
+        scheduler->waiting = (Sequence **)realloc(scheduler->waiting, scheduler->waitingCapacity * sizeof(Sequence *));
+    }
+    if (front)
+    {
+        memmove(scheduler->waiting + 1, scheduler->waiting, scheduler->numWaiting * sizeof(Sequence *));
+        scheduler->waiting[0] = seq;
+    }
+    else
+    {
+        scheduler->waiting[scheduler->numWaiting] = seq;
+    }
+    scheduler->numWaiting++;
+}
+
+// Queue a request; returns its id, or -1 if the prompt cannot fit MAX_POSITION_EMBEDDINGS.
+// maxNewTokens is capped at the positions left after the prompt.
+int scheduler_submit(Scheduler *scheduler, const int *prompt, int promptLength, int maxNewTokens, SamplerConfig sampler,
+                     TokenCallback callback, FinishCallback finish, void *userData)
+{
+    if (promptLength <= 0 || promptLength >= MAX_POSITION_EMBEDDINGS || maxNewTokens <= 0)
+    {
+        return -1;
+    }
+    if (maxNewTokens > MAX_POSITION_EMBEDDINGS - promptLength)
+    {
+        maxNewTokens = MAX_POSITION_EMBEDDINGS - promptLength;
+    }
+
+    Sequence *seq = (Sequence *)calloc(1, sizeof(Sequence));
+    seq->id = scheduler->nextId++;
+    seq->history = (int *)malloc((promptLength + maxNewTokens) * sizeof(int));
+    memcpy(seq->history, prompt, promptLength * sizeof(int));
+    seq->promptLength = promptLength;
+    seq->maxNewTokens = maxNewTokens;
+    seq->sampler = sampler;
+    seq->cache = kv_cache_create(scheduler->pool);
+    seq->callback = callback;
+    seq->finish = finish;
+    seq->userData = userData;
+    seq->submit_time = omp_get_wtime();
+    queue_sequence(scheduler, seq, 0);
+    return seq->id;
+}
+
+// Report a sequence's statistics and give its KV blocks back to the pool
+static void retire_sequence(Sequence *seq)
+{
+    if (seq->finish != NULL)
+    {
+        double end = omp_get_wtime();
+        GenerationStats stats;
+        stats.num_generated = seq->generated;
+        stats.time_to_first_token = (seq->generated > 0) ? seq->first_token_time - seq->submit_time : 0.0;
+        stats.mean_token_latency = (seq->generated > 1) ? (end - seq->first_token_time) / (seq->generated - 1) : 0.0;
+        stats.tokens_per_second = (seq->generated > 1) ? (seq->generated - 1) / (end - seq->first_token_time) : 0.0;
+        seq->finish(seq->id, &stats, seq->userData);
+    }
+    kv_cache_free(seq->cache);
+    free(seq->history);
+    free(seq);
+}
+
+// Free a running sequence's KV blocks and put it ahead of every waiting request. Its stream
+// stays open: once admitted again it recomputes the cache from its history and carries on.
+static void preempt_sequence(Scheduler *scheduler, Sequence *seq)
+{
+    kv_cache_reset(seq->cache);
+    seq->preemptions++;
+    scheduler->preemptions++;
+    queue_sequence(scheduler, seq, 1);
+}
+
+// Whether a running sequence is still prefilling full prompt blocks that seq could map from
+// the prefix cache once they are committed. Admitting seq now would compute them twice.
+static int awaits_shared_prefix(const Scheduler *scheduler, const Sequence *seq)
+{
+    int blockTokens = scheduler->pool->blockTokens;
+    for (int r = 0; r < scheduler->numRunning; r++)
+    {
+        const Sequence *other = scheduler->running[r];
+        // Lookups never map a prompt's last token, so neither side shares blocks past it
+        int limit = (seq->promptLength < other->promptLength ? seq->promptLength : other->promptLength) - 1;
+        int common = 0;
+        while (common < limit && seq->history[common] == other->history[common])
+        {
+            common++;
+        }
+        common -= common % blockTokens;
+        if (common > 0 && other->cache->length < common)
+            return 1;
+    }
+    return 0;
+}
+
+// Run one step of the running batch. Returns the number of requests still waiting or running.
+int scheduler_step(Scheduler *scheduler)
+{
+    // Admit waiting requests in arrival order while the pool can hold their prompt (with any
+    // tokens generated before a preemption) and next token. Cached prefix blocks are mapped
+    // first, so they need no new blocks; a request whose prefix blocks a running sequence is
+    // still prefilling waits for them to reach the prefix cache.
+    KVPrefixCache *prefix = scheduler->pool->prefix;
+    int admitted = 0;
+    while (admitted < scheduler->numWaiting && scheduler->numRunning < scheduler->maxBatch)
+    {
+        Sequence *seq = scheduler->waiting[admitted];
+        if (prefix != NULL && awaits_shared_prefix(scheduler, seq))
+            break;
+        int context = seq->promptLength + seq->generated;
+        int reused = (prefix != NULL) ? kv_prefix_lookup(prefix, seq->cache, seq->history, context) : 0;
+        if (kv_cache_reserve(seq->cache, context + 1) != 0)
+        {
+            kv_cache_reset(seq->cache);
+            break;
+        }
+        if (seq->preemptions == 0)
+        {
+            scheduler->promptTokens += seq->promptLength;
+            scheduler->reusedTokens += reused;
+        }
+        scheduler->running[scheduler->numRunning++] = seq;
+        admitted++;
+    }
+    scheduler->numWaiting -= admitted;
+    memmove(scheduler->waiting, scheduler->waiting + admitted, scheduler->numWaiting * sizeof(Sequence *));
+
+    // Lay out the batch: the last sampled token of decoding sequences, and the next chunk of
+    // the uncached history of prefilling (or preempted) ones. Prompt rows share a budget of
+    // prefillChunk per step, so a long prompt is spread over several steps instead of stalling
+    // every decoding sequence behind it. When a cache cannot grow by its next rows, the newest
+    // sequences are preempted until it can, the sequence itself last.
+    int *lengths = (int *)malloc(scheduler->numRunning * sizeof(int));
+    int budget = scheduler->prefillChunk;
+    int numRows = 0;
+    int numSegments = 0;
+    int kept = 0;
+    for (int s = 0; s < scheduler->numRunning; s++)
+    {
+        Sequence *seq = scheduler->running[s];
+        int length = seq->promptLength + seq->generated - seq->cache->length;
+        if (seq->generated == 0 || length > 1)
+        {
+            length = (length < budget) ? length : budget;
+            budget -= length;
+        }
+        int reserved = length == 0 || kv_cache_reserve(seq->cache, seq->cache->length + length) == 0;
+        while (!reserved && scheduler->numRunning - 1 > s)
+        {
+            preempt_sequence(scheduler, scheduler->running[--scheduler->numRunning]);
+            reserved = kv_cache_reserve(seq->cache, seq->cache->length + length) == 0;
+        }
+        if (!reserved)
+        {
+            preempt_sequence(scheduler, seq);
+            continue;
+        }
+        lengths[kept] = length;
+        scheduler->running[kept++] = seq;
+        numRows += length;
+        numSegments += (length > 0);
+    }
+    scheduler->numRunning = kept;
+    if (numSegments == 0)
+    {
+        free(lengths);
+        return scheduler->numRunning + scheduler->numWaiting;
+    }
+
+    int *tokens = (int *)malloc(numRows * sizeof(int));
+    BatchSegment *segments = (BatchSegment *)calloc(numSegments, sizeof(BatchSegment));
+    int row = 0;
+    int segment = 0;
+    for (int s = 0; s < kept; s++)
+    {
+        Sequence *seq = scheduler->running[s];
+        if (lengths[s] == 0)
+            continue;
+        memcpy(&tokens[row], &seq->history[seq->cache->length], lengths[s] * sizeof(int));
+        segments[segment].cache = seq->cache;
+        segments[segment].start = row;
+        segments[segment].length = lengths[s];
+        segment++;
+        row += lengths[s];
+    }
+
+    float **hidden = forward_batch(tokens, scheduler->weights, segments, numSegments);
+    free(segments);
+    free(tokens);
+    if (hidden == NULL)
+    {
+        // Unreachable after the reservations above; drop the batch rather than spin on it
+        for (int s = 0; s < kept; s++)
+        {
+            retire_sequence(scheduler->running[s]);
+        }
+        scheduler->numRunning = 0;
+        free(lengths);
+        return scheduler->numWaiting;
+    }
+
+    // Only sequences whose whole prompt is now cached sample a token; the hidden state of an
+    // intermediate prompt chunk is dropped. Prompt blocks go into the prefix cache as soon as
+    // their chunk commits, so the next step's admissions can map them.
+    int *sampling = (int *)malloc(numSegments * sizeof(int)); // indices into running
+    int numSampling = 0;
+    segment = 0;
+    for (int s = 0; s < kept; s++)
+    {
+        Sequence *seq = scheduler->running[s];
+        if (lengths[s] == 0)
+            continue;
+        if (prefix != NULL && seq->cache->length - lengths[s] < seq->promptLength)
+        {
+            kv_prefix_insert(prefix, seq->cache, seq->history, seq->promptLength);
+        }
+        if (seq->cache->length == seq->promptLength + seq->generated)
+        {
+            sampling[numSampling] = s;
+            hidden[numSampling++] = hidden[segment];
+        }
+        else
+        {
+            free(hidden[segment]);
+        }
+        segment++;
+    }
+    free(lengths);
+
+    TokenSelector *selectors = (TokenSelector *)malloc(numSampling * sizeof(TokenSelector));
+    for (int s = 0; s < numSampling; s++)
+    {
+        Sequence *seq = scheduler->running[sampling[s]];
+        selector_init(&selectors[s], &seq->sampler, scheduler->weights.config.vocabSize, seq->history, seq->promptLength + seq->generated);
+    }
+    select_tokens(hidden, numSampling, scheduler->weights, selectors);
+
+    // Stream every sampled token and retire the sequences that are done
+    double now = omp_get_wtime();
+    for (int s = 0; s < numSampling; s++)
+    {
+        Sequence *seq = scheduler->running[sampling[s]];
+        int token = selector_sample(&selectors[s], &seq->sampler);
+        selector_free(&selectors[s]);
+        free(hidden[s]);
+
+        seq->history[seq->promptLength + seq->generated] = token;
+        if (seq->generated == 0)
+        {
+            seq->first_token_time = now;
+        }
+        seq->generated++;
+
+        int stop = seq->callback != NULL && seq->callback(token, seq->generated - 1, seq->userData) != 0;
+        if (stop || token == EOS_TOKEN || seq->generated == seq->maxNewTokens || seq->cache->length >= MAX_POSITION_EMBEDDINGS)
+        {
+            retire_sequence(seq);
+            scheduler->running[sampling[s]] = NULL;
+        }
+    }
+
+    // Keep the running order, so prompts keep their place in the prefill budget
+    scheduler->numRunning = 0;
+    for (int s = 0; s < kept; s++)
+    {
+        if (scheduler->running[s] != NULL)
+            scheduler->running[scheduler->numRunning++] = scheduler->running[s];
+    }
+
+    free(sampling);
+    free(selectors);
+    free(hidden);
+    return scheduler->numRunning + scheduler->numWaiting;
+}
+
+// Drop every request still queued or running
+void scheduler_free(Scheduler *scheduler)
+{
+    for (int s = 0; s < scheduler->numRunning; s++)
+    {
+        retire_sequence(scheduler->running[s]);
+    }
+    for (int s = 0; s < scheduler->numWaiting; s++)
+    {
+        retire_sequence(scheduler->waiting[s]);
+    }
+    free(scheduler->running);
+    free(scheduler->waiting);
+    free(scheduler);
+}
+
+// Row pointers into one contiguous, cache-line aligned [rows][cols] buffer
+float **allocate_rows(int rows, int cols)
+{
+    float **matrix = (float **)malloc(rows * sizeof(float *));
+    size_t bytes = ((size_t)rows * cols * sizeof(float) + 63) & ~(size_t)63;
+    float *data = (float *)aligned_alloc(64, bytes);
+    for (int i = 0; i < rows; i++)
+    {
+        matrix[i] = data + (size_t)i * cols;
+    }
+    return matrix;
+}
+
+// Fill a contiguous matrix with uniform values in [-0.01, 0.01). Philox is counter-based, so
+// every chunk is generated independently and the result does not depend on the thread count.
+void fill_random_rows(float **matrix, int rows, int cols, uint64_t stream)
+{
+    size_t count = (size_t)rows * cols;
+    long numChunks = (long)((count + INIT_CHUNK - 1) / INIT_CHUNK);
+
+#pragma omp parallel for schedule(static)
+    for (long c = 0; c < numChunks; c++)
+    {
+        size_t start = (size_t)c * INIT_CHUNK;
+        size_t length = (count - start < INIT_CHUNK) ? count - start : INIT_CHUNK;
+        philox_fill_uniform(matrix[0] + start, length, INIT_SEED, stream, start, -0.01f, 0.01f);
+    }
+}
+
+void initialize_linear_layer(LinearLayer *layer, int inputSize, int outputSize, uint64_t stream)
+{
+    layer->fcInputSize = inputSize;
+    layer->fcOutputSize = outputSize;
+    layer->weights = allocate_rows(outputSize, inputSize);
+    layer->biases = (float *)calloc(outputSize, sizeof(float)); // Initialize biases to zero
+    layer->quantized = NULL;
+    layer->half = NULL;
+    layer->init_stream = stream;
+    layer->pending = LAZY_INIT;
+    if (!layer->pending)
+    {
+        fill_random_rows(layer->weights, outputSize, inputSize, stream);
+    }
+}
+
+void materialize_linear_layer(LinearLayer *layer)
+{
+    if (layer->pending)
+    {
+        fill_random_rows(layer->weights, layer->fcOutputSize, layer->fcInputSize, layer->init_stream);
+        layer->pending = 0;
+    }
+}
+
+// Generate a block's weights on first use when they were initialized lazily
+void materialize_block(BlockWeights *weights)
+{
+    materialize_linear_layer(&weights->q_mlp);
+    materialize_linear_layer(&weights->k_mlp);
+    materialize_linear_layer(&weights->v_mlp);
+    materialize_linear_layer(&weights->first_block_MLP);
+    materialize_linear_layer(&weights->second_block_MLP);
+}
+
+// Random weights of the given size for benchmarking. Each tensor has its own Philox stream: 0 for wte, 1 for wpe,
+// then five per block and one for an untied logits projection.
+GPT2Weights initialize_weights(const GPT2Config *config)
+{
+    // Initialize GPT2Weights
+    GPT2Weights weights;
+    int embeddingSize = config->embeddingSize;
+    int vocabSize = config->vocabSize;
+    weights.config = *config;
+    uint64_t stream = 0;
+
+    // Initialize token embeddings (wte)
+    weights.wte = allocate_rows(vocabSize, embeddingSize);
+    fill_random_rows(weights.wte, vocabSize, embeddingSize, stream++);
+
+    // Initialize positional embeddings (wpe)
+    weights.wpe = allocate_rows(MAX_POSITION_EMBEDDINGS, embeddingSize);
+    fill_random_rows(weights.wpe, MAX_POSITION_EMBEDDINGS, embeddingSize, stream++);
+
+    weights.blocks = (BlockWeights *)malloc(config->numBlocks * sizeof(BlockWeights));
+    weights.numBlocks = config->numBlocks;
+    for (int b = 0; b < config->numBlocks; b++)
+    {
+        // Initialize Q, K, V linear layers using the helper function
+        initialize_linear_layer(&weights.blocks[b].q_mlp, embeddingSize, embeddingSize, stream++);
+        initialize_linear_layer(&weights.blocks[b].k_mlp, embeddingSize, embeddingSize, stream++);
+        initialize_linear_layer(&weights.blocks[b].v_mlp, embeddingSize, embeddingSize, stream++);
+
+        // Initialize MLP layers
+        int mlpHiddenSize = embeddingSize * 4; // MLP hidden size is typically 4x the embedding size
+        initialize_linear_layer(&weights.blocks[b].first_block_MLP, embeddingSize, mlpHiddenSize, stream++);
+        initialize_linear_layer(&weights.blocks[b].second_block_MLP, mlpHiddenSize, embeddingSize, stream++);
+    }
+
+    // Initialize logits_mlp. GPT-2 ties it to the token embeddings: wte is stored as
+    // [vocabSize][embeddingSize], which is already the [output][input] layout of a linear
+    // layer, so logits = wte * h reads each row contiguously and needs no transpose.
+    weights.tied_embeddings = TIE_EMBEDDINGS;
+    if (weights.tied_embeddings)
+    {
+        weights.logits_mlp.fcInputSize = embeddingSize;
+        weights.logits_mlp.fcOutputSize = vocabSize;
+        weights.logits_mlp.weights = weights.wte;
+        weights.logits_mlp.biases = (float *)calloc(vocabSize, sizeof(float)); // GPT-2's lm_head has no bias
+        weights.logits_mlp.pending = 0;
+        weights.logits_mlp.quantized = NULL;
+        weights.logits_mlp.half = NULL;
+    }
+    else
+    {
+        initialize_linear_layer(&weights.logits_mlp, embeddingSize, vocabSize, stream);
+        materialize_linear_layer(&weights.logits_mlp);
+    }
+
+    weights.wte_half = NULL;
+    weights.checkpoint = NULL;
+    printf("GPT-2 Weights initialization complete.\n");
+    return weights;
+}
+
+// Row pointers into a mapped [rows][cols] float32 tensor; NULL if it is missing or mis-shaped
+float **map_rows(Checkpoint *checkpoint, const char *name, int rows, int cols)
+{
+    const CheckpointTensor *tensor = checkpoint_find(checkpoint, name);
+    if (tensor == NULL || tensor->dtype != CHECKPOINT_FLOAT32 || tensor->ndim != 2 ||
+        tensor->shape[0] != (uint32_t)rows || tensor->shape[1] != (uint32_t)cols)
+    {
+        fprintf(stderr, "Error: checkpoint tensor %s is missing or not [%d][%d] float32\n", name, rows, cols);
+        return NULL;
+    }
+
+    float *data = (float *)checkpoint_data(checkpoint, tensor);
+    float **matrix = (float **)malloc(rows * sizeof(float *));
+    for (int i = 0; i < rows; i++)
+    {
+        matrix[i] = data + (size_t)i * cols;
+    }
+    return matrix;
+}
+
+// Pointer into a mapped [size] float32 tensor; NULL if it is missing or mis-shaped
+float *map_vector(Checkpoint *checkpoint, const char *name, int size)
+{
+    const CheckpointTensor *tensor = checkpoint_find(checkpoint, name);
+    if (tensor == NULL || tensor->dtype != CHECKPOINT_FLOAT32 || tensor->ndim != 1 || tensor->shape[0] != (uint32_t)size)
+    {
+        fprintf(stderr, "Error: checkpoint tensor %s is missing or not [%d] float32\n", name, size);
+        return NULL;
+    }
+    return (float *)checkpoint_data(checkpoint, tensor);
+}
+
+// Map the [output][input] weights of a layer. float32 tensors become row pointers; int8
+// tensors written by convert_checkpoint's q8 op, with their per-row "<name>.scale", are used
+// in place as a per-output-channel QUANT_INT8 matrix.
+int map_layer_weights(LinearLayer *layer, Checkpoint *checkpoint, const char *name)
+{
+    const CheckpointTensor *tensor = checkpoint_find(checkpoint, name);
+    if (tensor == NULL || tensor->dtype != CHECKPOINT_INT8)
+    {
+        layer->weights = map_rows(checkpoint, name, layer->fcOutputSize, layer->fcInputSize);
+        return layer->weights != NULL ? 0 : -1;
+    }
+
+    char scaleName[CHECKPOINT_NAME_LENGTH];
+    snprintf(scaleName, sizeof(scaleName), "%s.scale", name);
+    float *scales = map_vector(checkpoint, scaleName, layer->fcOutputSize);
+    if (tensor->ndim != 2 || tensor->shape[0] != (uint32_t)layer->fcOutputSize || tensor->shape[1] != (uint32_t)layer->fcInputSize ||
+        scales == NULL)
+    {
+        fprintf(stderr, "Error: checkpoint tensor %s is not [%d][%d] int8 with a [%d] scale\n", name, layer->fcOutputSize,
+                layer->fcInputSize, layer->fcOutputSize);
+        return -1;
+    }
+    layer->quantized = quantized_matrix_view_int8((int8_t *)checkpoint_data(checkpoint, tensor), scales, layer->fcOutputSize, layer->fcInputSize);
+    return 0;
+}
+
+int map_linear_layer(LinearLayer *layer, Checkpoint *checkpoint, const char *prefix, int inputSize, int outputSize)
+{
+    char name[CHECKPOINT_NAME_LENGTH];
+    layer->fcInputSize = inputSize;
+    layer->fcOutputSize = outputSize;
+
+    snprintf(name, sizeof(name), "%s.weight", prefix);
+    int ok = map_layer_weights(layer, checkpoint, name) == 0;
+    snprintf(name, sizeof(name), "%s.bias", prefix);
+    layer->biases = map_vector(checkpoint, name, outputSize);
+    return (ok && layer->biases != NULL) ? 0 : -1;
+}
+
+// The model size of a checkpoint: wte is [vocabSize][embeddingSize], and the embedding size
+// picks the matching GPT-2 configuration
+int config_from_checkpoint(Checkpoint *checkpoint, GPT2Config *config)
+{
+    const CheckpointTensor *wte = checkpoint_find(checkpoint, "wte");
+    if (wte == NULL || wte->ndim != 2)
+    {
+        fprintf(stderr, "Error: checkpoint has no 2D wte tensor\n");
+        return -1;
+    }
+    for (int c = 0; c < NUM_GPT2_CONFIGS; c++)
+    {
+        if (wte->shape[1] == (uint32_t)GPT2_CONFIGS[c].embeddingSize)
+        {
+            *config = GPT2_CONFIGS[c];
+            config->vocabSize = (int)wte->shape[0];
+            return 0;
+        }
+    }
+    fprintf(stderr, "Error: no GPT-2 configuration has embedding size %u\n", wte->shape[1]);
+    return -1;
+}
+
+// Load weights from a binary checkpoint without copying: every matrix row points into the
+// read-only mapping, so startup cost is building row tables and pages fault in on first use.
+// Tensors are [output][input]; lm_head.weight is optional and the projection is tied to wte
+// when it is absent. Linear weights quantized offline to int8 are mapped as they are (see
+// map_layer_weights). The model size is taken from the checkpoint.
+int load_weights(const char *path, GPT2Weights *weights)
+{
+    Checkpoint *checkpoint = checkpoint_open(path);
+    if (checkpoint == NULL)
+    {
+        return -1;
+    }
+
+    memset(weights, 0, sizeof(GPT2Weights));
+    weights->checkpoint = checkpoint;
+    if (config_from_checkpoint(checkpoint, &weights->config) != 0)
+    {
+        free_weights(weights);
+        return -1;
+    }
+    int embeddingSize = weights->config.embeddingSize;
+    int vocabSize = weights->config.vocabSize;
+    weights->wte = map_rows(checkpoint, "wte", vocabSize, embeddingSize);
+    weights->wpe = map_rows(checkpoint, "wpe", MAX_POSITION_EMBEDDINGS, embeddingSize);
+    int ok = weights->wte != NULL && weights->wpe != NULL;
+
+    weights->blocks = (BlockWeights *)calloc(weights->config.numBlocks, sizeof(BlockWeights));
+    weights->numBlocks = weights->config.numBlocks;
+    for (int b = 0; b < weights->config.numBlocks; b++)
+    {
+        char prefix[32];
+        int mlpHiddenSize = embeddingSize * 4;
+        snprintf(prefix, sizeof(prefix), "h.%d.q", b);
+        ok = map_linear_layer(&weights->blocks[b].q_mlp, checkpoint, prefix, embeddingSize, embeddingSize) == 0 && ok;
+        snprintf(prefix, sizeof(prefix), "h.%d.k", b);
+        ok = map_linear_layer(&weights->blocks[b].k_mlp, checkpoint, prefix, embeddingSize, embeddingSize) == 0 && ok;
+        snprintf(prefix, sizeof(prefix), "h.%d.v", b);
+        ok = map_linear_layer(&weights->blocks[b].v_mlp, checkpoint, prefix, embeddingSize, embeddingSize) == 0 && ok;
+        snprintf(prefix, sizeof(prefix), "h.%d.mlp_fc", b);
+        ok = map_linear_layer(&weights->blocks[b].first_block_MLP, checkpoint, prefix, embeddingSize, mlpHiddenSize) == 0 && ok;
+        snprintf(prefix, sizeof(prefix), "h.%d.mlp_proj", b);
+        ok = map_linear_layer(&weights->blocks[b].second_block_MLP, checkpoint, prefix, mlpHiddenSize, embeddingSize) == 0 && ok;
+    }
+
+    // The logits biases are always a private zeroed (or copied) buffer
+    weights->tied_embeddings = checkpoint_find(checkpoint, "lm_head.weight") == NULL;
+    weights->logits_mlp.fcInputSize = embeddingSize;
+    weights->logits_mlp.fcOutputSize = vocabSize;
+    if (weights->tied_embeddings)
+        weights->logits_mlp.weights = weights->wte;
+    else
+        ok = map_layer_weights(&weights->logits_mlp, checkpoint, "lm_head.weight") == 0 && ok;
+    weights->logits_mlp.biases = (float *)calloc(vocabSize, sizeof(float));
+    if (checkpoint_find(checkpoint, "lm_head.bias") != NULL)
+    {
+        float *bias = map_vector(checkpoint, "lm_head.bias", vocabSize);
+        ok = bias != NULL && ok;
+        if (bias != NULL)
+        {
+            memcpy(weights->logits_mlp.biases, bias, vocabSize * sizeof(float));
+        }
+    }
+    ok = (weights->logits_mlp.weights != NULL || weights->logits_mlp.quantized != NULL) && ok;
+
+    if (!ok)
+    {
+        free_weights(weights);
+        return -1;
+    }
+    return 0;
+}
+
+int save_linear_layer(CheckpointWriter *writer, LinearLayer *layer, const char *prefix)
+{
+    char name[CHECKPOINT_NAME_LENGTH];
+    int shape[1] = {layer->fcOutputSize};
+    snprintf(name, sizeof(name), "%s.weight", prefix);
+    if (checkpoint_writer_add_rows(writer, name, layer->fcOutputSize, layer->fcInputSize, layer->weights) != 0)
+        return -1;
+    snprintf(name, sizeof(name), "%s.bias", prefix);
+    return checkpoint_writer_add(writer, name, CHECKPOINT_FLOAT32, 1, shape, layer->biases);
+}
+
+// Write weights in the layout load_weights maps
+int save_weights(GPT2Weights *weights, const char *path)
+{
+    CheckpointWriter *writer = checkpoint_writer_create(path);
+    if (writer == NULL)
+    {
+        return -1;
+    }
+
+    const GPT2Config *config = &weights->config;
+    int ok = checkpoint_writer_add_rows(writer, "wte", config->vocabSize, config->embeddingSize, weights->wte) == 0;
+    ok = checkpoint_writer_add_rows(writer, "wpe", MAX_POSITION_EMBEDDINGS, config->embeddingSize, weights->wpe) == 0 && ok;
+    for (int b = 0; b < config->numBlocks; b++)
+    {
+        char prefix[32];
+        materialize_block(&weights->blocks[b]);
+        snprintf(prefix, sizeof(prefix), "h.%d.q", b);
+        ok = save_linear_layer(writer, &weights->blocks[b].q_mlp, prefix) == 0 && ok;
+        snprintf(prefix, sizeof(prefix), "h.%d.k", b);
+        ok = save_linear_layer(writer, &weights->blocks[b].k_mlp, prefix) == 0 && ok;
+        snprintf(prefix, sizeof(prefix), "h.%d.v", b);
+        ok = save_linear_layer(writer, &weights->blocks[b].v_mlp, prefix) == 0 && ok;
+        snprintf(prefix, sizeof(prefix), "h.%d.mlp_fc", b);
+        ok = save_linear_layer(writer, &weights->blocks[b].first_block_MLP, prefix) == 0 && ok;
+        snprintf(prefix, sizeof(prefix), "h.%d.mlp_proj", b);
+        ok = save_linear_layer(writer, &weights->blocks[b].second_block_MLP, prefix) == 0 && ok;
+    }
+    if (!weights->tied_embeddings)
+    {
+        ok = save_linear_layer(writer, &weights->logits_mlp, "lm_head") == 0 && ok;
+    }
+
+    // Always close so the file handle is released even after a failed add
+    return (checkpoint_writer_close(writer) == 0 && ok) ? 0 : -1;
+}
+
+// Function to free a LinearLayer
+void free_linear_layer(LinearLayer *layer)
+{
+    if (layer->weights != NULL)
+    {
+        free(layer->weights[0]);
+        free(layer->weights);
+    }
+    quantized_matrix_free(layer->quantized);
+    half_matrix_free(layer->half);
+    free(layer->biases);
+}
+
+// Replace a layer's fp32 weights with a quantized copy. Mapped rows cost nothing once
+// untouched, so only malloc'd ones that nothing else reads are released.
+void quantize_linear_layer(LinearLayer *layer, QuantType type, int groupSize, int release)
+{
+    if (layer->quantized != NULL)
+    {
+        return; // quantized offline and mapped from the checkpoint
+    }
+    materialize_linear_layer(layer);
+    layer->quantized = (type == QUANT_INT4) ? quantize_int4(layer->weights, layer->fcOutputSize, layer->fcInputSize, groupSize)
+                                            : quantize_int8(layer->weights, layer->fcOutputSize, layer->fcInputSize, groupSize);
+    if (release && layer->quantized != NULL)
+    {
+        free(layer->weights[0]);
+        free(layer->weights);
+        layer->weights = NULL;
+    }
+}
+
+// Weight-only quantization of the block linears and, separately, the logits projection. A
+// tied projection keeps wte in fp32 for the embedding lookup next to its quantized copy.
+void quantize_weights(GPT2Weights *weights, QuantType blockType, QuantType logitsType, int groupSize)
+{
+    int mapped = weights->checkpoint != NULL;
+    for (int b = 0; b < weights->config.numBlocks && blockType != QUANT_NONE; b++)
+    {
+        quantize_linear_layer(&weights->blocks[b].q_mlp, blockType, groupSize, !mapped);
+        quantize_linear_layer(&weights->blocks[b].k_mlp, blockType, groupSize, !mapped);
+        quantize_linear_layer(&weights->blocks[b].v_mlp, blockType, groupSize, !mapped);
+        quantize_linear_layer(&weights->blocks[b].first_block_MLP, blockType, groupSize, !mapped);
+        quantize_linear_layer(&weights->blocks[b].second_block_MLP, blockType, groupSize, !mapped);
+    }
+    if (logitsType != QUANT_NONE)
+    {
+        quantize_linear_layer(&weights->logits_mlp, logitsType, groupSize, !mapped && !weights->tied_embeddings);
+    }
+}
+
+// Replace a layer's fp32 weights with a 16-bit copy, releasing them like quantize_linear_layer
+void halve_linear_layer(LinearLayer *layer, HalfType type, int release)
+{
+    materialize_linear_layer(layer);
+    layer->half = half_matrix_from_rows(layer->weights, layer->fcOutputSize, layer->fcInputSize, type);
+    if (release && layer->half != NULL)
+    {
+        free(layer->weights[0]);
+        free(layer->weights);
+        layer->weights = NULL;
+    }
+}
+
+// 16-bit storage of wte and of every linear layer left in fp32 by quantize_weights. A tied
+// projection shares the 16-bit wte unless it has its own quantized copy.
+void halve_weights(GPT2Weights *weights, HalfType type)
+{
+    if (type == HALF_NONE)
+    {
+        return;
+    }
+    int mapped = weights->checkpoint != NULL;
+    for (int b = 0; b < weights->config.numBlocks; b++)
+    {
+        LinearLayer *layers[5] = {&weights->blocks[b].q_mlp, &weights->blocks[b].k_mlp, &weights->blocks[b].v_mlp,
+                                  &weights->blocks[b].first_block_MLP, &weights->blocks[b].second_block_MLP};
+        for (int l = 0; l < 5; l++)
+        {
+            if (layers[l]->quantized == NULL)
+            {
+                halve_linear_layer(layers[l], type, !mapped);
+            }
+        }
+    }
+
+    weights->wte_half = half_matrix_from_rows(weights->wte, weights->config.vocabSize, weights->config.embeddingSize, type);
+    if (!weights->tied_embeddings && weights->logits_mlp.quantized == NULL)
+    {
+        halve_linear_layer(&weights->logits_mlp, type, !mapped);
+    }
+    else if (weights->tied_embeddings)
+    {
+        weights->logits_mlp.half = (weights->logits_mlp.quantized == NULL) ? weights->wte_half : NULL;
+    }
+    if (!mapped)
+    {
+        free(weights->wte[0]);
+        free(weights->wte);
+        weights->wte = NULL;
+        if (weights->tied_embeddings)
+        {
+            weights->logits_mlp.weights = NULL;
+        }
+    }
+}
+
+// Free the row tables of weights loaded by load_weights, then unmap the checkpoint
+void free_mapped_weights(GPT2Weights *weights)
+{
+    free(weights->wte);
+    free(weights->wpe);
+    for (int b = 0; b < weights->config.numBlocks && weights->blocks != NULL; b++)
+    {
+        LinearLayer *layers[5] = {&weights->blocks[b].q_mlp, &weights->blocks[b].k_mlp, &weights->blocks[b].v_mlp,
+                                  &weights->blocks[b].first_block_MLP, &weights->blocks[b].second_block_MLP};
+        for (int l = 0; l < 5; l++)
+        {
+            free(layers[l]->weights);
+            quantized_matrix_free(layers[l]->quantized);
+            half_matrix_free(layers[l]->half);
+        }
+    }
+    free(weights->blocks);
+    if (!weights->tied_embeddings)
+    {
+        free(weights->logits_mlp.weights);
+        half_matrix_free(weights->logits_mlp.half);
+    }
+    free(weights->logits_mlp.biases);
+    quantized_matrix_free(weights->logits_mlp.quantized);
+    half_matrix_free(weights->wte_half);
+    checkpoint_close(weights->checkpoint);
+}
+
+// Function to free GPT2Weights
+void free_weights(GPT2Weights *weights)
+{
+    if (weights->checkpoint != NULL)
+    {
+        free_mapped_weights(weights);
+        return;
+    }
+
+    // Free token and positional embeddings; wte is gone once a 16-bit copy replaced it
+    if (weights->wte != NULL)
+    {
+        free(weights->wte[0]);
+        free(weights->wte);
+    }
+    half_matrix_free(weights->wte_half);
+    free(weights->wpe[0]);
+    free(weights->wpe);
+
+    // Free transformer blocks
+    for (int b = 0; b < weights->config.numBlocks; b++)
+    {
+        // Free Q, K, V linear layers
+        free_linear_layer(&weights->blocks[b].q_mlp);
+        free_linear_layer(&weights->blocks[b].k_mlp);
+        free_linear_layer(&weights->blocks[b].v_mlp);
+
+        // Free MLP layers
+        free_linear_layer(&weights->blocks[b].first_block_MLP);
+        free_linear_layer(&weights->blocks[b].second_block_MLP);
+    }
+    free(weights->blocks);
+
+    // Free logits_mlp, whose rows (fp32 or 16-bit) belong to wte when tied
+    if (weights->tied_embeddings)
+    {
+        free(weights->logits_mlp.biases);
+        quantized_matrix_free(weights->logits_mlp.quantized);
+    }
+    else
+    {
+        free_linear_layer(&weights->logits_mlp);
+    }
+}
+
+// Streams each generated token to stdout
+int print_token(int token, int index, void *userData)
+{
+    (void)index;
+    (void)userData;
+    printf("%d ", token);
+    fflush(stdout);
+    return 0;
+}
+
+// Totals over the requests of run_batch
+typedef struct
+{
+    int finished;
+    int tokens;
+    double time_to_first_token;
+} BatchReport;
+
+void collect_stats(int id, const GenerationStats *stats, void *userData)
+{
+    (void)id;
+    BatchReport *report = (BatchReport *)userData;
+    report->finished++;
+    report->tokens += stats->num_generated;
+    report->time_to_first_token += stats->time_to_first_token;
+}
+
+// Serve numRequests requests with different random prompts through the continuous-batching
+// scheduler, and report the throughput over all of them. Every prompt starts with the same
+// sharedPrefix tokens, like a common system prompt, followed by seqLength tokens of its own.
+void run_batch(GPT2Weights weights, KVBlockPool *pool, int numRequests, int seqLength, int maxNewTokens, int sharedPrefix)
+{
+    Scheduler *scheduler = scheduler_create(weights, pool, SCHEDULER_MAX_BATCH);
+    SamplerConfig sampler = {0.0f, 0, 1.0f, 1.0f, 42};
+    BatchReport report = {0, 0, 0.0};
+    int promptLength = sharedPrefix + seqLength;
+    int *prompt = (int *)malloc(promptLength * sizeof(int));
+
+    double start = omp_get_wtime();
+    for (int r = 0; r < numRequests; r++)
+    {
+        for (int i = (r == 0) ? 0 : sharedPrefix; i < promptLength; i++)
+        {
+            prompt[i] = rand() % 10000;
+        }
+        // Uneven lengths, so sequences retire and get replaced mid-batch
+        scheduler_submit(scheduler, prompt, promptLength, maxNewTokens - r % 4, sampler, NULL, collect_stats, &report);
+    }
+    int steps = 0;
+    while (scheduler_step(scheduler) > 0)
+    {
+        steps++;
+    }
+    double elapsed = omp_get_wtime() - start;
+
+    printf("Served %d requests in %d steps: %d tokens in %.4f seconds (%.2f tokens/s), mean time to first token %.4f seconds.\n",
+           report.finished, steps + 1, report.tokens, elapsed, report.tokens / elapsed,
+           report.finished ? report.time_to_first_token / report.finished : 0.0);
+    if (pool->prefix != NULL)
+    {
+        printf("Prefix cache supplied %ld of %ld prompt tokens (%.1f%%).\n", scheduler->reusedTokens, scheduler->promptTokens,
+               scheduler->promptTokens ? 100.0 * scheduler->reusedTokens / scheduler->promptTokens : 0.0);
+    }
+    if (scheduler->preemptions > 0)
+    {
+        printf("%d preemptions freed KV blocks for older sequences; the preempted ones recomputed their history.\n", scheduler->preemptions);
+    }
+
+    free(prompt);
+    scheduler_free(scheduler);
+}
+
+// Collects the generated tokens of one request
+int record_token(int token, int index, void *userData)
+{
+    ((int *)userData)[index] = token;
+    return 0;
+}
+
+// Generate from the prompt with plain and with speculative decoding, using the first
+// DRAFT_BLOCKS blocks of the model as the draft, and compare the two
+void run_speculative(GPT2Weights weights, KVBlockPool *pool, int *prompt, int promptLength, int maxNewTokens, SamplerConfig sampler)
+{
+    GPT2Weights draft = weights;
+    draft.numBlocks = DRAFT_BLOCKS;
+    KVBlockPool *draftPool = kv_pool_create(DRAFT_BLOCKS, MAX_POSITION_EMBEDDINGS / KV_BLOCK_TOKENS, KV_BLOCK_TOKENS, weights.config.numHeads,
+                                         weights.config.headDim, KV_CACHE_TYPE);
+    int *plainTokens = (int *)malloc(maxNewTokens * sizeof(int));
+    int *speculativeTokens = (int *)malloc(maxNewTokens * sizeof(int));
+
+    KVCache *cache = kv_cache_create(pool);
+    GenerationStats plain;
+    int numPlain = generate(prompt, promptLength, maxNewTokens, sampler, weights, cache, record_token, plainTokens, &plain);
+    kv_cache_free(cache);
+
+    cache = kv_cache_create(pool);
+    KVCache *draftCache = kv_cache_create(draftPool);
+    GenerationStats stats;
+    SpeculativeStats speculative;
+    int numSpeculative = generate_speculative(prompt, promptLength, maxNewTokens, sampler, weights, cache, draft, draftCache,
+                                              SPECULATIVE_TOKENS, record_token, speculativeTokens, &stats, &speculative);
+    kv_cache_free(draftCache);
+    kv_cache_free(cache);
+
+    int same = numPlain == numSpeculative && memcmp(plainTokens, speculativeTokens, numPlain * sizeof(int)) == 0;
+    printf("Speculative decoding with a %d-block draft: %d of %d drafted tokens accepted (%.1f%%) over %d verification forwards.\n",
+           DRAFT_BLOCKS, speculative.accepted, speculative.drafted,
+           speculative.drafted ? 100.0 * speculative.accepted / speculative.drafted : 0.0, speculative.rounds);
+    printf("Effective decode rate %.2f tokens/s (plain %.2f tokens/s); output %s plain decoding.\n",
+           stats.tokens_per_second, plain.tokens_per_second, same ? "matches" : "differs from");
+
+    free(plainTokens);
+    free(speculativeTokens);
+    kv_pool_free(draftPool);
+}
+
+// Beam search from the prompt, reporting how many KV blocks the beams needed at most against
+// numBeams private caches of the full sequence
+void run_beam_search(GPT2Weights weights, KVBlockPool *pool, int *prompt, int promptLength, int maxNewTokens, int numBeams)
+{
+    int *output = (int *)malloc(maxNewTokens * sizeof(int));
+    BeamStats stats;
+    double start = omp_get_wtime();
+    int length = beam_search(prompt, promptLength, maxNewTokens, numBeams, weights, pool, output, &stats);
+    double elapsed = omp_get_wtime() - start;
+    if (length < 0)
+    {
+        fprintf(stderr, "Error: Beam search could not prefill the prompt\n");
+        free(output);
+        return;
+    }
+
+    printf("Beam search (%d beams) token IDs: ", numBeams);
+    for (int i = 0; i < length; i++)
+    {
+        printf("%d ", output[i]);
+    }
+    int blocksPerBeam = (promptLength + maxNewTokens + KV_BLOCK_TOKENS - 1) / KV_BLOCK_TOKENS;
+    printf("\nScore %.4f in %.4f seconds; at most %d KV blocks in use, against %d for unshared beams.\n",
+           stats.score, elapsed, stats.peak_blocks, numBeams * blocksPerBeam);
+    free(output);
+}
+
+// Inference server. A client connects, sends one request line and reads one line per token:
+//
+//   tokens=464,2068,7586 max_tokens=32 temperature=0.8 top_k=40 top_p=0.95 repetition_penalty=1.1 seed=7
+//
+// Only tokens is required; the defaults are 16 tokens of greedy decoding. Every generated token
+// is sent as "<token>\n" as soon as it is sampled, followed by "done <count> <time to first
+// token> <tokens/s>\n", or a single "error <reason>\n"; then the server closes the connection.
+typedef struct
+{
+    int fd;
+    int *prompt;
+    int promptLength;
+    int maxNewTokens;
+    SamplerConfig sampler;
+} ServerRequest;
+
+typedef struct
+{
+    int fd;
+    int used;
+    char line[SERVER_LINE_LENGTH];
+} PendingConnection;
+
+// State shared by the front-end thread (accept and parse) and the compute thread (schedule)
+typedef struct
+{
+    int listen_fd;
+    SpscQueue *queue;   // parsed requests, front end -> compute thread
+    int wake_fds[2];    // pipe that wakes the compute thread when it sleeps on an empty queue
+    atomic_int sleeping;
+    int vocabSize;      // prompt tokens must be below it
+} Server;
+
+static volatile sig_atomic_t server_stop = 0;
+
+void handle_stop(int signal)
+{
+    (void)signal;
+    server_stop = 1;
+}
+
+void send_line(int fd, const char *line)
+{
+    // Never block the compute thread on a slow client: a full socket buffer drops the line
+    send(fd, line, strlen(line), MSG_NOSIGNAL | MSG_DONTWAIT);
+}
+
+// Whole-string numeric fields of a request line; return 0 on success, -1 on trailing text,
+// overflow or a value outside [min, max]
+static int parse_long(const char *value, long min, long max, long *out)
+{
+    char *end;
+    errno = 0;
+    long parsed = strtol(value, &end, 10);
+    if (end == value || *end != '\0' || errno == ERANGE || parsed < min || parsed > max)
+        return -1;
+    *out = parsed;
+    return 0;
+}
+
+static int parse_float(const char *value, float *out)
+{
+    char *end;
+    float parsed = strtof(value, &end);
+    if (end == value || *end != '\0' || !isfinite(parsed))
+        return -1;
+    *out = parsed;
+    return 0;
+}
+
+// Parse a request line; returns NULL and fills error on a malformed request. Sampling settings
+// must be in range: temperature >= 0, top_k >= 0, top_p in (0, 1] and repetition_penalty >= 1
+// (the streaming top-k filter relies on the penalty only ever lowering a logit).
+ServerRequest *parse_request(char *line, int vocabSize, char *error, size_t errorSize)
+{
+    ServerRequest *request = (ServerRequest *)calloc(1, sizeof(ServerRequest));
+    SamplerConfig defaults = {0.0f, 0, 1.0f, 1.0f, 0};
+    request->sampler = defaults;
+    request->maxNewTokens = 16;
+    request->prompt = (int *)malloc(MAX_POSITION_EMBEDDINGS * sizeof(int));
+
+    int ok = 1;
+    char *saveField;
+    for (char *field = strtok_r(line, " \t\r\n", &saveField); field != NULL && ok; field = strtok_r(NULL, " \t\r\n", &saveField))
+    {
+        char *value = strchr(field, '=');
+        if (value == NULL)
+        {
+            ok = 0;
+            break;
+        }
+        *value++ = '\0';
+        if (strcmp(field, "tokens") == 0)
+        {
+            char *saveToken;
+            for (char *token = strtok_r(value, ",", &saveToken); token != NULL; token = strtok_r(NULL, ",", &saveToken))
+            {
+                long id;
+                if (request->promptLength == MAX_POSITION_EMBEDDINGS - 1 || parse_long(token, 0, vocabSize - 1, &id) != 0)
+                {
+                    ok = 0;
+                    break;
+                }
+                request->prompt[request->promptLength++] = (int)id;
+            }
+        }
+        else if (strcmp(field, "max_tokens") == 0)
+        {
+            long maxNewTokens;
+            ok = parse_long(value, 1, INT_MAX, &maxNewTokens) == 0;
+            if (ok)
+                request->maxNewTokens = (int)maxNewTokens;
+        }
+        else if (strcmp(field, "temperature") == 0)
+            ok = parse_float(value, &request->sampler.temperature) == 0 && request->sampler.temperature >= 0.0f;
+        else if (strcmp(field, "top_k") == 0)
+        {
+            long topK;
+            ok = parse_long(value, 0, INT_MAX, &topK) == 0;
+            if (ok)
+                request->sampler.top_k = (int)topK;
+        }
+        else if (strcmp(field, "top_p") == 0)
+            ok = parse_float(value, &request->sampler.top_p) == 0 && request->sampler.top_p > 0.0f && request->sampler.top_p <= 1.0f;
+        else if (strcmp(field, "repetition_penalty") == 0)
+            ok = parse_float(value, &request->sampler.repetition_penalty) == 0 && request->sampler.repetition_penalty >= 1.0f;
+        else if (strcmp(field, "seed") == 0)
+        {
+            char *end;
+            errno = 0;
+            request->sampler.seed = strtoull(value, &end, 10);
+            ok = value[0] >= '0' && value[0] <= '9' && *end == '\0' && errno != ERANGE;
+        }
+        else
+            ok = 0;
+    }
+
+    if (!ok || request->promptLength == 0)
+    {
+        snprintf(error, errorSize, "error expected tokens=<id>,... with ids below %d and optional max_tokens > 0, "
+                                   "temperature >= 0, top_k >= 0, top_p in (0, 1], repetition_penalty >= 1, seed\n", vocabSize);
+        free(request->prompt);
+        free(request);
+        return NULL;
+    }
+    return request;
+}
+
+// Hand a parsed request to the compute thread, waking it if it sleeps on an empty queue
+void enqueue_request(Server *server, PendingConnection *connection)
+{
+    char error[256];
+    ServerRequest *request = parse_request(connection->line, server->vocabSize, error, sizeof(error));
+    if (request != NULL)
+    {
+        request->fd = connection->fd;
+        if (spsc_queue_push(server->queue, request) == 0)
+        {
+            if (atomic_load(&server->sleeping))
+            {
+                char byte = 1;
+                ssize_t written = write(server->wake_fds[1], &byte, 1);
+                (void)written; // a full pipe already holds a wake-up
+            }
+            return;
+        }
+        snprintf(error, sizeof(error), "error server busy\n");
+        free(request->prompt);
+        free(request);
+    }
+    send_line(connection->fd, error);
+    close(connection->fd);
+}
+
+// Front-end thread: accept connections and read their request lines without ever touching
+// the model, so slow or idle clients cannot stall a decode step
+void *server_front_end(void *arg)
+{
+    Server *server = (Server *)arg;
+    PendingConnection *pending = (PendingConnection *)malloc(SERVER_MAX_PENDING * sizeof(PendingConnection));
+    struct pollfd fds[SERVER_MAX_PENDING + 1];
+    int numPending = 0;
+
+    while (!server_stop)
+    {
+        fds[0].fd = server->listen_fd;
+        fds[0].events = (numPending < SERVER_MAX_PENDING) ? POLLIN : 0;
+        for (int c = 0; c < numPending; c++)
+        {
+            fds[c + 1].fd = pending[c].fd;
+            fds[c + 1].events = POLLIN;
+        }
+        if (poll(fds, numPending + 1, 100) <= 0)
+        {
+            continue;
+        }
+
+        // Read whatever arrived; a connection leaves the pending set once its line is complete
+        int kept = 0;
+        for (int c = 0; c < numPending; c++)
+        {
+            PendingConnection *connection = &pending[c];
+            int done = 0;
+            if (fds[c + 1].revents & (POLLIN | POLLHUP | POLLERR))
+            {
+                ssize_t n = read(connection->fd, connection->line + connection->used, SERVER_LINE_LENGTH - 1 - connection->used);
+                if (n <= 0)
+                {
+                    close(connection->fd);
+                    done = 1;
+                }
+                else
+                {
+                    connection->used += n;
+                    connection->line[connection->used] = '\0';
+                    if (strchr(connection->line, '\n') != NULL || connection->used == SERVER_LINE_LENGTH - 1)
+                    {
+                        enqueue_request(server, connection);
+                        done = 1;
+                    }
+                }
+            }
+            if (!done)
+            {
+                pending[kept++] = *connection;
+            }
+        }
+        numPending = kept;
+
+        if (fds[0].revents & POLLIN)
+        {
+            int fd = accept(server->listen_fd, NULL, NULL);
+            if (fd >= 0)
+            {
+                pending[numPending].fd = fd;
+                pending[numPending].used = 0;
+                numPending++;
+            }
+        }
+    }
+
+    for (int c = 0; c < numPending; c++)
+    {
+        close(pending[c].fd);
+    }
+    free(pending);
+    return NULL;
+}
+
+// Stream each token to the client; a send failure (client gone) stops the request
+int stream_token(int token, int index, void *userData)
+{
+    (void)index;
+    ServerRequest *request = (ServerRequest *)userData;
+    char line[32];
+    int length = snprintf(line, sizeof(line), "%d\n", token);
+    return send(request->fd, line, length, MSG_NOSIGNAL | MSG_DONTWAIT) == length ? 0 : 1;
+}
+
+void finish_request(int id, const GenerationStats *stats, void *userData)
+{
+    (void)id;
+    ServerRequest *request = (ServerRequest *)userData;
+    char line[128];
+    snprintf(line, sizeof(line), "done %d %.4f %.2f\n", stats->num_generated, stats->time_to_first_token, stats->tokens_per_second);
+    send_line(request->fd, line);
+    close(request->fd);
+    free(request);
+}
+
+// Listen on a Unix socket path, or on 127.0.0.1 when address is a port number
+int open_listener(const char *address)
+{
+    int fd;
+    if (strspn(address, "0123456789") == strlen(address))
+    {
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons((uint16_t)atoi(address));
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        int one = 1;
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0 || setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) != 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, SOMAXCONN) != 0)
+        {
+            fprintf(stderr, "Error: Unable to listen on 127.0.0.1:%s (%s)\n", address, strerror(errno));
+            return -1;
+        }
+        return fd;
+    }
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(address) >= sizeof(addr.sun_path))
+    {
+        fprintf(stderr, "Error: Socket path %s is too long\n", address);
+        return -1;
+    }
+    strcpy(addr.sun_path, address);
+    unlink(address);
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, SOMAXCONN) != 0)
+    {
+        fprintf(stderr, "Error: Unable to listen on %s (%s)\n", address, strerror(errno));
+        return -1;
+    }
+    return fd;
+}
+
+// Serve requests until SIGINT or SIGTERM. The weights are loaded and packed once by the caller;
+// this thread only drains the request queue into the scheduler and runs decode steps.
+int serve(GPT2Weights weights, KVBlockPool *pool, const char *address)
+{
+    Server server;
+    server.vocabSize = weights.config.vocabSize;
+    server.listen_fd = open_listener(address);
+    if (server.listen_fd < 0 || pipe(server.wake_fds) != 0)
+    {
+        return -1;
+    }
+    fcntl(server.wake_fds[0], F_SETFL, O_NONBLOCK);
+    fcntl(server.wake_fds[1], F_SETFL, O_NONBLOCK);
+    server.queue = spsc_queue_create(SERVER_QUEUE_SIZE);
+    atomic_init(&server.sleeping, 0);
+
+    signal(SIGINT, handle_stop);
+    signal(SIGTERM, handle_stop);
+    signal(SIGPIPE, SIG_IGN);
+    pthread_t front_end;
+    pthread_create(&front_end, NULL, server_front_end, &server);
+    printf("Serving on %s.\n", address);
+    fflush(stdout);
+
+    Scheduler *scheduler = scheduler_create(weights, pool, SCHEDULER_MAX_BATCH);
+    int active = 0;
+    while (!server_stop)
+    {
+        ServerRequest *request;
+        while ((request = (ServerRequest *)spsc_queue_pop(server.queue)) != NULL)
+        {
+            int id = scheduler_submit(scheduler, request->prompt, request->promptLength, request->maxNewTokens,
+                                      request->sampler, stream_token, finish_request, request);
+            free(request->prompt);
+            request->prompt = NULL;
+            if (id < 0)
+            {
+                send_line(request->fd, "error prompt too long\n");
+                close(request->fd);
+                free(request);
+            }
+            else
+            {
+                active++;
+            }
+        }
+
+        if (active > 0)
+        {
+            active = scheduler_step(scheduler);
+            continue;
+        }
+
+        // Idle: announce the sleep, then re-check the queue so a request pushed in between is not missed
+        atomic_store(&server.sleeping, 1);
+        if (spsc_queue_empty(server.queue))
+        {
+            struct pollfd wake = {server.wake_fds[0], POLLIN, 0};
+            poll(&wake, 1, 100);
+        }
+        atomic_store(&server.sleeping, 0);
+        char drain[64];
+        while (read(server.wake_fds[0], drain, sizeof(drain)) > 0)
+        {
+        }
+    }
+
+    pthread_join(front_end, NULL);
+    scheduler_free(scheduler);
+    ServerRequest *request;
+    while ((request = (ServerRequest *)spsc_queue_pop(server.queue)) != NULL)
+    {
+        close(request->fd);
+        free(request->prompt);
+        free(request);
+    }
+    spsc_queue_free(server.queue);
+    close(server.wake_fds[0]);
+    close(server.wake_fds[1]);
+    close(server.listen_fd);
+    if (strspn(address, "0123456789") != strlen(address))
+    {
+        unlink(address);
+    }
+    printf("Server stopped.\n");
+    return 0;
+}
+
+// Test case. Usage: gptop [--speculative] [--beams B] [--batch N [--shared-prefix L]] [model.bin]
+// loads a mapped checkpoint instead of random weights, with --speculative also compares
+// speculative with plain decoding, with --beams also runs a B-beam search, and with --batch
+// also serves N concurrent requests through the scheduler, their prompts starting with the
+// same L tokens;
+// gptop --serve <socket path | port> [model.bin] runs the inference server instead of the demo;
+// gptop --save model.bin writes the random weights as a checkpoint and exits. --model small|medium|large|xl
+// sets the size of random weights; a checkpoint carries its own. The unit tests include this
+// file with GPT2_NO_MAIN defined.
+#ifndef GPT2_NO_MAIN
+int main(int argc, char **argv)
+{
+    // Seed the random number generator
+    srand(42);
+
+    // Define sequence length and tokens
+    // int seqLength = 5;
+    // int tokens[] = {10, 20, 30, 40, 50}; // Example token IDs
+
+    int seqLength = 16;
+    int tokens[16];
+    for (int i = 0; i < 16; i++)
+    {
+        tokens[i] = rand() % 10000;
+    }
+    int maxNewTokens = 16;
+
+    const char *checkpointPath = NULL;
+    const char *serveAddress = NULL;
+    int batchRequests = 0;
+    int sharedPrefix = 0;
+    int speculative = 0;
+    int numBeams = 0;
+    const char *modelName = MODEL_CONFIG;
+    const char *savePath = NULL;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--model") == 0 && i + 1 < argc)
+        {
+            modelName = argv[++i];
+        }
+        else if (strcmp(argv[i], "--save") == 0 && i + 1 < argc)
+        {
+            savePath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc)
+        {
+            batchRequests = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--shared-prefix") == 0 && i + 1 < argc)
+        {
+            sharedPrefix = atoi(argv[++i]);
+            if (sharedPrefix < 0 || sharedPrefix + seqLength + maxNewTokens > MAX_POSITION_EMBEDDINGS)
+            {
+                fprintf(stderr, "Error: --shared-prefix must be between 0 and %d\n", MAX_POSITION_EMBEDDINGS - seqLength - maxNewTokens);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--beams") == 0 && i + 1 < argc)
+        {
+            numBeams = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--speculative") == 0)
+        {
+            speculative = 1;
+        }
+        else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc)
+        {
+            serveAddress = argv[++i];
+        }
+        else
+        {
+            checkpointPath = argv[i];
+        }
+    }
+
+    const GPT2Config *config = NULL;
+    for (int c = 0; c < NUM_GPT2_CONFIGS; c++)
+    {
+        if (strcmp(modelName, GPT2_CONFIGS[c].name) == 0)
+            config = &GPT2_CONFIGS[c];
+    }
+    if (config == NULL)
+    {
+        fprintf(stderr, "Error: --model must be small, medium, large or xl\n");
+        return 1;
+    }
+
+    GPT2Weights weights;
+    double load_start = omp_get_wtime();
+    if (savePath != NULL)
+    {
+        weights = initialize_weights(config);
+        int status = save_weights(&weights, savePath);
+        free_weights(&weights);
+        if (status != 0)
+        {
+            fprintf(stderr, "Error: Unable to write checkpoint %s\n", savePath);
+            return 1;
+        }
+        printf("Saved checkpoint to %s.\n", savePath);
+        return 0;
+    }
+    else if (checkpointPath != NULL)
+    {
+        if (load_weights(checkpointPath, &weights) != 0)
+        {
+            return 1;
+        }
+    }
+    else
+    {
+        weights = initialize_weights(config);
+    }
+    printf("Model: %d blocks, %d heads of %d, embedding size %d, vocabulary %d.\n", weights.config.numBlocks,
+           weights.config.numHeads, weights.config.headDim, weights.config.embeddingSize, weights.config.vocabSize);
+    quantize_weights(&weights, WEIGHT_QUANT, LOGITS_QUANT, WEIGHT_QUANT_GROUP);
+    halve_weights(&weights, WEIGHT_HALF);
+    printf("Weights ready in %.4f seconds.\n", omp_get_wtime() - load_start);
+    KVBlockPool *kv_pool = kv_pool_create(weights.config.numBlocks, KV_POOL_SEQUENCES * MAX_POSITION_EMBEDDINGS / KV_BLOCK_TOKENS, KV_BLOCK_TOKENS,
+                                          weights.config.numHeads, weights.config.headDim, KV_CACHE_TYPE);
+    KVPrefixCache *prefix_cache = PREFIX_CACHE ? kv_prefix_cache_create(kv_pool) : NULL;
+    if (serveAddress != NULL)
+    {
+        int status = serve(weights, kv_pool, serveAddress);
+        if (prefix_cache != NULL)
+            kv_prefix_cache_free(prefix_cache);
+        kv_pool_free(kv_pool);
+        free_weights(&weights);
+        return status == 0 ? 0 : 1;
+    }
+    KVCache *cache = kv_cache_create(kv_pool);
+
+    // Greedy decoding of the prompt continuation
+    SamplerConfig sampler = {0.0f, 0, 1.0f, 1.0f, 42};
+    GenerationStats stats;
+    printf("Generated token IDs: ");
+    generate(tokens, seqLength, maxNewTokens, sampler, weights, cache, print_token, NULL, &stats);
+    printf("\n");
+
+    printf("Time to first token: %.4f seconds.\n", stats.time_to_first_token);
+    printf("Per-token latency: %.4f seconds (%.2f tokens/s over %d tokens).\n",
+           stats.mean_token_latency, stats.tokens_per_second, stats.num_generated);
+
+    kv_cache_free(cache);
+    if (speculative)
+    {
+        run_speculative(weights, kv_pool, tokens, seqLength, maxNewTokens, sampler);
+    }
+    if (numBeams > 0)
+    {
+        run_beam_search(weights, kv_pool, tokens, seqLength, maxNewTokens, numBeams);
+    }
+    if (batchRequests > 0)
+    {
+        run_batch(weights, kv_pool, batchRequests, seqLength, maxNewTokens, sharedPrefix);
+    }
+    if (prefix_cache != NULL)
+        kv_prefix_cache_free(prefix_cache);
+    kv_pool_free(kv_pool);
     free_weights(&weights);
     return 0;
 }
+#endif // GPT2_NO_MAIN
@@ -1,6 +1,9 @@
 #include "attention.h"
 #include <stdio.h>
 #include <math.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 // Helper function to allocate a matrix of size rows x cols
 float **allocate_matrix_1(int rows, int cols)
@@ -81,3 +84,319 @@ float **scaled_dot_product_attention(float **Q, float **K, float **V, int seqLen
 
     return output;
 }
+
+// Where the fused kernel reads K/V from: dense row arrays, or a paged cache's block table
+typedef struct
+{
+    float **K;      // K[kvLength][...], used when cache is NULL
+    float **V;      // V[kvLength][...], used when cache is NULL
+    KVCache *cache; // paged K/V of one layer, read through the block table
+    int layer;
+} KVSource;
+
+// Per-thread working set of the fused attention kernel: O(ATTENTION_BLOCK_Q * depth) floats
+typedef struct
+{
+    float *acc;    // acc[ATTENTION_BLOCK_Q][depth], unnormalised output rows
+    float *scores; // scores[ATTENTION_BLOCK_Q][ATTENTION_BLOCK_KV]
+    float row_max[ATTENTION_BLOCK_Q];
+    float row_sum[ATTENTION_BLOCK_Q];
+    float *k_rows[ATTENTION_BLOCK_KV]; // head slices of the rows of the current K/V tile
+    float *v_rows[ATTENTION_BLOCK_KV];
+    float *k_tile; // k_tile[ATTENTION_BLOCK_KV][depth], fp32 tile of an int8 or 16-bit cache
+    float *v_tile;
+} AttentionScratch;
+
+static void init_scratch(AttentionScratch *scratch, int depth)
+{
+    scratch->acc = (float *)malloc(ATTENTION_BLOCK_Q * depth * sizeof(float));
+    scratch->scores = (float *)malloc(ATTENTION_BLOCK_Q * ATTENTION_BLOCK_KV * sizeof(float));
+    scratch->k_tile = (float *)malloc(ATTENTION_BLOCK_KV * depth * sizeof(float));
+    scratch->v_tile = (float *)malloc(ATTENTION_BLOCK_KV * depth * sizeof(float));
+}
+
+static void free_scratch(AttentionScratch *scratch)
+{
+    free(scratch->acc);
+    free(scratch->scores);
+    free(scratch->k_tile);
+    free(scratch->v_tile);
+}
+
+// Resolve the head slice [offset, offset + depth) of the K/V tile rows [bk, bk + kv_rows).
+// fp32 rows are used in place; int8 and 16-bit cache rows are widened into the scratch tile,
+// which stays in L1 while every query row of the block is scored against it.
+static inline void load_kv_tile(const KVSource *src, int bk, int kv_rows, int offset, int depth, AttentionScratch *scratch)
+{
+    if (src->cache == NULL)
+    {
+        for (int j = 0; j < kv_rows; j++)
+        {
+            scratch->k_rows[j] = &src->K[bk + j][offset];
+            scratch->v_rows[j] = &src->V[bk + j][offset];
+        }
+        return;
+    }
+
+    const KVBlockPool *pool = src->cache->pool;
+    if (pool->type == KV_FLOAT32)
+    {
+        for (int j = 0; j < kv_rows; j++)
+        {
+            scratch->k_rows[j] = &kv_cache_key(src->cache, src->layer, bk + j)[offset];
+            scratch->v_rows[j] = &kv_cache_value(src->cache, src->layer, bk + j)[offset];
+        }
+        return;
+    }
+
+    HalfType half = kv_half_type(pool);
+    if (half != HALF_NONE)
+    {
+        for (int j = 0; j < kv_rows; j++)
+        {
+            size_t row = kv_cache_slot(src->cache, bk + j) * pool->width + offset;
+            float *k = &scratch->k_tile[j * depth];
+            float *v = &scratch->v_tile[j * depth];
+            convert_from_half(&pool->keys_h[src->layer][row], k, depth, half);
+            convert_from_half(&pool->values_h[src->layer][row], v, depth, half);
+            scratch->k_rows[j] = k;
+            scratch->v_rows[j] = v;
+        }
+        return;
+    }
+
+    int h = offset / pool->headDim;
+    for (int j = 0; j < kv_rows; j++)
+    {
+        size_t slot = kv_cache_slot(src->cache, bk + j);
+        const int8_t *kq = &pool->keys_q[src->layer][slot * pool->width + offset];
+        const int8_t *vq = &pool->values_q[src->layer][slot * pool->width + offset];
+        float k_scale = pool->key_scales[src->layer][slot * pool->numHeads + h];
+        float v_scale = pool->value_scales[src->layer][slot * pool->numHeads + h];
+
+        float *k = &scratch->k_tile[j * depth];
+        float *v = &scratch->v_tile[j * depth];
+        for (int d = 0; d < depth; d++)
+        {
+            k[d] = kq[d] * k_scale;
+            v[d] = vq[d] * v_scale;
+        }
+        scratch->k_rows[j] = k;
+        scratch->v_rows[j] = v;
+    }
+}
+
+// Fused attention of query rows [bq, bq + q_rows) for the head whose columns start at `offset`.
+// K/V are streamed in tiles of ATTENTION_BLOCK_KV rows, and each query row keeps a running
+// max and softmax denominator so the score matrix is never stored.
+//
+// The qLength queries are the last positions of the kvLength keys, so query i sits at
+// position kvLength - qLength + i. With causal set, it only attends to keys up to that
+// position: K/V tiles entirely above the diagonal are never loaded, and only the tile
+// straddling the diagonal is masked per row.
+static inline void flash_attention_block(float **Q, const KVSource *src, float **output, int offset, int bq, int q_rows,
+                                         int qLength, int kvLength, int depth, int causal, AttentionScratch *scratch)
+{
+    float scale_factor = 1.0f / sqrtf((float)depth);
+    float *acc = scratch->acc;
+    float *scores = scratch->scores;
+    float *row_max = scratch->row_max;
+    float *row_sum = scratch->row_sum;
+
+    // Keys past the last query of this block are masked for every row
+    int past_length = kvLength - qLength;
+    int kv_length = causal ? past_length + bq + q_rows : kvLength;
+
+    for (int i = 0; i < q_rows; i++)
+    {
+        row_max[i] = -INFINITY;
+        row_sum[i] = 0.0f;
+        for (int d = 0; d < depth; d++)
+        {
+            acc[i * depth + d] = 0.0f;
+        }
+    }
+
+    for (int bk = 0; bk < kv_length; bk += ATTENTION_BLOCK_KV)
+    {
+        int kv_rows = (kv_length - bk < ATTENTION_BLOCK_KV) ? kv_length - bk : ATTENTION_BLOCK_KV;
+        load_kv_tile(src, bk, kv_rows, offset, depth, scratch);
+
+        // Only the tile that crosses the diagonal needs a per-row mask
+        int diagonal = causal && bk + kv_rows - 1 > past_length + bq;
+
+        for (int i = 0; i < q_rows; i++)
+        {
+            float *q = &Q[bq + i][offset];
+            float *s = &scores[i * ATTENTION_BLOCK_KV];
+            int row_kv = kv_rows;
+            if (diagonal)
+            {
+                row_kv = past_length + bq + i - bk + 1;
+                if (row_kv > kv_rows)
+                {
+                    row_kv = kv_rows;
+                }
+                if (row_kv <= 0)
+                {
+                    continue;
+                }
+            }
+
+            // Scores of this query row against the K tile
+            float tile_max = -INFINITY;
+            for (int j = 0; j < row_kv; j++)
+            {
+                float *k = scratch->k_rows[j];
+                float dot = 0.0f;
+                for (int d = 0; d < depth; d++)
+                {
+                    dot += q[d] * k[d];
+                }
+                s[j] = dot * scale_factor;
+                if (s[j] > tile_max)
+                {
+                    tile_max = s[j];
+                }
+            }
+
+            // Online softmax: rescale the running state if the max grew
+            float new_max = (tile_max > row_max[i]) ? tile_max : row_max[i];
+            float correction = expf(row_max[i] - new_max);
+            row_max[i] = new_max;
+            row_sum[i] *= correction;
+
+            float *a = &acc[i * depth];
+            for (int d = 0; d < depth; d++)
+            {
+                a[d] *= correction;
+            }
+
+            // Accumulate the V tile weighted by the unnormalised probabilities
+            for (int j = 0; j < row_kv; j++)
+            {
+                float p = expf(s[j] - new_max);
+                row_sum[i] += p;
+                float *v = scratch->v_rows[j];
+                for (int d = 0; d < depth; d++)
+                {
+                    a[d] += p * v[d];
+                }
+            }
+        }
+    }
+
+    // Normalise and write out
+    for (int i = 0; i < q_rows; i++)
+    {
+        float inv_sum = 1.0f / row_sum[i];
+        float *out = &output[bq + i][offset];
+        for (int d = 0; d < depth; d++)
+        {
+            out[d] = acc[i * depth + d] * inv_sum;
+        }
+    }
+}
+
+// flash_attention_block with depth as a literal for ATTENTION_HEAD_DIM-wide heads, so that copy
+// has its per-element loops fully unrolled and vectorised; other depths run the generic copy
+static void attention_block(float **Q, const KVSource *src, float **output, int offset, int bq, int q_rows,
+                            int qLength, int kvLength, int depth, int causal, AttentionScratch *scratch)
+{
+    if (depth == ATTENTION_HEAD_DIM)
+        flash_attention_block(Q, src, output, offset, bq, q_rows, qLength, kvLength, ATTENTION_HEAD_DIM, causal, scratch);
+    else
+        flash_attention_block(Q, src, output, offset, bq, q_rows, qLength, kvLength, depth, causal, scratch);
+}
+
+// Fused (flash) attention for one head whose columns start at `offset` in every row of Q, K, V.
+// Q has qLength rows and K/V have kvLength rows; for self-attention both are the sequence length.
+// The result for query row i is written to output[i][offset .. offset + depth).
+void flash_attention_head(float **Q, float **K, float **V, float **output, int offset, int qLength, int kvLength, int depth, int causal)
+{
+    KVSource src = {K, V, NULL, 0};
+    int num_q_blocks = (qLength + ATTENTION_BLOCK_Q - 1) / ATTENTION_BLOCK_Q;
+
+    // Query blocks are independent, so they are processed in parallel. Under a causal mask the
+    // work of a block grows with its index, so blocks are handed out last-first to keep the
+    // threads balanced at the end of the triangle.
+#pragma omp parallel
+    {
+        AttentionScratch scratch;
+        init_scratch(&scratch, depth);
+
+#pragma omp for schedule(dynamic, 1)
+        for (int block = num_q_blocks - 1; block >= 0; block--)
+        {
+            int bq = block * ATTENTION_BLOCK_Q;
+            int q_rows = (qLength - bq < ATTENTION_BLOCK_Q) ? qLength - bq : ATTENTION_BLOCK_Q;
+            attention_block(Q, &src, output, offset, bq, q_rows, qLength, kvLength, depth, causal, &scratch);
+        }
+
+        free_scratch(&scratch);
+    }
+}
+
+// Runs every (head, query-block) task of a multi-head attention over one K/V source
+static void multi_head_tasks(float **Q, const KVSource *src, float **output, int qLength, int kvLength, int numHeads, int headDim, int causal)
+{
+    int num_threads = 1;
+#ifdef _OPENMP
+    num_threads = omp_get_max_threads();
+#endif
+
+    int block_q = ATTENTION_BLOCK_Q;
+    while (block_q > 1 && numHeads * ((qLength + block_q - 1) / block_q) < num_threads)
+    {
+        block_q /= 2;
+    }
+    int num_q_blocks = (qLength + block_q - 1) / block_q;
+    int num_tasks = numHeads * num_q_blocks;
+
+#pragma omp parallel
+    {
+        AttentionScratch scratch;
+        init_scratch(&scratch, headDim);
+
+        // Tasks are ordered by query block, last block first, so the heaviest causal rows of
+        // every head are started before the light ones
+#pragma omp for schedule(dynamic, 1)
+        for (int task = 0; task < num_tasks; task++)
+        {
+            int block = num_q_blocks - 1 - task / numHeads;
+            int h = task % numHeads;
+            int bq = block * block_q;
+            int q_rows = (qLength - bq < block_q) ? qLength - bq : block_q;
+            attention_block(Q, src, output, h * headDim, bq, q_rows, qLength, kvLength, headDim, causal, &scratch);
+        }
+
+        free_scratch(&scratch);
+    }
+}
+
+// Fused attention over all heads at once. Q, K, V and output rows are numHeads * headDim wide,
+// with head h in columns [h * headDim, (h + 1) * headDim). Work is split into (head, query-block)
+// tasks scheduled over a single parallel region; for short sequences the query blocks shrink
+// so that there are at least as many tasks as threads.
+void multi_head_attention(float **Q, float **K, float **V, float **output, int qLength, int kvLength, int numHeads, int headDim, int causal)
+{
+    KVSource src = {K, V, NULL, 0};
+    multi_head_tasks(Q, &src, output, qLength, kvLength, numHeads, headDim, causal);
+}
+
+// Multi-head attention of qLength new queries over the first kvLength positions of one layer
+// of a paged KV cache. K/V rows are located through the sequence's block table, so the cache
+// never has to be contiguous. int8 caches are dequantized tile by tile inside the kernel.
+void paged_attention(float **Q, KVCache *cache, int layer, float **output, int qLength, int kvLength, int numHeads, int headDim, int causal)
+{
+    KVSource src = {NULL, NULL, cache, layer};
+    multi_head_tasks(Q, &src, output, qLength, kvLength, numHeads, headDim, causal);
+}
+
+// Fused attention returning a newly allocated seqLength x depth output, optionally causal
+float **flash_attention(float **Q, float **K, float **V, int seqLength, int depth, int causal)
+{
+    float **output = allocate_matrix_1(seqLength, depth);
+    flash_attention_head(Q, K, V, output, 0, seqLength, seqLength, depth, causal);
+    return output;
+}
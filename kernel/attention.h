@@ -6,8 +6,18 @@
 #include <stdio.h>
 #include "functional.h"
 #include "matrix_ops.h"
+#include "kv_cache.h"
+
+// Tile sizes of the fused attention kernel
+#define ATTENTION_BLOCK_Q 32
+#define ATTENTION_BLOCK_KV 64
+#define ATTENTION_HEAD_DIM 64 // head width with a specialised kernel copy (every GPT-2 size)
 
 // Function declarations
 float **scaled_dot_product_attention(float **Q, float **K, float **V, int seqLength, int depth);
+float **flash_attention(float **Q, float **K, float **V, int seqLength, int depth, int causal);
+void flash_attention_head(float **Q, float **K, float **V, float **output, int offset, int qLength, int kvLength, int depth, int causal);
+void multi_head_attention(float **Q, float **K, float **V, float **output, int qLength, int kvLength, int numHeads, int headDim, int causal);
+void paged_attention(float **Q, KVCache *cache, int layer, float **output, int qLength, int kvLength, int numHeads, int headDim, int causal);
 
 #endif
\ No newline at end of file
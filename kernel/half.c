@@ -0,0 +1,308 @@
+#include "half.h"
+#ifdef __SSE__
+#include <immintrin.h>
+#endif
+
+#if defined(__AVX2__) && defined(__FMA__) && defined(__F16C__)
+#define HALF_SIMD 1
+
+static inline float horizontal_sum(__m256 v)
+{
+    __m128 lanes = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    lanes = _mm_hadd_ps(lanes, lanes);
+    lanes = _mm_hadd_ps(lanes, lanes);
+    return _mm_cvtss_f32(lanes);
+}
+
+// Widen 8 16-bit values to fp32: F16C for fp16, a zero-extend and shift for bf16
+static inline __m256 load_half8(const uint16_t *p, HalfType type)
+{
+    __m128i bits = _mm_loadu_si128((const __m128i *)p);
+    if (type == HALF_BF16)
+    {
+        return _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_cvtepu16_epi32(bits), 16));
+    }
+    return _mm256_cvtph_ps(bits);
+}
+
+// Narrow 8 fp32 values with round-to-nearest-even. bf16 uses the AVX512-BF16 instruction when
+// available and otherwise adds the rounding bias before dropping the low 16 bits.
+static inline void store_half8(uint16_t *p, __m256 v, HalfType type)
+{
+    if (type == HALF_FP16)
+    {
+        _mm_storeu_si128((__m128i *)p, _mm256_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT));
+        return;
+    }
+#if defined(__AVX512BF16__) && defined(__AVX512VL__)
+    __m128bh narrowed = _mm256_cvtneps_pbh(v);
+    memcpy(p, &narrowed, sizeof(narrowed));
+#else
+    __m256i bits = _mm256_castps_si256(v);
+    __m256i high = _mm256_srli_epi32(bits, 16);
+    __m256i bias = _mm256_add_epi32(_mm256_and_si256(high, _mm256_set1_epi32(1)), _mm256_set1_epi32(0x7FFF));
+    __m256i rounded = _mm256_srli_epi32(_mm256_add_epi32(bits, bias), 16);
+    __m256i nan = _mm256_castps_si256(_mm256_cmp_ps(v, v, _CMP_UNORD_Q));
+    rounded = _mm256_blendv_epi8(rounded, _mm256_or_si256(high, _mm256_set1_epi32(0x40)), nan);
+    __m128i packed = _mm_packus_epi32(_mm256_castsi256_si128(rounded), _mm256_extracti128_si256(rounded, 1));
+    _mm_storeu_si128((__m128i *)p, packed);
+#endif
+}
+#endif
+
+void convert_to_half(const float *input, uint16_t *output, size_t count, HalfType type)
+{
+    size_t i = 0;
+#ifdef HALF_SIMD
+    for (; i + 8 <= count; i += 8)
+    {
+        store_half8(output + i, _mm256_loadu_ps(input + i), type);
+    }
+#endif
+    for (; i < count; i++)
+    {
+        output[i] = (type == HALF_BF16) ? float_to_bf16(input[i]) : float_to_fp16(input[i]);
+    }
+}
+
+void convert_from_half(const uint16_t *input, float *output, size_t count, HalfType type)
+{
+    size_t i = 0;
+#ifdef HALF_SIMD
+    for (; i + 8 <= count; i += 8)
+    {
+        _mm256_storeu_ps(output + i, load_half8(input + i, type));
+    }
+#endif
+    for (; i < count; i++)
+    {
+        output[i] = half_value(input[i], type);
+    }
+}
+
+HalfMatrix *half_matrix_from_rows(float **matrix, int rows, int cols, HalfType type)
+{
+    if (type != HALF_FP16 && type != HALF_BF16)
+    {
+        return NULL;
+    }
+    HalfMatrix *half = (HalfMatrix *)malloc(sizeof(HalfMatrix));
+    half->type = type;
+    half->rows = rows;
+    half->cols = cols;
+    half->data = (uint16_t *)malloc((size_t)rows * cols * sizeof(uint16_t));
+
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < rows; i++)
+    {
+        convert_to_half(matrix[i], half->data + (size_t)i * cols, cols, type);
+    }
+    return half;
+}
+
+void half_matrix_free(HalfMatrix *matrix)
+{
+    if (matrix == NULL)
+        return;
+    free(matrix->data);
+    free(matrix);
+}
+
+// Dot product of x with one 16-bit row. Callers pass the type as a constant so the format
+// branch in load_half8 folds away inside the loop.
+static inline float dot_half(const float *x, const uint16_t *w, int cols, HalfType type)
+{
+    int k = 0;
+    float sum = 0.0f;
+#ifdef HALF_SIMD
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    for (; k + 16 <= cols; k += 16)
+    {
+        acc0 = _mm256_fmadd_ps(load_half8(w + k, type), _mm256_loadu_ps(x + k), acc0);
+        acc1 = _mm256_fmadd_ps(load_half8(w + k + 8, type), _mm256_loadu_ps(x + k + 8), acc1);
+    }
+    for (; k + 8 <= cols; k += 8)
+    {
+        acc0 = _mm256_fmadd_ps(load_half8(w + k, type), _mm256_loadu_ps(x + k), acc0);
+    }
+    sum = horizontal_sum(_mm256_add_ps(acc0, acc1));
+#endif
+    for (; k < cols; k++)
+    {
+        sum += half_value(w[k], type) * x[k];
+    }
+    return sum;
+}
+
+// Dot products of HALF_TILE_ROWS inputs with one 16-bit row; each weight vector is widened
+// once and reused for all of them
+static inline void dot_half_tile(const float **x, const uint16_t *w, int cols, HalfType type, float *out)
+{
+    int k = 0;
+#ifdef HALF_SIMD
+    __m256 acc[HALF_TILE_ROWS];
+    for (int t = 0; t < HALF_TILE_ROWS; t++)
+    {
+        acc[t] = _mm256_setzero_ps();
+    }
+    for (; k + 8 <= cols; k += 8)
+    {
+        __m256 wv = load_half8(w + k, type);
+        for (int t = 0; t < HALF_TILE_ROWS; t++)
+        {
+            acc[t] = _mm256_fmadd_ps(wv, _mm256_loadu_ps(x[t] + k), acc[t]);
+        }
+    }
+    for (int t = 0; t < HALF_TILE_ROWS; t++)
+    {
+        out[t] = horizontal_sum(acc[t]);
+    }
+#else
+    for (int t = 0; t < HALF_TILE_ROWS; t++)
+    {
+        out[t] = 0.0f;
+    }
+#endif
+    for (; k < cols; k++)
+    {
+        float wk = half_value(w[k], type);
+        for (int t = 0; t < HALF_TILE_ROWS; t++)
+        {
+            out[t] += wk * x[t][k];
+        }
+    }
+}
+
+static float dot_row(const HalfMatrix *weights, int i, const float *x)
+{
+    const uint16_t *w = weights->data + (size_t)i * weights->cols;
+    if (weights->type == HALF_BF16)
+        return dot_half(x, w, weights->cols, HALF_BF16);
+    return dot_half(x, w, weights->cols, HALF_FP16);
+}
+
+static void dot_row_tile(const HalfMatrix *weights, int i, const float **x, float *out)
+{
+    const uint16_t *w = weights->data + (size_t)i * weights->cols;
+    if (weights->type == HALF_BF16)
+        dot_half_tile(x, w, weights->cols, HALF_BF16, out);
+    else
+        dot_half_tile(x, w, weights->cols, HALF_FP16, out);
+}
+
+// GEMV over 16-bit weights: half the weight traffic of fp32 with the same fp32 accumulation,
+// and no per-layer scale tuning as with integer quantization.
+float *linear_half(const float *input, const HalfMatrix *weights, const float *biases)
+{
+    float *output = (float *)malloc(weights->rows * sizeof(float));
+
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < weights->rows; i++)
+    {
+        output[i] = dot_row(weights, i, input) + (biases != NULL ? biases[i] : 0.0f);
+    }
+    return output;
+}
+
+void linear_half_slice(const float *input, const HalfMatrix *weights, const float *biases, int start, int count, float *output)
+{
+    for (int r = 0; r < count; r++)
+    {
+        output[r] = dot_row(weights, start + r, input) + (biases != NULL ? biases[start + r] : 0.0f);
+    }
+}
+
+// GEMM over numInputs rows: every weight row is streamed and widened once per tile of
+// HALF_TILE_ROWS inputs instead of once per input.
+float **linear_half_rows(float **inputs, int numInputs, const HalfMatrix *weights, const float *biases)
+{
+    float **outputs = (float **)malloc(numInputs * sizeof(float *));
+    for (int t = 0; t < numInputs; t++)
+    {
+        outputs[t] = (float *)malloc(weights->rows * sizeof(float));
+    }
+
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < weights->rows; i++)
+    {
+        float bias = (biases != NULL) ? biases[i] : 0.0f;
+        int t0 = 0;
+        for (; t0 + HALF_TILE_ROWS <= numInputs; t0 += HALF_TILE_ROWS)
+        {
+            float values[HALF_TILE_ROWS];
+            dot_row_tile(weights, i, (const float **)inputs + t0, values);
+            for (int t = 0; t < HALF_TILE_ROWS; t++)
+            {
+                outputs[t0 + t][i] = values[t] + bias;
+            }
+        }
+        for (; t0 < numInputs; t0++)
+        {
+            outputs[t0][i] = dot_row(weights, i, inputs[t0]) + bias;
+        }
+    }
+    return outputs;
+}
+
+// Accumulate a[t] * b into c[t] for up to HALF_TILE_ROWS rows of A at once
+static inline void axpy_half_tile(const float *a, int n, const uint16_t *b, int width, HalfType type, float **c)
+{
+    int j = 0;
+#ifdef HALF_SIMD
+    for (; j + 8 <= width; j += 8)
+    {
+        __m256 bv = load_half8(b + j, type);
+        for (int t = 0; t < n; t++)
+        {
+            float *ct = c[t] + j;
+            _mm256_storeu_ps(ct, _mm256_fmadd_ps(_mm256_set1_ps(a[t]), bv, _mm256_loadu_ps(ct)));
+        }
+    }
+#endif
+    for (; j < width; j++)
+    {
+        float bj = half_value(b[j], type);
+        for (int t = 0; t < n; t++)
+        {
+            c[t][j] += a[t] * bj;
+        }
+    }
+}
+
+// i-k-j order so B is read row by row; a tile of A rows shares every widened B vector
+float **matmul_half(float **A, const HalfMatrix *B, int A_rows)
+{
+    float **C = (float **)malloc(A_rows * sizeof(float *));
+    for (int i = 0; i < A_rows; i++)
+    {
+        C[i] = (float *)calloc(B->cols, sizeof(float));
+    }
+
+    int num_tiles = (A_rows + HALF_TILE_ROWS - 1) / HALF_TILE_ROWS;
+#pragma omp parallel for schedule(static)
+    for (int tile = 0; tile < num_tiles; tile++)
+    {
+        int i0 = tile * HALF_TILE_ROWS;
+        int n = (A_rows - i0 < HALF_TILE_ROWS) ? A_rows - i0 : HALF_TILE_ROWS;
+        for (int k = 0; k < B->rows; k++)
+        {
+            float a[HALF_TILE_ROWS];
+            for (int t = 0; t < n; t++)
+            {
+                a[t] = A[i0 + t][k];
+            }
+            const uint16_t *b = B->data + (size_t)k * B->cols;
+            if (B->type == HALF_BF16)
+                axpy_half_tile(a, n, b, B->cols, HALF_BF16, &C[i0]);
+            else
+                axpy_half_tile(a, n, b, B->cols, HALF_FP16, &C[i0]);
+        }
+    }
+    return C;
+}
+
+void embedding_half(const HalfMatrix *table, int index, float *output)
+{
+    convert_from_half(table->data + (size_t)index * table->cols, output, table->cols, table->type);
+}
@@ -0,0 +1,130 @@
+#ifndef HALF_H
+#define HALF_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#ifdef __F16C__
+#include <immintrin.h>
+#endif
+
+#define HALF_TILE_ROWS 4 // input rows that share each converted weight vector in the GEMM
+
+// 16-bit float storage formats. Values are widened to fp32 in registers and every product
+// is accumulated in fp32, so only the bytes in memory shrink.
+typedef enum
+{
+    HALF_NONE,
+    HALF_FP16, // IEEE binary16: 5 exponent bits, 10 mantissa bits
+    HALF_BF16  // bfloat16: the upper half of an fp32, same range with 7 mantissa bits
+} HalfType;
+
+// [rows][cols] matrix of 16-bit floats, e.g. the [output][input] weights of a linear layer
+typedef struct
+{
+    HalfType type;
+    int rows;
+    int cols;
+    uint16_t *data; // data[rows * cols]
+} HalfMatrix;
+
+// IEEE half precision conversions with round-to-nearest-even
+static inline float fp16_to_float(uint16_t h)
+{
+#ifdef __F16C__
+    return _cvtsh_ss(h);
+#else
+    uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+    uint32_t exponent = (h >> 10) & 0x1F;
+    uint32_t mantissa = h & 0x3FF;
+    uint32_t bits;
+    if (exponent == 0x1F)
+    {
+        bits = sign | 0x7F800000 | (mantissa << 13);
+    }
+    else if (exponent != 0)
+    {
+        bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    }
+    else
+    {
+        // Zero or subnormal: value = mantissa * 2^-24
+        float value = (float)mantissa * (1.0f / 16777216.0f);
+        return sign ? -value : value;
+    }
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+#endif
+}
+
+static inline uint16_t float_to_fp16(float f)
+{
+#ifdef __F16C__
+    return _cvtss_sh(f, _MM_FROUND_TO_NEAREST_INT);
+#else
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    uint16_t sign = (bits >> 16) & 0x8000;
+    uint32_t magnitude = bits & 0x7FFFFFFF;
+    if (magnitude >= 0x7F800000)
+        return sign | 0x7C00 | (magnitude > 0x7F800000 ? 0x200 : 0); // inf / nan
+    if (magnitude >= 0x477FF000)
+        return sign | 0x7C00; // rounds past the largest half
+    if (magnitude < 0x38800000)
+    {
+        // Subnormal half: round magnitude / 2^-24 to an integer
+        float value;
+        memcpy(&value, &magnitude, sizeof(value));
+        return sign | (uint16_t)lrintf(value * 16777216.0f);
+    }
+    uint32_t rounded = magnitude + 0xFFF + ((magnitude >> 13) & 1);
+    return sign | (uint16_t)((rounded - 0x38000000) >> 13);
+#endif
+}
+
+// bfloat16 widens with a shift; narrowing rounds the dropped 16 bits to nearest even
+static inline float bf16_to_float(uint16_t h)
+{
+    uint32_t bits = (uint32_t)h << 16;
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static inline uint16_t float_to_bf16(float f)
+{
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    if ((bits & 0x7FFFFFFF) > 0x7F800000)
+        return (uint16_t)((bits >> 16) | 0x40); // keep nan quiet rather than rounding it to inf
+    return (uint16_t)((bits + 0x7FFF + ((bits >> 16) & 1)) >> 16);
+}
+
+static inline float half_value(uint16_t h, HalfType type)
+{
+    return (type == HALF_BF16) ? bf16_to_float(h) : fp16_to_float(h);
+}
+
+// Bulk conversions between fp32 and a 16-bit format
+void convert_to_half(const float *input, uint16_t *output, size_t count, HalfType type);
+void convert_from_half(const uint16_t *input, float *output, size_t count, HalfType type);
+
+HalfMatrix *half_matrix_from_rows(float **matrix, int rows, int cols, HalfType type);
+void half_matrix_free(HalfMatrix *matrix);
+
+// output = weights * input + biases with 16-bit weights and fp32 accumulation. biases may be NULL.
+float *linear_half(const float *input, const HalfMatrix *weights, const float *biases);
+float **linear_half_rows(float **inputs, int numInputs, const HalfMatrix *weights, const float *biases);
+
+// output[r] = row start + r of weights * input + biases, for r < count, on the calling thread
+void linear_half_slice(const float *input, const HalfMatrix *weights, const float *biases, int start, int count, float *output);
+
+// C[A_rows][B->cols] = A * B for fp32 A[A_rows][B->rows] and a 16-bit B
+float **matmul_half(float **A, const HalfMatrix *B, int A_rows);
+
+// Copy row `index` of a 16-bit embedding table into output[table->cols] as fp32
+void embedding_half(const HalfMatrix *table, int index, float *output);
+
+#endif // HALF_H
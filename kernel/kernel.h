@@ -7,5 +7,9 @@
 #include "linear.h"
 #include "nn.h"
 #include "attention.h"
+#include "kv_cache.h"
+#include "sampling.h"
+#include "quant.h"
+#include "half.h"
 
 #endif // KERNEL_H
\ No newline at end of file
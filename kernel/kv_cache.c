@@ -0,0 +1,482 @@
+#include "kv_cache.h"
+#include <stdio.h>
+#include <math.h>
+
+KVBlockPool *kv_pool_create(int numLayers, int numBlocks, int blockTokens, int numHeads, int headDim, KVCacheType type)
+{
+    KVBlockPool *pool = (KVBlockPool *)calloc(1, sizeof(KVBlockPool));
+    pool->type = type;
+    pool->numLayers = numLayers;
+    pool->numBlocks = numBlocks;
+    pool->blockTokens = blockTokens;
+    pool->numHeads = numHeads;
+    pool->headDim = headDim;
+    pool->width = numHeads * headDim;
+
+    size_t slots = (size_t)numBlocks * blockTokens;
+    if (type == KV_INT8)
+    {
+        pool->keys_q = (int8_t **)malloc(numLayers * sizeof(int8_t *));
+        pool->values_q = (int8_t **)malloc(numLayers * sizeof(int8_t *));
+        pool->key_scales = (float **)malloc(numLayers * sizeof(float *));
+        pool->value_scales = (float **)malloc(numLayers * sizeof(float *));
+        for (int l = 0; l < numLayers; l++)
+        {
+            pool->keys_q[l] = (int8_t *)malloc(slots * pool->width);
+            pool->values_q[l] = (int8_t *)malloc(slots * pool->width);
+            pool->key_scales[l] = (float *)malloc(slots * numHeads * sizeof(float));
+            pool->value_scales[l] = (float *)malloc(slots * numHeads * sizeof(float));
+        }
+    }
+    else if (kv_half_type(pool) != HALF_NONE)
+    {
+        pool->keys_h = (uint16_t **)malloc(numLayers * sizeof(uint16_t *));
+        pool->values_h = (uint16_t **)malloc(numLayers * sizeof(uint16_t *));
+        for (int l = 0; l < numLayers; l++)
+        {
+            pool->keys_h[l] = (uint16_t *)malloc(slots * pool->width * sizeof(uint16_t));
+            pool->values_h[l] = (uint16_t *)malloc(slots * pool->width * sizeof(uint16_t));
+        }
+    }
+    else
+    {
+        pool->keys = (float **)malloc(numLayers * sizeof(float *));
+        pool->values = (float **)malloc(numLayers * sizeof(float *));
+        for (int l = 0; l < numLayers; l++)
+        {
+            pool->keys[l] = (float *)malloc(slots * pool->width * sizeof(float));
+            pool->values[l] = (float *)malloc(slots * pool->width * sizeof(float));
+        }
+    }
+
+    // Lowest block ids are handed out first
+    pool->refCounts = (int *)calloc(numBlocks, sizeof(int));
+    pool->freeBlocks = (int *)malloc(numBlocks * sizeof(int));
+    for (int b = 0; b < numBlocks; b++)
+    {
+        pool->freeBlocks[b] = numBlocks - 1 - b;
+    }
+    pool->numFree = numBlocks;
+    return pool;
+}
+
+void kv_pool_free(KVBlockPool *pool)
+{
+    for (int l = 0; l < pool->numLayers; l++)
+    {
+        if (pool->type == KV_INT8)
+        {
+            free(pool->keys_q[l]);
+            free(pool->values_q[l]);
+            free(pool->key_scales[l]);
+            free(pool->value_scales[l]);
+        }
+        else if (kv_half_type(pool) != HALF_NONE)
+        {
+            free(pool->keys_h[l]);
+            free(pool->values_h[l]);
+        }
+        else
+        {
+            free(pool->keys[l]);
+            free(pool->values[l]);
+        }
+    }
+    free(pool->keys);
+    free(pool->values);
+    free(pool->keys_q);
+    free(pool->values_q);
+    free(pool->key_scales);
+    free(pool->value_scales);
+    free(pool->keys_h);
+    free(pool->values_h);
+    free(pool->freeBlocks);
+    free(pool->refCounts);
+    free(pool);
+}
+
+static void grow_table(KVCache *cache, int needed)
+{
+    if (needed > cache->maxBlocks)
+    {
+        while (cache->maxBlocks < needed)
+        {
+            cache->maxBlocks *= 2;
+        }
+        cache->blockTable = (int *)realloc(cache->blockTable, cache->maxBlocks * sizeof(int));
+    }
+}
+
+KVCache *kv_cache_create(KVBlockPool *pool)
+{
+    KVCache *cache = (KVCache *)malloc(sizeof(KVCache));
+    cache->pool = pool;
+    cache->length = 0;
+    cache->numBlocks = 0;
+    cache->maxBlocks = 4;
+    cache->blockTable = (int *)malloc(cache->maxBlocks * sizeof(int));
+    return cache;
+}
+
+// A second sequence with the same positions, e.g. a beam that branches off another one. The
+// blocks holding them are shared until one of the two writes into a shared block, which then
+// gets its own copy (see kv_cache_reserve).
+KVCache *kv_cache_fork(const KVCache *cache)
+{
+    KVBlockPool *pool = cache->pool;
+    KVCache *fork = kv_cache_create(pool);
+    int used = (cache->length + pool->blockTokens - 1) / pool->blockTokens;
+    grow_table(fork, used);
+    for (int b = 0; b < used; b++)
+    {
+        fork->blockTable[b] = cache->blockTable[b];
+        pool->refCounts[fork->blockTable[b]]++;
+    }
+    fork->numBlocks = used;
+    fork->length = cache->length;
+    return fork;
+}
+
+void kv_cache_free(KVCache *cache)
+{
+    kv_cache_reset(cache);
+    free(cache->blockTable);
+    free(cache);
+}
+
+// Drop one reference to a block, returning it to the pool with the last one
+static void release_block(KVBlockPool *pool, int block)
+{
+    if (--pool->refCounts[block] == 0)
+    {
+        pool->freeBlocks[pool->numFree++] = block;
+    }
+}
+
+// Release every block of the sequence; blocks still held by the prefix cache stay allocated
+void kv_cache_reset(KVCache *cache)
+{
+    KVBlockPool *pool = cache->pool;
+    for (int b = cache->numBlocks - 1; b >= 0; b--)
+    {
+        release_block(pool, cache->blockTable[b]);
+    }
+    cache->numBlocks = 0;
+    cache->length = 0;
+}
+
+// Roll the sequence back to its first `length` positions, e.g. to drop rejected speculative
+// tokens, and release the blocks past them
+void kv_cache_truncate(KVCache *cache, int length)
+{
+    if (length >= cache->length)
+        return;
+    KVBlockPool *pool = cache->pool;
+    int needed = (length + pool->blockTokens - 1) / pool->blockTokens;
+    while (cache->numBlocks > needed)
+    {
+        release_block(pool, cache->blockTable[--cache->numBlocks]);
+    }
+    cache->length = length;
+}
+
+static void copy_rows(void *dst, const void *src, size_t slot_from, size_t slot_to, size_t count, size_t row_bytes)
+{
+    memcpy((char *)dst + slot_to * row_bytes, (const char *)src + slot_from * row_bytes, count * row_bytes);
+}
+
+// Copy every layer of block `from` into block `to`
+static void copy_block(KVBlockPool *pool, int from, int to)
+{
+    size_t count = pool->blockTokens;
+    size_t slot_from = (size_t)from * count;
+    size_t slot_to = (size_t)to * count;
+    for (int l = 0; l < pool->numLayers; l++)
+    {
+        if (pool->type == KV_INT8)
+        {
+            copy_rows(pool->keys_q[l], pool->keys_q[l], slot_from, slot_to, count, pool->width);
+            copy_rows(pool->values_q[l], pool->values_q[l], slot_from, slot_to, count, pool->width);
+            copy_rows(pool->key_scales[l], pool->key_scales[l], slot_from, slot_to, count, pool->numHeads * sizeof(float));
+            copy_rows(pool->value_scales[l], pool->value_scales[l], slot_from, slot_to, count, pool->numHeads * sizeof(float));
+        }
+        else if (kv_half_type(pool) != HALF_NONE)
+        {
+            copy_rows(pool->keys_h[l], pool->keys_h[l], slot_from, slot_to, count, pool->width * sizeof(uint16_t));
+            copy_rows(pool->values_h[l], pool->values_h[l], slot_from, slot_to, count, pool->width * sizeof(uint16_t));
+        }
+        else
+        {
+            copy_rows(pool->keys[l], pool->keys[l], slot_from, slot_to, count, pool->width * sizeof(float));
+            copy_rows(pool->values[l], pool->values[l], slot_from, slot_to, count, pool->width * sizeof(float));
+        }
+    }
+}
+
+// Make sure the block table covers `length` positions, taking blocks from the pool. If the
+// next position falls in a block shared with another sequence, that block is copied first
+// (copy on write); blocks past it are never shared. Returns 0 on success, -1 if the pool has
+// run out of blocks even after evicting unused prefix cache entries.
+int kv_cache_reserve(KVCache *cache, int length)
+{
+    KVBlockPool *pool = cache->pool;
+    int needed = (length + pool->blockTokens - 1) / pool->blockTokens;
+    int next = cache->length / pool->blockTokens;
+    int shared = length > cache->length && next < cache->numBlocks && pool->refCounts[cache->blockTable[next]] > 1;
+    int missing = needed - cache->numBlocks;
+    missing = (missing > 0 ? missing : 0) + shared;
+    if (missing > pool->numFree && pool->prefix != NULL)
+        kv_prefix_evict(pool->prefix, missing - pool->numFree);
+    if (missing > pool->numFree)
+        return -1;
+
+    if (shared)
+    {
+        int block = pool->freeBlocks[--pool->numFree];
+        pool->refCounts[block] = 1;
+        copy_block(pool, cache->blockTable[next], block);
+        release_block(pool, cache->blockTable[next]);
+        cache->blockTable[next] = block;
+    }
+    grow_table(cache, needed);
+    while (cache->numBlocks < needed)
+    {
+        int block = pool->freeBlocks[--pool->numFree];
+        pool->refCounts[block] = 1;
+        cache->blockTable[cache->numBlocks++] = block;
+    }
+    return 0;
+}
+
+// Symmetric int8 quantization of one row, one scale per head
+static void quantize_row(const float *row, int8_t *q, float *scales, int numHeads, int headDim)
+{
+    for (int h = 0; h < numHeads; h++)
+    {
+        const float *x = &row[h * headDim];
+        float max_abs = 0.0f;
+        for (int d = 0; d < headDim; d++)
+        {
+            float a = fabsf(x[d]);
+            if (a > max_abs)
+            {
+                max_abs = a;
+            }
+        }
+
+        float scale = max_abs / 127.0f;
+        float inv_scale = (scale > 0.0f) ? 1.0f / scale : 0.0f;
+        scales[h] = scale;
+        for (int d = 0; d < headDim; d++)
+        {
+            q[h * headDim + d] = (int8_t)lrintf(x[d] * inv_scale);
+        }
+    }
+}
+
+// Copy the K/V rows of numTokens new positions of one layer after the committed ones.
+// Returns 0 on success, -1 if the pool cannot hold them.
+int kv_cache_append(KVCache *cache, int layer, float **K, float **V, int numTokens)
+{
+    if (kv_cache_reserve(cache, cache->length + numTokens) != 0)
+        return -1;
+
+    KVBlockPool *pool = cache->pool;
+    for (int i = 0; i < numTokens; i++)
+    {
+        size_t slot = kv_cache_slot(cache, cache->length + i);
+        if (pool->type == KV_INT8)
+        {
+            quantize_row(K[i], &pool->keys_q[layer][slot * pool->width], &pool->key_scales[layer][slot * pool->numHeads], pool->numHeads, pool->headDim);
+            quantize_row(V[i], &pool->values_q[layer][slot * pool->width], &pool->value_scales[layer][slot * pool->numHeads], pool->numHeads, pool->headDim);
+        }
+        else if (kv_half_type(pool) != HALF_NONE)
+        {
+            convert_to_half(K[i], &pool->keys_h[layer][slot * pool->width], pool->width, kv_half_type(pool));
+            convert_to_half(V[i], &pool->values_h[layer][slot * pool->width], pool->width, kv_half_type(pool));
+        }
+        else
+        {
+            memcpy(&pool->keys[layer][slot * pool->width], K[i], pool->width * sizeof(float));
+            memcpy(&pool->values[layer][slot * pool->width], V[i], pool->width * sizeof(float));
+        }
+    }
+    return 0;
+}
+
+// Make the positions appended to every layer visible to the next step
+void kv_cache_commit(KVCache *cache, int numTokens)
+{
+    cache->length += numTokens;
+}
+
+KVPrefixCache *kv_prefix_cache_create(KVBlockPool *pool)
+{
+    KVPrefixCache *prefix = (KVPrefixCache *)calloc(1, sizeof(KVPrefixCache));
+    prefix->pool = pool;
+    prefix->capacity = pool->numBlocks;
+    prefix->entries = (KVPrefixEntry *)malloc(prefix->capacity * sizeof(KVPrefixEntry));
+    prefix->tokens = (int *)malloc((size_t)prefix->capacity * pool->blockTokens * sizeof(int));
+    prefix->numBuckets = 1;
+    while (prefix->numBuckets < 2 * prefix->capacity)
+    {
+        prefix->numBuckets <<= 1;
+    }
+    prefix->buckets = (int *)malloc(prefix->numBuckets * sizeof(int));
+    for (int b = 0; b < prefix->numBuckets; b++)
+    {
+        prefix->buckets[b] = -1;
+    }
+    prefix->freeEntries = (int *)malloc(prefix->capacity * sizeof(int));
+    for (int e = 0; e < prefix->capacity; e++)
+    {
+        prefix->entries[e].block = -1;
+        prefix->freeEntries[e] = prefix->capacity - 1 - e;
+    }
+    prefix->numFreeEntries = prefix->capacity;
+    pool->prefix = prefix;
+    return prefix;
+}
+
+// Release every entry's block and detach from the pool
+void kv_prefix_cache_free(KVPrefixCache *prefix)
+{
+    for (int e = 0; e < prefix->capacity; e++)
+    {
+        if (prefix->entries[e].block >= 0)
+        {
+            release_block(prefix->pool, prefix->entries[e].block);
+        }
+    }
+    prefix->pool->prefix = NULL;
+    free(prefix->entries);
+    free(prefix->tokens);
+    free(prefix->buckets);
+    free(prefix->freeEntries);
+    free(prefix);
+}
+
+// FNV-1a over the block's tokens, seeded with the hash of the blocks before it
+static uint64_t chain_hash(uint64_t parent, const int *tokens, int count)
+{
+    uint64_t hash = parent ^ 0xCBF29CE484222325ull;
+    for (int i = 0; i < count; i++)
+    {
+        hash = (hash ^ (uint32_t)tokens[i]) * 0x100000001B3ull;
+    }
+    return hash;
+}
+
+static int find_entry(const KVPrefixCache *prefix, uint64_t hash, int depth, const int *tokens)
+{
+    int blockTokens = prefix->pool->blockTokens;
+    for (int e = prefix->buckets[hash & (prefix->numBuckets - 1)]; e >= 0; e = prefix->entries[e].next)
+    {
+        const KVPrefixEntry *entry = &prefix->entries[e];
+        if (entry->hash == hash && entry->depth == depth &&
+            memcmp(&prefix->tokens[(size_t)e * blockTokens], tokens, blockTokens * sizeof(int)) == 0)
+            return e;
+    }
+    return -1;
+}
+
+static void remove_entry(KVPrefixCache *prefix, int e)
+{
+    int *link = &prefix->buckets[prefix->entries[e].hash & (prefix->numBuckets - 1)];
+    while (*link != e)
+    {
+        link = &prefix->entries[*link].next;
+    }
+    *link = prefix->entries[e].next;
+    release_block(prefix->pool, prefix->entries[e].block);
+    prefix->entries[e].block = -1;
+    prefix->freeEntries[prefix->numFreeEntries++] = e;
+}
+
+// Map the longest cached prefix of tokens into an empty cache and return the number of
+// positions it covers. Only whole blocks are shared, and the last token is always left out
+// so the caller still runs it to get the next token's logits.
+int kv_prefix_lookup(KVPrefixCache *prefix, KVCache *cache, const int *tokens, int numTokens)
+{
+    int blockTokens = prefix->pool->blockTokens;
+    if (cache->length != 0)
+        return 0;
+
+    uint64_t hash = 0;
+    uint64_t now = ++prefix->clock;
+    int reused = 0;
+    for (int depth = 0; (depth + 1) * blockTokens < numTokens; depth++)
+    {
+        hash = chain_hash(hash, &tokens[depth * blockTokens], blockTokens);
+        int e = find_entry(prefix, hash, depth, &tokens[depth * blockTokens]);
+        if (e < 0)
+            break;
+
+        // Share the block: the sequence only ever appends after it, so it is never written
+        int block = prefix->entries[e].block;
+        prefix->pool->refCounts[block]++;
+        grow_table(cache, depth + 1);
+        cache->blockTable[cache->numBlocks++] = block;
+        prefix->entries[e].lastUsed = now;
+        reused += blockTokens;
+    }
+    cache->length = reused;
+    return reused;
+}
+
+// Record the full blocks of cache that hold tokens[0, numTokens), so later requests with the
+// same prefix can reuse them. Blocks already cached are only touched.
+void kv_prefix_insert(KVPrefixCache *prefix, const KVCache *cache, const int *tokens, int numTokens)
+{
+    int blockTokens = prefix->pool->blockTokens;
+    uint64_t hash = 0;
+    uint64_t now = ++prefix->clock;
+    for (int depth = 0; (depth + 1) * blockTokens <= numTokens && (depth + 1) * blockTokens <= cache->length; depth++)
+    {
+        const int *blockTokenIds = &tokens[depth * blockTokens];
+        hash = chain_hash(hash, blockTokenIds, blockTokens);
+        int e = find_entry(prefix, hash, depth, blockTokenIds);
+        if (e < 0)
+        {
+            if (prefix->numFreeEntries == 0 && kv_prefix_evict(prefix, 0) == 0)
+                return;
+            e = prefix->freeEntries[--prefix->numFreeEntries];
+            KVPrefixEntry *entry = &prefix->entries[e];
+            entry->hash = hash;
+            entry->depth = depth;
+            entry->block = cache->blockTable[depth];
+            entry->next = prefix->buckets[hash & (prefix->numBuckets - 1)];
+            prefix->buckets[hash & (prefix->numBuckets - 1)] = e;
+            memcpy(&prefix->tokens[(size_t)e * blockTokens], blockTokenIds, blockTokens * sizeof(int));
+            prefix->pool->refCounts[entry->block]++;
+        }
+        prefix->entries[e].lastUsed = now;
+    }
+}
+
+// Evict least recently used entries whose block no sequence holds, until numBlocks blocks
+// went back to the pool (or one entry when numBlocks is 0). Within one lookup's stamp the
+// deepest block goes first, so a chain is trimmed from its tail and never orphaned.
+// Returns the number of entries evicted; the scan is linear, which eviction's rarity affords.
+int kv_prefix_evict(KVPrefixCache *prefix, int numBlocks)
+{
+    int evicted = 0;
+    do
+    {
+        int victim = -1;
+        for (int e = 0; e < prefix->capacity; e++)
+        {
+            const KVPrefixEntry *entry = &prefix->entries[e];
+            if (entry->block < 0 || prefix->pool->refCounts[entry->block] != 1)
+                continue;
+            if (victim < 0 || entry->lastUsed < prefix->entries[victim].lastUsed ||
+                (entry->lastUsed == prefix->entries[victim].lastUsed && entry->depth > prefix->entries[victim].depth))
+                victim = e;
+        }
+        if (victim < 0)
+            break;
+        remove_entry(prefix, victim);
+        evicted++;
+    } while (evicted < numBlocks);
+    return evicted;
+}
@@ -0,0 +1,127 @@
+#ifndef KV_CACHE_H
+#define KV_CACHE_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "half.h"
+
+#define KV_BLOCK_TOKENS 16 // Default number of positions per cache block
+
+typedef struct KVPrefixCache KVPrefixCache;
+
+// Storage type of cached keys and values
+typedef enum
+{
+    KV_FLOAT32,
+    KV_INT8,     // int8 with one scale per (position, head)
+    KV_FLOAT16,  // IEEE fp16, widened to fp32 when attention reads a tile
+    KV_BFLOAT16  // bfloat16, same range as fp32 with 8 bits of precision
+} KVCacheType;
+
+// Shared pool of fixed-size KV blocks. A block holds blockTokens positions of every layer,
+// so one block id in a sequence's block table addresses the same positions in all layers.
+typedef struct
+{
+    KVCacheType type;
+    int numLayers;
+    int numBlocks;
+    int blockTokens;
+    int numHeads;
+    int headDim;
+    int width;             // numHeads * headDim
+    float **keys;          // keys[numLayers][numBlocks * blockTokens * width], KV_FLOAT32 only
+    float **values;        // values[numLayers][numBlocks * blockTokens * width], KV_FLOAT32 only
+    int8_t **keys_q;       // keys_q[numLayers][numBlocks * blockTokens * width], KV_INT8 only
+    int8_t **values_q;     // values_q[numLayers][numBlocks * blockTokens * width], KV_INT8 only
+    float **key_scales;    // key_scales[numLayers][numBlocks * blockTokens * numHeads], KV_INT8 only
+    float **value_scales;  // value_scales[numLayers][numBlocks * blockTokens * numHeads], KV_INT8 only
+    uint16_t **keys_h;     // keys_h[numLayers][numBlocks * blockTokens * width], KV_FLOAT16 / KV_BFLOAT16 only
+    uint16_t **values_h;   // values_h[numLayers][numBlocks * blockTokens * width], KV_FLOAT16 / KV_BFLOAT16 only
+    int *freeBlocks;       // stack of free block ids
+    int numFree;
+    int *refCounts;        // refCounts[numBlocks], block tables and prefix cache entries holding each block
+    KVPrefixCache *prefix; // optional prefix cache, evicted from when the pool runs dry
+} KVBlockPool;
+
+// Per-sequence key/value cache: a block table into a shared pool, grown on demand
+typedef struct
+{
+    KVBlockPool *pool;
+    int length;      // number of committed positions
+    int numBlocks;   // blocks currently in the table
+    int maxBlocks;   // capacity of the table
+    int *blockTable; // blockTable[numBlocks], logical block -> pool block id
+} KVCache;
+
+KVBlockPool *kv_pool_create(int numLayers, int numBlocks, int blockTokens, int numHeads, int headDim, KVCacheType type);
+void kv_pool_free(KVBlockPool *pool);
+
+KVCache *kv_cache_create(KVBlockPool *pool);
+KVCache *kv_cache_fork(const KVCache *cache);
+void kv_cache_free(KVCache *cache);
+void kv_cache_reset(KVCache *cache);
+int kv_cache_reserve(KVCache *cache, int length);
+int kv_cache_append(KVCache *cache, int layer, float **K, float **V, int numTokens);
+void kv_cache_commit(KVCache *cache, int numTokens);
+void kv_cache_truncate(KVCache *cache, int length);
+
+// One cached block of a prompt prefix
+typedef struct
+{
+    uint64_t hash;     // chain hash of this block's tokens and of every block before it
+    uint64_t lastUsed; // clock of the last lookup or insert that touched the block
+    int block;         // pool block id, -1 for a free entry
+    int depth;         // index of the block in its sequence
+    int next;          // next entry of the same hash bucket, -1 at the end
+} KVPrefixEntry;
+
+// Cache of full KV blocks keyed by the token prefix they hold. A request whose prompt starts
+// with cached blocks maps them into its block table and skips their prefill. Entries hold a
+// reference on their block, so blocks outlive the sequence that computed them; unreferenced
+// entries are evicted least recently used first when the pool runs out of blocks.
+struct KVPrefixCache
+{
+    KVBlockPool *pool;
+    int capacity;         // one entry per pool block at most
+    KVPrefixEntry *entries;
+    int *tokens;          // tokens[capacity * blockTokens], tokens of each entry's block
+    int *buckets;         // buckets[numBuckets], first entry of each hash bucket
+    int numBuckets;
+    int *freeEntries;
+    int numFreeEntries;
+    uint64_t clock;
+};
+
+KVPrefixCache *kv_prefix_cache_create(KVBlockPool *pool);
+void kv_prefix_cache_free(KVPrefixCache *prefix);
+int kv_prefix_lookup(KVPrefixCache *prefix, KVCache *cache, const int *tokens, int numTokens);
+void kv_prefix_insert(KVPrefixCache *prefix, const KVCache *cache, const int *tokens, int numTokens);
+int kv_prefix_evict(KVPrefixCache *prefix, int numBlocks);
+
+// 16-bit format of a KV_FLOAT16 / KV_BFLOAT16 pool, HALF_NONE for the others
+static inline HalfType kv_half_type(const KVBlockPool *pool)
+{
+    return (pool->type == KV_FLOAT16) ? HALF_FP16 : (pool->type == KV_BFLOAT16) ? HALF_BF16 : HALF_NONE;
+}
+
+// Index of the pool slot that holds `position` of the sequence
+static inline size_t kv_cache_slot(const KVCache *cache, int position)
+{
+    const KVBlockPool *pool = cache->pool;
+    int block = cache->blockTable[position / pool->blockTokens];
+    return (size_t)block * pool->blockTokens + position % pool->blockTokens;
+}
+
+// Address of the key/value row of `position` in `layer` (KV_FLOAT32 pools)
+static inline float *kv_cache_key(const KVCache *cache, int layer, int position)
+{
+    return cache->pool->keys[layer] + kv_cache_slot(cache, position) * cache->pool->width;
+}
+
+static inline float *kv_cache_value(const KVCache *cache, int layer, int position)
+{
+    return cache->pool->values[layer] + kv_cache_slot(cache, position) * cache->pool->width;
+}
+
+#endif // KV_CACHE_H
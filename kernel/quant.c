@@ -0,0 +1,664 @@
+#include "quant.h"
+#include "half.h"
+#include <math.h>
+#include <string.h>
+#ifdef __SSE__
+#include <immintrin.h>
+#endif
+
+QuantizedMatrix *quantize_int8(float **weights, int rows, int cols, int groupSize)
+{
+    if (groupSize == 0)
+        groupSize = cols;
+    if (groupSize <= 0 || cols % groupSize != 0)
+        return NULL;
+
+    QuantizedMatrix *matrix = (QuantizedMatrix *)calloc(1, sizeof(QuantizedMatrix));
+    matrix->type = QUANT_INT8;
+    matrix->rows = rows;
+    matrix->cols = cols;
+    matrix->groupSize = groupSize;
+    matrix->numGroups = cols / groupSize;
+    matrix->data = (int8_t *)malloc((size_t)rows * cols);
+    matrix->scales = (float *)malloc((size_t)rows * matrix->numGroups * sizeof(float));
+
+    // Symmetric quantization: the largest magnitude of each group maps to +-127
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < rows; i++)
+    {
+        for (int g = 0; g < matrix->numGroups; g++)
+        {
+            const float *w = weights[i] + g * groupSize;
+            int8_t *q = matrix->data + (size_t)i * cols + g * groupSize;
+            float maxAbs = 0.0f;
+            for (int j = 0; j < groupSize; j++)
+            {
+                maxAbs = fmaxf(maxAbs, fabsf(w[j]));
+            }
+
+            float inverse = (maxAbs > 0.0f) ? 127.0f / maxAbs : 0.0f;
+            matrix->scales[(size_t)i * matrix->numGroups + g] = maxAbs / 127.0f;
+            for (int j = 0; j < groupSize; j++)
+            {
+                q[j] = (int8_t)lrintf(w[j] * inverse);
+            }
+        }
+    }
+    return matrix;
+}
+
+// Asymmetric 4-bit quantization: each group's [min, max] maps onto [0, 15], so no code is
+// wasted on a sign. The scale and zero point are rounded to fp16 before the weights are
+// quantized so that the stored parameters reproduce them exactly.
+QuantizedMatrix *quantize_int4(float **weights, int rows, int cols, int groupSize)
+{
+    if (groupSize == 0)
+        groupSize = cols;
+    if (groupSize <= 0 || groupSize % 2 != 0 || cols % groupSize != 0)
+        return NULL;
+
+    QuantizedMatrix *matrix = (QuantizedMatrix *)calloc(1, sizeof(QuantizedMatrix));
+    matrix->type = QUANT_INT4;
+    matrix->rows = rows;
+    matrix->cols = cols;
+    matrix->groupSize = groupSize;
+    matrix->numGroups = cols / groupSize;
+    matrix->packed = (uint8_t *)malloc((size_t)rows * cols / 2);
+    matrix->half_scales = (uint16_t *)malloc((size_t)rows * matrix->numGroups * sizeof(uint16_t));
+    matrix->half_zeros = (uint16_t *)malloc((size_t)rows * matrix->numGroups * sizeof(uint16_t));
+
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < rows; i++)
+    {
+        for (int g = 0; g < matrix->numGroups; g++)
+        {
+            const float *w = weights[i] + g * groupSize;
+            uint8_t *q = matrix->packed + ((size_t)i * cols + g * groupSize) / 2;
+            float low = w[0], high = w[0];
+            for (int j = 1; j < groupSize; j++)
+            {
+                low = fminf(low, w[j]);
+                high = fmaxf(high, w[j]);
+            }
+
+            // A constant group still needs a non-zero scale to be representable
+            float range = high - low;
+            float scale = (range > 0.0f) ? range / 15.0f : ((low != 0.0f) ? fabsf(low) : 1.0f);
+            size_t index = (size_t)i * matrix->numGroups + g;
+            matrix->half_scales[index] = float_to_fp16(scale);
+            matrix->half_zeros[index] = float_to_fp16(-low / scale);
+            scale = fp16_to_float(matrix->half_scales[index]);
+            float zero = fp16_to_float(matrix->half_zeros[index]);
+
+            for (int j = 0; j < groupSize; j += 2)
+            {
+                long q0 = lrintf(w[j] / scale + zero);
+                long q1 = lrintf(w[j + 1] / scale + zero);
+                q0 = q0 < 0 ? 0 : (q0 > 15 ? 15 : q0);
+                q1 = q1 < 0 ? 0 : (q1 > 15 ? 15 : q1);
+                q[j / 2] = (uint8_t)(q0 | (q1 << 4));
+            }
+        }
+    }
+    return matrix;
+}
+
+QuantizedMatrix *quantized_matrix_view_int8(int8_t *data, float *scales, int rows, int cols)
+{
+    QuantizedMatrix *matrix = (QuantizedMatrix *)calloc(1, sizeof(QuantizedMatrix));
+    matrix->type = QUANT_INT8;
+    matrix->rows = rows;
+    matrix->cols = cols;
+    matrix->groupSize = cols;
+    matrix->numGroups = 1;
+    matrix->data = data;
+    matrix->scales = scales;
+    matrix->borrowed = 1;
+    return matrix;
+}
+
+void quantized_matrix_free(QuantizedMatrix *matrix)
+{
+    if (matrix == NULL)
+        return;
+    if (matrix->borrowed)
+    {
+        free(matrix);
+        return;
+    }
+    free(matrix->data);
+    free(matrix->scales);
+    free(matrix->packed);
+    free(matrix->half_scales);
+    free(matrix->half_zeros);
+    free(matrix);
+}
+
+#if defined(__AVX2__) && defined(__FMA__)
+static inline float horizontal_sum(__m256 v)
+{
+    __m128 lanes = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    lanes = _mm_hadd_ps(lanes, lanes);
+    lanes = _mm_hadd_ps(lanes, lanes);
+    return _mm_cvtss_f32(lanes);
+}
+
+// Sign-extend 8 int8 weights to fp32
+static inline __m256 load_int8x8(const int8_t *w)
+{
+    return _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i *)w)));
+}
+
+// Unpack 16 int4 weights (8 bytes, low nibble first) to two fp32 vectors: mask and shift
+// split the nibbles, and a byte interleave puts them back in weight order
+static inline void load_int4x16(const uint8_t *p, __m256 *first, __m256 *second)
+{
+    const __m128i mask = _mm_set1_epi8(0x0F);
+    __m128i bytes = _mm_loadl_epi64((const __m128i *)p);
+    __m128i low = _mm_and_si128(bytes, mask);
+    __m128i high = _mm_and_si128(_mm_srli_epi16(bytes, 4), mask);
+    __m128i q = _mm_unpacklo_epi8(low, high);
+    *first = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(q));
+    *second = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_srli_si128(q, 8)));
+}
+#endif
+
+// Dot product of x with one quantized row. Each group is accumulated unscaled and folded into
+// the total with its scale, so there is one multiply per group rather than per weight.
+static float dot_int8(const float *x, const int8_t *w, const float *scales, int cols, int groupSize)
+{
+#if defined(__AVX2__) && defined(__FMA__)
+    if (groupSize % 16 == 0)
+    {
+        __m256 total = _mm256_setzero_ps();
+        for (int g0 = 0; g0 < cols; g0 += groupSize)
+        {
+            __m256 acc0 = _mm256_setzero_ps();
+            __m256 acc1 = _mm256_setzero_ps();
+            for (int k = g0; k < g0 + groupSize; k += 16)
+            {
+                acc0 = _mm256_fmadd_ps(load_int8x8(w + k), _mm256_loadu_ps(x + k), acc0);
+                acc1 = _mm256_fmadd_ps(load_int8x8(w + k + 8), _mm256_loadu_ps(x + k + 8), acc1);
+            }
+            total = _mm256_fmadd_ps(_mm256_add_ps(acc0, acc1), _mm256_set1_ps(scales[g0 / groupSize]), total);
+        }
+        return horizontal_sum(total);
+    }
+#endif
+    float sum = 0.0f;
+    for (int g0 = 0; g0 < cols; g0 += groupSize)
+    {
+        float acc = 0.0f;
+        for (int k = g0; k < g0 + groupSize; k++)
+        {
+            acc += w[k] * x[k];
+        }
+        sum += acc * scales[g0 / groupSize];
+    }
+    return sum;
+}
+
+// Dot products of QUANT_TILE_ROWS inputs with one quantized row; each weight vector is
+// converted once and reused for all of them
+static void dot_int8_tile(const float **x, const int8_t *w, const float *scales, int cols, int groupSize, float *out)
+{
+#if defined(__AVX2__) && defined(__FMA__)
+    if (groupSize % 8 == 0)
+    {
+        __m256 total[QUANT_TILE_ROWS];
+        for (int t = 0; t < QUANT_TILE_ROWS; t++)
+        {
+            total[t] = _mm256_setzero_ps();
+        }
+
+        for (int g0 = 0; g0 < cols; g0 += groupSize)
+        {
+            __m256 acc[QUANT_TILE_ROWS];
+            for (int t = 0; t < QUANT_TILE_ROWS; t++)
+            {
+                acc[t] = _mm256_setzero_ps();
+            }
+            for (int k = g0; k < g0 + groupSize; k += 8)
+            {
+                __m256 wv = load_int8x8(w + k);
+                for (int t = 0; t < QUANT_TILE_ROWS; t++)
+                {
+                    acc[t] = _mm256_fmadd_ps(wv, _mm256_loadu_ps(x[t] + k), acc[t]);
+                }
+            }
+            __m256 scale = _mm256_set1_ps(scales[g0 / groupSize]);
+            for (int t = 0; t < QUANT_TILE_ROWS; t++)
+            {
+                total[t] = _mm256_fmadd_ps(acc[t], scale, total[t]);
+            }
+        }
+
+        for (int t = 0; t < QUANT_TILE_ROWS; t++)
+        {
+            out[t] = horizontal_sum(total[t]);
+        }
+        return;
+    }
+#endif
+    for (int t = 0; t < QUANT_TILE_ROWS; t++)
+    {
+        out[t] = dot_int8(x[t], w, scales, cols, groupSize);
+    }
+}
+
+// Per-group sums of x, which turn the zero points into one correction per group:
+// sum_j (q_j - z) s x_j = s (sum_j q_j x_j - z sum_j x_j)
+static void group_sums(const float *x, int cols, int groupSize, float *sums)
+{
+    for (int g0 = 0; g0 < cols; g0 += groupSize)
+    {
+        float sum = 0.0f;
+        for (int k = g0; k < g0 + groupSize; k++)
+        {
+            sum += x[k];
+        }
+        sums[g0 / groupSize] = sum;
+    }
+}
+
+static float dot_int4(const float *x, const float *xsums, const uint8_t *p, const uint16_t *scales, const uint16_t *zeros, int cols, int groupSize)
+{
+    float correction = 0.0f;
+#if defined(__AVX2__) && defined(__FMA__)
+    if (groupSize % 16 == 0)
+    {
+        __m256 total = _mm256_setzero_ps();
+        for (int g0 = 0; g0 < cols; g0 += groupSize)
+        {
+            __m256 acc0 = _mm256_setzero_ps();
+            __m256 acc1 = _mm256_setzero_ps();
+            for (int k = g0; k < g0 + groupSize; k += 16)
+            {
+                __m256 w0, w1;
+                load_int4x16(p + k / 2, &w0, &w1);
+                acc0 = _mm256_fmadd_ps(w0, _mm256_loadu_ps(x + k), acc0);
+                acc1 = _mm256_fmadd_ps(w1, _mm256_loadu_ps(x + k + 8), acc1);
+            }
+            int g = g0 / groupSize;
+            float scale = fp16_to_float(scales[g]);
+            total = _mm256_fmadd_ps(_mm256_add_ps(acc0, acc1), _mm256_set1_ps(scale), total);
+            correction += scale * fp16_to_float(zeros[g]) * xsums[g];
+        }
+        return horizontal_sum(total) - correction;
+    }
+#endif
+    float sum = 0.0f;
+    for (int g0 = 0; g0 < cols; g0 += groupSize)
+    {
+        float acc = 0.0f;
+        for (int k = g0; k < g0 + groupSize; k += 2)
+        {
+            acc += (p[k / 2] & 0x0F) * x[k] + (p[k / 2] >> 4) * x[k + 1];
+        }
+        int g = g0 / groupSize;
+        float scale = fp16_to_float(scales[g]);
+        sum += scale * acc;
+        correction += scale * fp16_to_float(zeros[g]) * xsums[g];
+    }
+    return sum - correction;
+}
+
+static void dot_int4_tile(const float **x, const float **xsums, const uint8_t *p, const uint16_t *scales, const uint16_t *zeros, int cols, int groupSize, float *out)
+{
+#if defined(__AVX2__) && defined(__FMA__)
+    if (groupSize % 16 == 0)
+    {
+        __m256 total[QUANT_TILE_ROWS];
+        float correction[QUANT_TILE_ROWS];
+        for (int t = 0; t < QUANT_TILE_ROWS; t++)
+        {
+            total[t] = _mm256_setzero_ps();
+            correction[t] = 0.0f;
+        }
+
+        for (int g0 = 0; g0 < cols; g0 += groupSize)
+        {
+            __m256 acc[QUANT_TILE_ROWS];
+            for (int t = 0; t < QUANT_TILE_ROWS; t++)
+            {
+                acc[t] = _mm256_setzero_ps();
+            }
+            for (int k = g0; k < g0 + groupSize; k += 16)
+            {
+                __m256 w0, w1;
+                load_int4x16(p + k / 2, &w0, &w1);
+                for (int t = 0; t < QUANT_TILE_ROWS; t++)
+                {
+                    acc[t] = _mm256_fmadd_ps(w0, _mm256_loadu_ps(x[t] + k), acc[t]);
+                    acc[t] = _mm256_fmadd_ps(w1, _mm256_loadu_ps(x[t] + k + 8), acc[t]);
+                }
+            }
+            int g = g0 / groupSize;
+            float scale = fp16_to_float(scales[g]);
+            float offset = scale * fp16_to_float(zeros[g]);
+            __m256 scaleVector = _mm256_set1_ps(scale);
+            for (int t = 0; t < QUANT_TILE_ROWS; t++)
+            {
+                total[t] = _mm256_fmadd_ps(acc[t], scaleVector, total[t]);
+                correction[t] += offset * xsums[t][g];
+            }
+        }
+
+        for (int t = 0; t < QUANT_TILE_ROWS; t++)
+        {
+            out[t] = horizontal_sum(total[t]) - correction[t];
+        }
+        return;
+    }
+#endif
+    for (int t = 0; t < QUANT_TILE_ROWS; t++)
+    {
+        out[t] = dot_int4(x[t], xsums[t], p, scales, zeros, cols, groupSize);
+    }
+}
+
+// Row i of weights times x; xsums holds x's group sums (int4 only)
+static float dot_row(const QuantizedMatrix *weights, int i, const float *x, const float *xsums)
+{
+    size_t group = (size_t)i * weights->numGroups;
+    if (weights->type == QUANT_INT4)
+    {
+        return dot_int4(x, xsums, weights->packed + (size_t)i * weights->cols / 2, weights->half_scales + group,
+                        weights->half_zeros + group, weights->cols, weights->groupSize);
+    }
+    return dot_int8(x, weights->data + (size_t)i * weights->cols, weights->scales + group, weights->cols, weights->groupSize);
+}
+
+static void dot_row_tile(const QuantizedMatrix *weights, int i, const float **x, const float **xsums, float *out)
+{
+    size_t group = (size_t)i * weights->numGroups;
+    if (weights->type == QUANT_INT4)
+    {
+        dot_int4_tile(x, xsums, weights->packed + (size_t)i * weights->cols / 2, weights->half_scales + group,
+                      weights->half_zeros + group, weights->cols, weights->groupSize, out);
+    }
+    else
+    {
+        dot_int8_tile(x, weights->data + (size_t)i * weights->cols, weights->scales + group, weights->cols, weights->groupSize, out);
+    }
+}
+
+// Group sums of every input row, or NULL when the format has no zero points
+static float *input_group_sums(const float **inputs, int numInputs, const QuantizedMatrix *weights)
+{
+    if (weights->type != QUANT_INT4)
+        return NULL;
+
+    float *sums = (float *)malloc((size_t)numInputs * weights->numGroups * sizeof(float));
+    for (int t = 0; t < numInputs; t++)
+    {
+        group_sums(inputs[t], weights->cols, weights->groupSize, sums + (size_t)t * weights->numGroups);
+    }
+    return sums;
+}
+
+// Weight-only quantized GEMV. Decode is bound by weight traffic, and int8 (int4) weights move
+// a quarter (an eighth) of the bytes of fp32 ones through the memory hierarchy.
+float *linear_quantized(const float *input, const QuantizedMatrix *weights, const float *biases)
+{
+    float *output = (float *)malloc(weights->rows * sizeof(float));
+    float *xsums = input_group_sums(&input, 1, weights);
+
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < weights->rows; i++)
+    {
+        output[i] = dot_row(weights, i, input, xsums) + (biases != NULL ? biases[i] : 0.0f);
+    }
+
+    free(xsums);
+    return output;
+}
+
+void linear_quantized_slice(const float *input, const QuantizedMatrix *weights, const float *biases, int start, int count, float *output)
+{
+    float *xsums = input_group_sums(&input, 1, weights);
+    for (int r = 0; r < count; r++)
+    {
+        output[r] = dot_row(weights, start + r, input, xsums) + (biases != NULL ? biases[start + r] : 0.0f);
+    }
+    free(xsums);
+}
+
+// Weight-only quantized GEMM over numInputs rows (e.g. a prefill's tokens): outputs[t] =
+// weights * inputs[t] + biases. Inputs are processed QUANT_TILE_ROWS at a time so every weight
+// row is streamed and dequantized once per tile instead of once per input.
+float **linear_quantized_rows(float **inputs, int numInputs, const QuantizedMatrix *weights, const float *biases)
+{
+    float **outputs = (float **)malloc(numInputs * sizeof(float *));
+    for (int t = 0; t < numInputs; t++)
+    {
+        outputs[t] = (float *)malloc(weights->rows * sizeof(float));
+    }
+    float *xsums = input_group_sums((const float **)inputs, numInputs, weights);
+
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < weights->rows; i++)
+    {
+        float bias = (biases != NULL) ? biases[i] : 0.0f;
+        int t0 = 0;
+        for (; t0 + QUANT_TILE_ROWS <= numInputs; t0 += QUANT_TILE_ROWS)
+        {
+            const float *tileSums[QUANT_TILE_ROWS];
+            float values[QUANT_TILE_ROWS];
+            for (int t = 0; t < QUANT_TILE_ROWS; t++)
+            {
+                tileSums[t] = xsums ? xsums + (size_t)(t0 + t) * weights->numGroups : NULL;
+            }
+            dot_row_tile(weights, i, (const float **)inputs + t0, tileSums, values);
+            for (int t = 0; t < QUANT_TILE_ROWS; t++)
+            {
+                outputs[t0 + t][i] = values[t] + bias;
+            }
+        }
+        for (; t0 < numInputs; t0++)
+        {
+            outputs[t0][i] = dot_row(weights, i, inputs[t0], xsums ? xsums + (size_t)t0 * weights->numGroups : NULL) + bias;
+        }
+    }
+
+    free(xsums);
+    return outputs;
+}
+
+// Symmetric per-token quantization to [-127, 127]. Keeping -128 out of range lets the integer
+// kernels move signs between operands without overflow.
+static float quantize_row(const float *x, int cols, int8_t *q)
+{
+    float maxAbs = 0.0f;
+    for (int j = 0; j < cols; j++)
+    {
+        maxAbs = fmaxf(maxAbs, fabsf(x[j]));
+    }
+    float inverse = (maxAbs > 0.0f) ? 127.0f / maxAbs : 0.0f;
+    for (int j = 0; j < cols; j++)
+    {
+        q[j] = (int8_t)lrintf(x[j] * inverse);
+    }
+    return maxAbs / 127.0f;
+}
+
+static QuantizedActivations *allocate_activations(int rows, int cols)
+{
+    QuantizedActivations *activations = (QuantizedActivations *)malloc(sizeof(QuantizedActivations));
+    activations->rows = rows;
+    activations->cols = cols;
+    activations->data = (int8_t *)malloc((size_t)rows * cols);
+    activations->scales = (float *)malloc(rows * sizeof(float));
+    return activations;
+}
+
+QuantizedActivations *quantize_activations(float **inputs, int numInputs, int cols)
+{
+    QuantizedActivations *activations = allocate_activations(numInputs, cols);
+
+#pragma omp parallel for schedule(static)
+    for (int t = 0; t < numInputs; t++)
+    {
+        activations->scales[t] = quantize_row(inputs[t], cols, activations->data + (size_t)t * cols);
+    }
+    return activations;
+}
+
+void quantized_activations_free(QuantizedActivations *activations)
+{
+    if (activations == NULL)
+        return;
+    free(activations->data);
+    free(activations->scales);
+    free(activations);
+}
+
+// Integer dot products of n (<= QUANT_TILE_ROWS) int8 rows with one int8 weight segment.
+// The unsigned x signed multiply instructions (vpdpbusd, pmaddubsw) take |w| as the unsigned
+// operand and x with w's sign applied as the signed one, which preserves every product; with
+// both in [-127, 127] the pairwise int16 sums of pmaddubsw cannot saturate either.
+static inline void dot_i8(const int8_t **x, int n, const int8_t *w, int length, int32_t *out)
+{
+    int k = 0;
+    for (int t = 0; t < n; t++)
+    {
+        out[t] = 0;
+    }
+#if defined(__AVX512VNNI__) && defined(__AVX512BW__)
+    if (length % 64 == 0)
+    {
+        __m512i acc[QUANT_TILE_ROWS];
+        for (int t = 0; t < n; t++)
+        {
+            acc[t] = _mm512_setzero_si512();
+        }
+        for (; k < length; k += 64)
+        {
+            __m512i wv = _mm512_loadu_si512((const void *)(w + k));
+            __m512i magnitude = _mm512_abs_epi8(wv);
+            __mmask64 negative = _mm512_movepi8_mask(wv);
+            for (int t = 0; t < n; t++)
+            {
+                __m512i xv = _mm512_loadu_si512((const void *)(x[t] + k));
+                xv = _mm512_mask_sub_epi8(xv, negative, _mm512_setzero_si512(), xv);
+                acc[t] = _mm512_dpbusd_epi32(acc[t], magnitude, xv);
+            }
+        }
+        for (int t = 0; t < n; t++)
+        {
+            out[t] = _mm512_reduce_add_epi32(acc[t]);
+        }
+        return;
+    }
+#endif
+#if defined(__AVX2__)
+    if (length % 32 == 0)
+    {
+        __m256i acc[QUANT_TILE_ROWS];
+        for (int t = 0; t < n; t++)
+        {
+            acc[t] = _mm256_setzero_si256();
+        }
+        for (; k < length; k += 32)
+        {
+            __m256i wv = _mm256_loadu_si256((const __m256i *)(w + k));
+            __m256i magnitude = _mm256_abs_epi8(wv);
+            for (int t = 0; t < n; t++)
+            {
+                __m256i xv = _mm256_sign_epi8(_mm256_loadu_si256((const __m256i *)(x[t] + k)), wv);
+#if defined(__AVXVNNI__)
+                acc[t] = _mm256_dpbusd_avx_epi32(acc[t], magnitude, xv);
+#elif defined(__AVX512VNNI__) && defined(__AVX512VL__)
+                acc[t] = _mm256_dpbusd_epi32(acc[t], magnitude, xv);
+#else
+                __m256i pairs = _mm256_maddubs_epi16(magnitude, xv);
+                acc[t] = _mm256_add_epi32(acc[t], _mm256_madd_epi16(pairs, _mm256_set1_epi16(1)));
+#endif
+            }
+        }
+        for (int t = 0; t < n; t++)
+        {
+            __m128i lanes = _mm_add_epi32(_mm256_castsi256_si128(acc[t]), _mm256_extracti128_si256(acc[t], 1));
+            lanes = _mm_hadd_epi32(lanes, lanes);
+            lanes = _mm_hadd_epi32(lanes, lanes);
+            out[t] = _mm_cvtsi128_si32(lanes);
+        }
+        return;
+    }
+#endif
+    for (int t = 0; t < n; t++)
+    {
+        int32_t sum = 0;
+        for (int j = k; j < length; j++)
+        {
+            sum += (int32_t)x[t][j] * w[j];
+        }
+        out[t] = sum;
+    }
+}
+
+// Dequantized dot products of n activation rows with weight row i: every group's int32
+// result is scaled by its weight scale, and the total by the activation scales
+static inline void dot_w8a8(const QuantizedActivations *inputs, int t0, int n, const QuantizedMatrix *weights, int i, float *out)
+{
+    const int8_t *x[QUANT_TILE_ROWS];
+    float totals[QUANT_TILE_ROWS] = {0.0f};
+    for (int t = 0; t < n; t++)
+    {
+        x[t] = inputs->data + (size_t)(t0 + t) * inputs->cols;
+    }
+
+    const int8_t *w = weights->data + (size_t)i * weights->cols;
+    const float *scales = weights->scales + (size_t)i * weights->numGroups;
+    for (int g = 0; g < weights->numGroups; g++)
+    {
+        int32_t sums[QUANT_TILE_ROWS];
+        const int8_t *segment[QUANT_TILE_ROWS];
+        int offset = g * weights->groupSize;
+        for (int t = 0; t < n; t++)
+        {
+            segment[t] = x[t] + offset;
+        }
+        dot_i8(segment, n, w + offset, weights->groupSize, sums);
+        for (int t = 0; t < n; t++)
+        {
+            totals[t] += scales[g] * (float)sums[t];
+        }
+    }
+
+    for (int t = 0; t < n; t++)
+    {
+        out[t] = totals[t] * inputs->scales[t0 + t];
+    }
+}
+
+// W8A8 GEMM with a dequantizing epilogue: outputs[t] = weights * inputs[t] + biases in fp32.
+// Tiles of QUANT_TILE_ROWS tokens share every weight load.
+float **linear_int8_gemm(const QuantizedActivations *inputs, const QuantizedMatrix *weights, const float *biases)
+{
+    float **outputs = (float **)malloc(inputs->rows * sizeof(float *));
+    for (int t = 0; t < inputs->rows; t++)
+    {
+        outputs[t] = (float *)malloc(weights->rows * sizeof(float));
+    }
+
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < weights->rows; i++)
+    {
+        float bias = (biases != NULL) ? biases[i] : 0.0f;
+        for (int t0 = 0; t0 < inputs->rows; t0 += QUANT_TILE_ROWS)
+        {
+            float values[QUANT_TILE_ROWS];
+            int n = (inputs->rows - t0 < QUANT_TILE_ROWS) ? inputs->rows - t0 : QUANT_TILE_ROWS;
+            if (n == QUANT_TILE_ROWS)
+                dot_w8a8(inputs, t0, QUANT_TILE_ROWS, weights, i, values);
+            else
+                dot_w8a8(inputs, t0, n, weights, i, values);
+            for (int t = 0; t < n; t++)
+            {
+                outputs[t0 + t][i] = values[t] + bias;
+            }
+        }
+    }
+    return outputs;
+}
@@ -0,0 +1,74 @@
+#ifndef QUANT_H
+#define QUANT_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#define QUANT_TILE_ROWS 4 // input rows that share each dequantized weight vector in the GEMM
+
+typedef enum
+{
+    QUANT_NONE,
+    QUANT_INT8, // symmetric, fp32 scale per group
+    QUANT_INT4  // asymmetric, fp16 scale and zero point per group
+} QuantType;
+
+// Weight-only quantized [rows][cols] matrix in the [output][input] layout of a linear layer.
+// Every row is split into groups of groupSize inputs with their own scale; a single group
+// spanning the whole row is per-output-channel quantization.
+typedef struct
+{
+    QuantType type;
+    int rows;
+    int cols;
+    int groupSize;
+    int numGroups; // cols / groupSize
+
+    // QUANT_INT8: w[i][j] ~= data[i * cols + j] * scales[i * numGroups + j / groupSize]
+    int8_t *data;  // data[rows * cols]
+    float *scales; // scales[rows * numGroups]
+
+    // QUANT_INT4: w[i][j] ~= (q - zero) * scale with q in [0, 15], two weights per byte
+    // (low nibble first) and the group's scale and zero point stored as fp16
+    uint8_t *packed;       // packed[rows * cols / 2]
+    uint16_t *half_scales; // half_scales[rows * numGroups]
+    uint16_t *half_zeros;  // half_zeros[rows * numGroups]
+
+    int borrowed; // the arrays belong to someone else, e.g. a mapped checkpoint, and are not freed
+} QuantizedMatrix;
+
+// Int8 activations quantized per token on the fly: x[t][j] ~= data[t * cols + j] * scales[t],
+// with values in [-127, 127]
+typedef struct
+{
+    int rows;
+    int cols;
+    int8_t *data;  // data[rows * cols]
+    float *scales; // scales[rows]
+} QuantizedActivations;
+
+// groupSize 0 quantizes per output channel; otherwise it must divide cols (and be even for
+// int4). Returns NULL if it does not.
+QuantizedMatrix *quantize_int8(float **weights, int rows, int cols, int groupSize);
+QuantizedMatrix *quantize_int4(float **weights, int rows, int cols, int groupSize);
+void quantized_matrix_free(QuantizedMatrix *matrix);
+
+// Per-output-channel QUANT_INT8 matrix over existing data[rows * cols] and scales[rows], e.g.
+// tensors quantized offline and mapped from a checkpoint. Nothing is copied.
+QuantizedMatrix *quantized_matrix_view_int8(int8_t *data, float *scales, int rows, int cols);
+
+// output = weights * input + biases, dequantizing in registers and accumulating in fp32.
+// biases may be NULL.
+float *linear_quantized(const float *input, const QuantizedMatrix *weights, const float *biases);
+float **linear_quantized_rows(float **inputs, int numInputs, const QuantizedMatrix *weights, const float *biases);
+
+// output[r] = row start + r of weights * input + biases, for r < count, on the calling thread
+void linear_quantized_slice(const float *input, const QuantizedMatrix *weights, const float *biases, int start, int count, float *output);
+
+// Dynamic activation quantization and the int8 x int8 -> int32 GEMM for QUANT_INT8 weights.
+// The epilogue dequantizes (scales, then biases) to fp32.
+QuantizedActivations *quantize_activations(float **inputs, int numInputs, int cols);
+void quantized_activations_free(QuantizedActivations *activations);
+float **linear_int8_gemm(const QuantizedActivations *inputs, const QuantizedMatrix *weights, const float *biases);
+
+#endif // QUANT_H
@@ -0,0 +1,527 @@
+#include "sampling.h"
+#include <stdio.h>
+#include <string.h>
+#ifdef __SSE__
+#include <immintrin.h>
+#endif
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+enum
+{
+    SELECT_GREEDY,
+    SELECT_GUMBEL,
+    SELECT_CANDIDATES
+};
+
+// xorshift64* draw of a uniform number in [0, 1)
+static double next_uniform(unsigned long long *state)
+{
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return (double)((*state * 0x2545F4914F6CDD1DULL) >> 11) / (double)(1ULL << 53);
+}
+
+// Counter-based uniform in (0, 1) for logit `index` of a step, so that any slice of the
+// vocabulary can draw its noise independently of the others
+static double hashed_uniform(unsigned long long key, int index)
+{
+    unsigned long long z = key + (unsigned long long)(index + 1) * 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    z ^= z >> 31;
+    return ((double)(z >> 11) + 0.5) / (double)(1ULL << 53);
+}
+
+void selector_init(TokenSelector *selector, SamplerConfig *config, int vocabSize, const int *history, int historyLength)
+{
+    selector->penalty = config->repetition_penalty;
+    selector->penalized = NULL;
+    selector->owns_penalized = 0;
+    if (config->repetition_penalty != 1.0f && historyLength > 0)
+    {
+        selector->penalized = (unsigned char *)calloc(vocabSize, 1);
+        selector->owns_penalized = 1;
+        for (int i = 0; i < historyLength; i++)
+        {
+            selector->penalized[history[i]] = 1;
+        }
+    }
+
+    selector->inv_temperature = (config->temperature > 0.0f) ? 1.0f / config->temperature : 1.0f;
+    selector->track_sum = 0;
+    if (config->temperature <= 0.0f)
+    {
+        selector->mode = SELECT_GREEDY;
+        selector->capacity = 1;
+    }
+    else if (config->top_k <= 0 && config->top_p >= 1.0f)
+    {
+        // Pure temperature sampling: argmax of logit / T + Gumbel noise is an exact sample
+        selector->mode = SELECT_GUMBEL;
+        selector->capacity = 1;
+        selector->step_key = (unsigned long long)(next_uniform(&config->seed) * (double)(1ULL << 53));
+    }
+    else
+    {
+        selector->mode = SELECT_CANDIDATES;
+        selector->capacity = (config->top_k > 0 && config->top_k < SAMPLER_MAX_CANDIDATES) ? config->top_k : SAMPLER_MAX_CANDIDATES;
+        selector->track_sum = (config->top_k <= 0);
+    }
+
+    selector->count = 0;
+    selector->values = (float *)malloc(selector->capacity * sizeof(float));
+    selector->indices = (int *)malloc(selector->capacity * sizeof(int));
+    selector->max_logit = -INFINITY;
+    selector->sum_exp = 0.0;
+}
+
+// Keep the k highest logits and the softmax denominator over all of them, for beam search
+void selector_init_top_k(TokenSelector *selector, int k)
+{
+    selector->mode = SELECT_CANDIDATES;
+    selector->capacity = k;
+    selector->count = 0;
+    selector->values = (float *)malloc(k * sizeof(float));
+    selector->indices = (int *)malloc(k * sizeof(int));
+    selector->inv_temperature = 1.0f;
+    selector->penalty = 1.0f;
+    selector->penalized = NULL;
+    selector->owns_penalized = 0;
+    selector->track_sum = 1;
+    selector->max_logit = -INFINITY;
+    selector->sum_exp = 0.0;
+}
+
+// An empty selector with the same settings, for a thread that scans its own slice
+void selector_init_like(TokenSelector *selector, const TokenSelector *other)
+{
+    *selector = *other;
+    selector->owns_penalized = 0;
+    selector->count = 0;
+    selector->values = (float *)malloc(selector->capacity * sizeof(float));
+    selector->indices = (int *)malloc(selector->capacity * sizeof(int));
+    selector->max_logit = -INFINITY;
+    selector->sum_exp = 0.0;
+}
+
+void selector_free(TokenSelector *selector)
+{
+    free(selector->values);
+    free(selector->indices);
+    if (selector->owns_penalized)
+    {
+        free(selector->penalized);
+    }
+}
+
+// Restore the min-heap property downwards from position i
+static void sift_down(TokenSelector *selector, int i)
+{
+    float *values = selector->values;
+    int *indices = selector->indices;
+    for (;;)
+    {
+        int smallest = i;
+        int left = 2 * i + 1;
+        int right = left + 1;
+        if (left < selector->count && values[left] < values[smallest])
+            smallest = left;
+        if (right < selector->count && values[right] < values[smallest])
+            smallest = right;
+        if (smallest == i)
+            return;
+
+        float v = values[i];
+        values[i] = values[smallest];
+        values[smallest] = v;
+        int idx = indices[i];
+        indices[i] = indices[smallest];
+        indices[smallest] = idx;
+        i = smallest;
+    }
+}
+
+// Offer one candidate score; ties keep the lower token id
+static void heap_offer(TokenSelector *selector, float value, int index)
+{
+    float *values = selector->values;
+    int *indices = selector->indices;
+
+    if (selector->count < selector->capacity)
+    {
+        // Sift up
+        int i = selector->count++;
+        while (i > 0)
+        {
+            int parent = (i - 1) / 2;
+            if (values[parent] <= value)
+                break;
+            values[i] = values[parent];
+            indices[i] = indices[parent];
+            i = parent;
+        }
+        values[i] = value;
+        indices[i] = index;
+        return;
+    }
+
+    if (value < values[0] || (value == values[0] && index > indices[0]))
+        return;
+    values[0] = value;
+    indices[0] = index;
+    sift_down(selector, 0);
+}
+
+static inline float penalize(const TokenSelector *selector, float logit, int index)
+{
+    if (selector->penalized != NULL && selector->penalized[index])
+    {
+        // CTRL-style penalty: always moves the logit down
+        return (logit > 0.0f) ? logit / selector->penalty : logit * selector->penalty;
+    }
+    return logit;
+}
+
+// Feed logits[0 .. count) belonging to tokens [start, start + count)
+void selector_push(TokenSelector *selector, const float *logits, int start, int count)
+{
+    if (selector->track_sum)
+    {
+        // Online softmax denominator over every logit, used by top-p without top-k
+        float chunk_max = -INFINITY;
+        for (int i = 0; i < count; i++)
+        {
+            float l = penalize(selector, logits[i], start + i);
+            if (l > chunk_max)
+                chunk_max = l;
+        }
+        if (chunk_max > selector->max_logit)
+        {
+            selector->sum_exp *= exp((selector->max_logit - chunk_max) * selector->inv_temperature);
+            selector->max_logit = chunk_max;
+        }
+        for (int i = 0; i < count; i++)
+        {
+            float l = penalize(selector, logits[i], start + i);
+            selector->sum_exp += exp((l - selector->max_logit) * selector->inv_temperature);
+        }
+    }
+
+    if (selector->mode == SELECT_GUMBEL)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            float l = penalize(selector, logits[i], start + i);
+            double g = -log(-log(hashed_uniform(selector->step_key, start + i)));
+            heap_offer(selector, (float)(l * selector->inv_temperature + g), start + i);
+        }
+        return;
+    }
+
+    int i = 0;
+    while (i < count && selector->count < selector->capacity)
+    {
+        heap_offer(selector, penalize(selector, logits[i], start + i), start + i);
+        i++;
+    }
+
+    // Once the heap is full only logits above its minimum can enter. The penalty only lowers
+    // a logit, so the raw value can be filtered against the threshold four at a time.
+#ifdef __SSE__
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 threshold = _mm_set1_ps(selector->values[0]);
+        int mask = _mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(&logits[i]), threshold));
+        while (mask)
+        {
+            int lane = __builtin_ctz(mask);
+            mask &= mask - 1;
+            heap_offer(selector, penalize(selector, logits[i + lane], start + i + lane), start + i + lane);
+        }
+    }
+#endif
+    for (; i < count; i++)
+    {
+        if (logits[i] >= selector->values[0])
+        {
+            heap_offer(selector, penalize(selector, logits[i], start + i), start + i);
+        }
+    }
+}
+
+// Fold the candidates and softmax statistics of another selector (e.g. another thread's slice)
+void selector_merge(TokenSelector *selector, const TokenSelector *other)
+{
+    for (int i = 0; i < other->count; i++)
+    {
+        heap_offer(selector, other->values[i], other->indices[i]);
+    }
+
+    if (selector->track_sum && other->max_logit > -INFINITY)
+    {
+        if (other->max_logit > selector->max_logit)
+        {
+            selector->sum_exp = selector->sum_exp * exp((selector->max_logit - other->max_logit) * selector->inv_temperature) + other->sum_exp;
+            selector->max_logit = other->max_logit;
+        }
+        else
+        {
+            selector->sum_exp += other->sum_exp * exp((other->max_logit - selector->max_logit) * selector->inv_temperature);
+        }
+    }
+}
+
+// Sort candidates by decreasing score (heap sort in place: the min goes to the back)
+static void sort_candidates(TokenSelector *selector)
+{
+    int n = selector->count;
+    for (int end = n - 1; end > 0; end--)
+    {
+        float v = selector->values[0];
+        int idx = selector->indices[0];
+        selector->values[0] = selector->values[end];
+        selector->indices[0] = selector->indices[end];
+        selector->values[end] = v;
+        selector->indices[end] = idx;
+        selector->count = end;
+        sift_down(selector, 0);
+    }
+    selector->count = n;
+}
+
+// Write the candidates of a selector_init_top_k selector from most to least likely, with their
+// log-probabilities over every pushed logit. Returns the number of candidates.
+int selector_top_k(TokenSelector *selector, int *tokens, float *logprobs)
+{
+    sort_candidates(selector);
+    float log_sum = selector->max_logit + (float)log(selector->sum_exp);
+    for (int i = 0; i < selector->count; i++)
+    {
+        tokens[i] = selector->indices[i];
+        logprobs[i] = selector->values[i] - log_sum;
+    }
+    return selector->count;
+}
+
+// Pick the token from everything pushed so far
+int selector_sample(TokenSelector *selector, SamplerConfig *config)
+{
+    if (selector->count == 0)
+        return -1;
+
+    if (selector->mode != SELECT_CANDIDATES)
+    {
+        return selector->indices[0];
+    }
+
+    int n = selector->count;
+    sort_candidates(selector);
+
+    // Unnormalised probabilities relative to the best candidate
+    float *values = selector->values;
+    float best = values[0];
+    double kept_sum = 0.0;
+    for (int i = 0; i < n; i++)
+    {
+        values[i] = (float)exp((values[i] - best) * selector->inv_temperature);
+        kept_sum += values[i];
+    }
+
+    // Top-p over the full distribution when there is no top-k, otherwise over the top-k set.
+    // Without top-k the nucleus is truncated at SAMPLER_MAX_CANDIDATES tokens.
+    double total = kept_sum;
+    if (selector->track_sum)
+    {
+        total = selector->sum_exp * exp((selector->max_logit - best) * selector->inv_temperature);
+    }
+    int kept = n;
+    if (config->top_p < 1.0f)
+    {
+        double cumulative = 0.0;
+        for (int i = 0; i < n; i++)
+        {
+            cumulative += values[i];
+            if (cumulative >= config->top_p * total)
+            {
+                kept = i + 1;
+                break;
+            }
+        }
+        kept_sum = 0.0;
+        for (int i = 0; i < kept; i++)
+        {
+            kept_sum += values[i];
+        }
+    }
+
+    double r = next_uniform(&config->seed) * kept_sum;
+    double cumulative = 0.0;
+    for (int i = 0; i < kept; i++)
+    {
+        cumulative += values[i];
+        if (cumulative > r)
+        {
+            return selector->indices[i];
+        }
+    }
+    return selector->indices[0];
+}
+
+// Sample the next token from a full logits vector in a single pass
+int sample_logits(const float *logits, int vocabSize, SamplerConfig *config, const int *history, int historyLength)
+{
+    TokenSelector selector;
+    selector_init(&selector, config, vocabSize, history, historyLength);
+    selector_push(&selector, logits, 0, vocabSize);
+    int token = selector_sample(&selector, config);
+    selector_free(&selector);
+    return token;
+}
+
+// Dot product of two float vectors
+static float dot_product(const float *a, const float *b, int n)
+{
+    int i = 0;
+    float sum = 0.0f;
+#if defined(__AVX2__) && defined(__FMA__)
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    for (; i + 16 <= n; i += 16)
+    {
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(&a[i]), _mm256_loadu_ps(&b[i]), acc0);
+        acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(&a[i + 8]), _mm256_loadu_ps(&b[i + 8]), acc1);
+    }
+    __m256 acc = _mm256_add_ps(acc0, acc1);
+    __m128 lanes = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+    lanes = _mm_hadd_ps(lanes, lanes);
+    lanes = _mm_hadd_ps(lanes, lanes);
+    sum = _mm_cvtss_f32(lanes);
+#elif defined(__SSE__)
+    __m128 acc = _mm_setzero_ps();
+    for (; i + 4 <= n; i += 4)
+    {
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(&a[i]), _mm_loadu_ps(&b[i])));
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, acc);
+    sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#endif
+    for (; i < n; i++)
+    {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+// Producer of rows [start, start + count) of weights * input + biases
+typedef void (*SliceFunction)(const float *input, const void *weights, const float *biases, int start, int count, float *output);
+
+typedef struct
+{
+    float **rows; // rows[outputSize][inputSize]
+    int inputSize;
+} DenseWeights;
+
+static void dense_slice(const float *input, const void *weights, const float *biases, int start, int count, float *output)
+{
+    const DenseWeights *dense = (const DenseWeights *)weights;
+    for (int r = 0; r < count; r++)
+    {
+        output[r] = dot_product(input, dense->rows[start + r], dense->inputSize) + (biases != NULL ? biases[start + r] : 0.0f);
+    }
+}
+
+static void quantized_slice(const float *input, const void *weights, const float *biases, int start, int count, float *output)
+{
+    linear_quantized_slice(input, (const QuantizedMatrix *)weights, biases, start, count, output);
+}
+
+static void half_slice(const float *input, const void *weights, const float *biases, int start, int count, float *output)
+{
+    linear_half_slice(input, (const HalfMatrix *)weights, biases, start, count, output);
+}
+
+// Fused logits projection and token selection: outputs[t] = weights * inputs[t] + biases is
+// computed in slices of SELECT_CHUNK_ROWS rows, spread over the threads, and every slice is
+// pushed into that thread's own selector for input t while it is still in L1. The per-thread
+// candidates are merged at the end, so the full logits vectors are never written to memory.
+// With several inputs (a batch of sequences or beams) each group of SELECT_BATCH_ROWS weight
+// rows is scored against all of them while it is cached, so the weights are streamed once.
+static void select_rows(float **inputs, int numInputs, int outputSize, SliceFunction slice_fn, const void *weights,
+                        const float *biases, TokenSelector *selectors)
+{
+    int num_chunks = (outputSize + SELECT_CHUNK_ROWS - 1) / SELECT_CHUNK_ROWS;
+
+#pragma omp parallel
+    {
+        TokenSelector *local = (TokenSelector *)malloc(numInputs * sizeof(TokenSelector));
+        for (int t = 0; t < numInputs; t++)
+        {
+            selector_init_like(&local[t], &selectors[t]);
+        }
+        float slice[SELECT_BATCH_ROWS];
+
+#pragma omp for schedule(static)
+        for (int c = 0; c < num_chunks; c++)
+        {
+            int end = (c + 1) * SELECT_CHUNK_ROWS < outputSize ? (c + 1) * SELECT_CHUNK_ROWS : outputSize;
+            for (int start = c * SELECT_CHUNK_ROWS; start < end; start += SELECT_BATCH_ROWS)
+            {
+                int rows = (end - start < SELECT_BATCH_ROWS) ? end - start : SELECT_BATCH_ROWS;
+                for (int t = 0; t < numInputs; t++)
+                {
+                    slice_fn(inputs[t], weights, biases, start, rows, slice);
+                    selector_push(&local[t], slice, start, rows);
+                }
+            }
+        }
+
+#pragma omp critical
+        for (int t = 0; t < numInputs; t++)
+        {
+            selector_merge(&selectors[t], &local[t]);
+        }
+
+        for (int t = 0; t < numInputs; t++)
+        {
+            selector_free(&local[t]);
+        }
+        free(local);
+    }
+}
+
+void linear_select(const float *input, float **weights, const float *biases, int inputSize, int outputSize, TokenSelector *selector)
+{
+    linear_select_rows((float **)&input, 1, weights, biases, inputSize, outputSize, selector);
+}
+
+void linear_select_rows(float **inputs, int numInputs, float **weights, const float *biases, int inputSize, int outputSize, TokenSelector *selectors)
+{
+    DenseWeights dense = {weights, inputSize};
+    select_rows(inputs, numInputs, outputSize, dense_slice, &dense, biases, selectors);
+}
+
+// linear_select over quantized weights: each slice is produced by the quantized GEMV
+void linear_select_quantized(const float *input, const QuantizedMatrix *weights, const float *biases, TokenSelector *selector)
+{
+    select_rows((float **)&input, 1, weights->rows, quantized_slice, weights, biases, selector);
+}
+
+void linear_select_quantized_rows(float **inputs, int numInputs, const QuantizedMatrix *weights, const float *biases, TokenSelector *selectors)
+{
+    select_rows(inputs, numInputs, weights->rows, quantized_slice, weights, biases, selectors);
+}
+
+// linear_select over 16-bit weights: each slice is produced by the half-precision GEMV
+void linear_select_half(const float *input, const HalfMatrix *weights, const float *biases, TokenSelector *selector)
+{
+    select_rows((float **)&input, 1, weights->rows, half_slice, weights, biases, selector);
+}
+
+void linear_select_half_rows(float **inputs, int numInputs, const HalfMatrix *weights, const float *biases, TokenSelector *selectors)
+{
+    select_rows(inputs, numInputs, weights->rows, half_slice, weights, biases, selectors);
+}
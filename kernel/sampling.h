@@ -0,0 +1,61 @@
+#ifndef SAMPLING_H
+#define SAMPLING_H
+
+#include <math.h>
+#include <float.h>
+#include <stdlib.h>
+#include "quant.h"
+#include "half.h"
+
+#define SAMPLER_MAX_CANDIDATES 256 // Candidates kept for top-k / top-p sampling
+#define SELECT_CHUNK_ROWS 256      // Logits computed per slice by the fused projection
+#define SELECT_BATCH_ROWS 64       // Weight rows scored against every input of a batch before moving on
+
+typedef struct
+{
+    float temperature;        // 0 selects greedy decoding
+    int top_k;                // keep the k most likely tokens, 0 to disable
+    float top_p;              // keep the smallest set with cumulative probability >= top_p, 1 to disable
+    float repetition_penalty; // > 1 discourages tokens already in the history, 1 to disable
+    unsigned long long seed;  // random number generator state, advanced on every draw
+} SamplerConfig;
+
+// Streaming token selection over the logits. Consecutive (or per-thread) slices of the
+// logits are pushed as they are produced, so the full vocabulary never needs a second pass.
+typedef struct
+{
+    int mode;          // greedy, Gumbel-max temperature sampling, or top-k / top-p candidates
+    int capacity;      // number of candidates kept
+    int count;
+    float *values;     // min-heap of the best candidate scores
+    int *indices;
+    float inv_temperature;
+    float penalty;
+    unsigned char *penalized;   // penalized[vocabSize] flags built from the history, or NULL
+    int owns_penalized;
+    unsigned long long step_key; // per-step key of the Gumbel noise
+    int track_sum;     // whether the full softmax denominator is needed (top-p without top-k)
+    float max_logit;   // running max and sum of exp((logit - max) / T) over every pushed logit
+    double sum_exp;
+} TokenSelector;
+
+void selector_init(TokenSelector *selector, SamplerConfig *config, int vocabSize, const int *history, int historyLength);
+void selector_init_like(TokenSelector *selector, const TokenSelector *other);
+void selector_init_top_k(TokenSelector *selector, int k);
+void selector_free(TokenSelector *selector);
+void selector_push(TokenSelector *selector, const float *logits, int start, int count);
+void selector_merge(TokenSelector *selector, const TokenSelector *other);
+int selector_sample(TokenSelector *selector, SamplerConfig *config);
+int selector_top_k(TokenSelector *selector, int *tokens, float *logprobs);
+
+int sample_logits(const float *logits, int vocabSize, SamplerConfig *config, const int *history, int historyLength);
+void linear_select(const float *input, float **weights, const float *biases, int inputSize, int outputSize, TokenSelector *selector);
+void linear_select_quantized(const float *input, const QuantizedMatrix *weights, const float *biases, TokenSelector *selector);
+void linear_select_half(const float *input, const HalfMatrix *weights, const float *biases, TokenSelector *selector);
+
+// Batched variants: selectors[t] picks from weights * inputs[t] + biases, for t < numInputs
+void linear_select_rows(float **inputs, int numInputs, float **weights, const float *biases, int inputSize, int outputSize, TokenSelector *selectors);
+void linear_select_quantized_rows(float **inputs, int numInputs, const QuantizedMatrix *weights, const float *biases, TokenSelector *selectors);
+void linear_select_half_rows(float **inputs, int numInputs, const HalfMatrix *weights, const float *biases, TokenSelector *selectors);
+
+#endif // SAMPLING_H
@@ -5,6 +5,15 @@
 #include "test_linear.h"
 #include "test_matrix_ops.h"
 #include "test_attention.h"
+#include "test_kv_cache.h"
+#include "test_sampling.h"
+#include "test_checkpoint.h"
+#include "test_convert.h"
+#include "test_philox.h"
+#include "test_quant.h"
+#include "test_half.h"
+#include "test_spsc_queue.h"
+#include "test_gpt2.h"
 #include <stdio.h>
 
 const int SMALL_MAT = 8;
@@ -72,6 +81,82 @@ int main(void)
     RUN_TEST(test_matmul_with_negatives);
 
     RUN_TEST(test_scaled_dot_product_attention);
+    RUN_TEST(test_flash_attention);
+    RUN_TEST(test_flash_attention_matches_reference);
+    RUN_TEST(test_flash_attention_causal);
+    RUN_TEST(test_multi_head_attention);
+    RUN_TEST(test_flash_attention_incremental);
+    RUN_TEST(test_paged_attention);
+    RUN_TEST(test_paged_attention_int8);
+    RUN_TEST(test_paged_attention_half);
+
+    // Test kv_cache
+    RUN_TEST(test_kv_cache_append_commit);
+    RUN_TEST(test_kv_cache_overflow);
+    RUN_TEST(test_kv_cache_int8);
+    RUN_TEST(test_kv_cache_half);
+    RUN_TEST(test_kv_cache_truncate);
+    RUN_TEST(test_kv_cache_fork_copy_on_write);
+    RUN_TEST(test_kv_prefix_cache_reuse);
+    RUN_TEST(test_kv_prefix_cache_eviction);
+
+    // Test sampling
+    RUN_TEST(test_sample_greedy);
+    RUN_TEST(test_sample_top_k);
+    RUN_TEST(test_sample_top_p);
+    RUN_TEST(test_sample_repetition_penalty);
+    RUN_TEST(test_selector_merge_slices);
+    RUN_TEST(test_selector_top_k);
+    RUN_TEST(test_linear_select);
+    RUN_TEST(test_linear_select_rows);
+
+    // Test checkpoint
+    RUN_TEST(test_checkpoint_roundtrip);
+    RUN_TEST(test_checkpoint_invalid_file);
+    RUN_TEST(test_checkpoint_malformed_tensor);
+
+    // Test convert
+    RUN_TEST(test_load_npy);
+    RUN_TEST(test_load_hdf5_dataset);
+    RUN_TEST(test_convert_transpose);
+    RUN_TEST(test_convert_prune);
+    RUN_TEST(test_convert_quantize_int8);
+    RUN_TEST(test_convert_ops_after_quantize);
+    RUN_TEST(test_write_manifest_escapes);
+
+    // Test philox
+    RUN_TEST(test_philox_known_answers);
+    RUN_TEST(test_philox_fill_offsets);
+
+    // Test quant
+    RUN_TEST(test_quantize_int8);
+    RUN_TEST(test_linear_int8);
+    RUN_TEST(test_quantized_matrix_view_int8);
+    RUN_TEST(test_linear_quantized_rows);
+    RUN_TEST(test_quantize_int4);
+    RUN_TEST(test_linear_int4);
+    RUN_TEST(test_linear_select_quantized);
+    RUN_TEST(test_quantize_activations);
+    RUN_TEST(test_linear_int8_gemm);
+
+    // Test half
+    RUN_TEST(test_half_conversions);
+    RUN_TEST(test_convert_half_roundtrip);
+    RUN_TEST(test_linear_half);
+    RUN_TEST(test_linear_half_rows);
+    RUN_TEST(test_matmul_half);
+    RUN_TEST(test_embedding_half);
+
+    // Test spsc_queue
+    RUN_TEST(test_spsc_queue_order);
+    RUN_TEST(test_spsc_queue_threads);
+
+    // Test gpt2
+    RUN_TEST(test_gpt2_chunked_prefill);
+    RUN_TEST(test_gpt2_speculative_full_draft);
+    RUN_TEST(test_gpt2_beam_search_releases_blocks);
+    RUN_TEST(test_gpt2_forked_cache_isolation);
+    RUN_TEST(test_gpt2_mixed_int8_checkpoint);
 
     return UNITY_END();
 }
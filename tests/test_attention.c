@@ -68,4 +68,385 @@ void test_scaled_dot_product_attention(void)
     free_matrix(K, seqLength);
     free_matrix(V, seqLength);
     free(output);
-}
\ No newline at end of file
+}
+
+void test_flash_attention(void)
+{
+    // Same input as test_scaled_dot_product_attention
+    float Q_data[2][3] = {{1, 0, 1}, {0, 2, 1}};
+    float K_data[2][3] = {{1, 0, 2}, {0, 1, 2}};
+    float V_data[2][3] = {{0, 1, 0}, {1, 0, 1}};
+    int seqLength = 2;
+    int depth = 3;
+
+    float **Q = allocate_matrix(seqLength, depth);
+    float **K = allocate_matrix(seqLength, depth);
+    float **V = allocate_matrix(seqLength, depth);
+    for (int i = 0; i < seqLength; i++)
+    {
+        for (int j = 0; j < depth; j++)
+        {
+            Q[i][j] = Q_data[i][j];
+            K[i][j] = K_data[i][j];
+            V[i][j] = V_data[i][j];
+        }
+    }
+
+    double expected_output[2][3] = {{0.3595, 0.6405, 0.3595}, {0.7604, 0.2396, 0.7604}};
+
+    float **output = flash_attention(Q, K, V, seqLength, depth, 0);
+
+    for (int i = 0; i < seqLength; i++)
+    {
+        for (int j = 0; j < depth; j++)
+        {
+            UNITY_TEST_ASSERT_FLOAT_WITHIN(0.0001, expected_output[i][j], output[i][j], __LINE__, "Flash attention output mismatch");
+        }
+    }
+
+    free_matrix(Q, seqLength);
+    free_matrix(K, seqLength);
+    free_matrix(V, seqLength);
+    free_matrix(output, seqLength);
+}
+
+void test_flash_attention_matches_reference(void)
+{
+    // Sequence length spans several partial query and key/value tiles
+    int seqLength = 2 * ATTENTION_BLOCK_KV + 7;
+    int depth = 16;
+
+    float **Q = allocate_matrix(seqLength, depth);
+    float **K = allocate_matrix(seqLength, depth);
+    float **V = allocate_matrix(seqLength, depth);
+    for (int i = 0; i < seqLength; i++)
+    {
+        for (int j = 0; j < depth; j++)
+        {
+            Q[i][j] = (float)rand() / RAND_MAX * 2.0f - 1.0f;
+            K[i][j] = (float)rand() / RAND_MAX * 2.0f - 1.0f;
+            V[i][j] = (float)rand() / RAND_MAX * 2.0f - 1.0f;
+        }
+    }
+
+    float **expected = scaled_dot_product_attention(Q, K, V, seqLength, depth);
+    float **output = flash_attention(Q, K, V, seqLength, depth, 0);
+
+    for (int i = 0; i < seqLength; i++)
+    {
+        for (int j = 0; j < depth; j++)
+        {
+            UNITY_TEST_ASSERT_FLOAT_WITHIN(1e-5, expected[i][j], output[i][j], __LINE__, "Flash attention differs from reference");
+        }
+    }
+
+    free_matrix(Q, seqLength);
+    free_matrix(K, seqLength);
+    free_matrix(V, seqLength);
+    free_matrix(expected, seqLength);
+    free_matrix(output, seqLength);
+}
+
+void test_flash_attention_causal(void)
+{
+    // Spans the diagonal tile of several query blocks
+    int seqLength = 2 * ATTENTION_BLOCK_KV + 7;
+    int depth = 16;
+
+    float **Q = allocate_matrix(seqLength, depth);
+    float **K = allocate_matrix(seqLength, depth);
+    float **V = allocate_matrix(seqLength, depth);
+    for (int i = 0; i < seqLength; i++)
+    {
+        for (int j = 0; j < depth; j++)
+        {
+            Q[i][j] = (float)rand() / RAND_MAX * 2.0f - 1.0f;
+            K[i][j] = (float)rand() / RAND_MAX * 2.0f - 1.0f;
+            V[i][j] = (float)rand() / RAND_MAX * 2.0f - 1.0f;
+        }
+    }
+
+    float **output = flash_attention(Q, K, V, seqLength, depth, 1);
+
+    // Reference: query i attends over keys 0..i only
+    for (int i = 0; i < seqLength; i++)
+    {
+        float scores[seqLength];
+        for (int j = 0; j <= i; j++)
+        {
+            scores[j] = 0.0f;
+            for (int d = 0; d < depth; d++)
+            {
+                scores[j] += Q[i][d] * K[j][d];
+            }
+            scores[j] /= sqrtf((float)depth);
+        }
+        float *weights = softmax(scores, i + 1);
+        for (int d = 0; d < depth; d++)
+        {
+            float expected = 0.0f;
+            for (int j = 0; j <= i; j++)
+            {
+                expected += weights[j] * V[j][d];
+            }
+            UNITY_TEST_ASSERT_FLOAT_WITHIN(1e-5, expected, output[i][d], __LINE__, "Causal flash attention mismatch");
+        }
+        free(weights);
+    }
+
+    free_matrix(Q, seqLength);
+    free_matrix(K, seqLength);
+    free_matrix(V, seqLength);
+    free_matrix(output, seqLength);
+}
+
+void test_multi_head_attention(void)
+{
+    int seqLength = 37;
+    int numHeads = 4;
+    int headDim = 8;
+    int width = numHeads * headDim;
+
+    float **Q = allocate_matrix(seqLength, width);
+    float **K = allocate_matrix(seqLength, width);
+    float **V = allocate_matrix(seqLength, width);
+    float **expected = allocate_matrix(seqLength, width);
+    float **output = allocate_matrix(seqLength, width);
+    for (int i = 0; i < seqLength; i++)
+    {
+        for (int j = 0; j < width; j++)
+        {
+            Q[i][j] = (float)rand() / RAND_MAX * 2.0f - 1.0f;
+            K[i][j] = (float)rand() / RAND_MAX * 2.0f - 1.0f;
+            V[i][j] = (float)rand() / RAND_MAX * 2.0f - 1.0f;
+        }
+    }
+
+    // Reference: each head on its own
+    for (int h = 0; h < numHeads; h++)
+    {
+        flash_attention_head(Q, K, V, expected, h * headDim, seqLength, seqLength, headDim, 1);
+    }
+    multi_head_attention(Q, K, V, output, seqLength, seqLength, numHeads, headDim, 1);
+
+    for (int i = 0; i < seqLength; i++)
+    {
+        for (int j = 0; j < width; j++)
+        {
+            UNITY_TEST_ASSERT_FLOAT_WITHIN(1e-6, expected[i][j], output[i][j], __LINE__, "Multi-head attention mismatch");
+        }
+    }
+
+    free_matrix(Q, seqLength);
+    free_matrix(K, seqLength);
+    free_matrix(V, seqLength);
+    free_matrix(expected, seqLength);
+    free_matrix(output, seqLength);
+}
+
+void test_flash_attention_incremental(void)
+{
+    // Attending the last queries over a longer K/V (as when decoding from a KV cache)
+    // must give the same rows as full causal self-attention
+    int seqLength = ATTENTION_BLOCK_KV + 9;
+    int depth = 8;
+    int qLength = 5;
+
+    float **Q = allocate_matrix(seqLength, depth);
+    float **K = allocate_matrix(seqLength, depth);
+    float **V = allocate_matrix(seqLength, depth);
+    float **output = allocate_matrix(qLength, depth);
+    for (int i = 0; i < seqLength; i++)
+    {
+        for (int j = 0; j < depth; j++)
+        {
+            Q[i][j] = (float)rand() / RAND_MAX * 2.0f - 1.0f;
+            K[i][j] = (float)rand() / RAND_MAX * 2.0f - 1.0f;
+            V[i][j] = (float)rand() / RAND_MAX * 2.0f - 1.0f;
+        }
+    }
+
+    float **expected = flash_attention(Q, K, V, seqLength, depth, 1);
+    flash_attention_head(&Q[seqLength - qLength], K, V, output, 0, qLength, seqLength, depth, 1);
+
+    for (int i = 0; i < qLength; i++)
+    {
+        for (int j = 0; j < depth; j++)
+        {
+            UNITY_TEST_ASSERT_FLOAT_WITHIN(1e-6, expected[seqLength - qLength + i][j], output[i][j], __LINE__, "Incremental attention mismatch");
+        }
+    }
+
+    free_matrix(Q, seqLength);
+    free_matrix(K, seqLength);
+    free_matrix(V, seqLength);
+    free_matrix(expected, seqLength);
+    free_matrix(output, qLength);
+}
+
+void test_paged_attention(void)
+{
+    // Paged attention over a cache with blocks scattered through the pool must match the
+    // dense kernel over the same rows
+    int numHeads = 2;
+    int headDim = 8;
+    int width = numHeads * headDim;
+    int pastLength = ATTENTION_BLOCK_KV + 3;
+    int qLength = 4;
+    int kvLength = pastLength + qLength;
+
+    float **Q = allocate_matrix(qLength, width);
+    float **K = allocate_matrix(kvLength, width);
+    float **V = allocate_matrix(kvLength, width);
+    float **expected = allocate_matrix(qLength, width);
+    float **output = allocate_matrix(qLength, width);
+    for (int i = 0; i < kvLength; i++)
+    {
+        for (int j = 0; j < width; j++)
+        {
+            K[i][j] = (float)rand() / RAND_MAX * 2.0f - 1.0f;
+            V[i][j] = (float)rand() / RAND_MAX * 2.0f - 1.0f;
+            if (i < qLength)
+            {
+                Q[i][j] = (float)rand() / RAND_MAX * 2.0f - 1.0f;
+            }
+        }
+    }
+
+    KVBlockPool *pool = kv_pool_create(1, 32, 5, numHeads, headDim, KV_FLOAT32);
+    KVCache *other = kv_cache_create(pool);
+    KVCache *cache = kv_cache_create(pool);
+
+    // Interleave with another sequence so the block ids are not consecutive
+    for (int i = 0; i < pastLength; i += 5)
+    {
+        int n = (pastLength - i < 5) ? pastLength - i : 5;
+        kv_cache_append(other, 0, &K[i], &V[i], 5);
+        kv_cache_commit(other, 5);
+        kv_cache_append(cache, 0, &K[i], &V[i], n);
+        kv_cache_commit(cache, n);
+    }
+    kv_cache_append(cache, 0, &K[pastLength], &V[pastLength], qLength);
+
+    multi_head_attention(Q, K, V, expected, qLength, kvLength, numHeads, headDim, 1);
+    paged_attention(Q, cache, 0, output, qLength, kvLength, numHeads, headDim, 1);
+
+    for (int i = 0; i < qLength; i++)
+    {
+        for (int j = 0; j < width; j++)
+        {
+            UNITY_TEST_ASSERT_FLOAT_WITHIN(1e-6, expected[i][j], output[i][j], __LINE__, "Paged attention mismatch");
+        }
+    }
+
+    kv_cache_free(cache);
+    kv_cache_free(other);
+    kv_pool_free(pool);
+    free_matrix(Q, qLength);
+    free_matrix(K, kvLength);
+    free_matrix(V, kvLength);
+    free_matrix(expected, qLength);
+    free_matrix(output, qLength);
+}
+
+void test_paged_attention_int8(void)
+{
+    int numHeads = 2;
+    int headDim = 16;
+    int width = numHeads * headDim;
+    int kvLength = ATTENTION_BLOCK_KV + 11;
+    int qLength = 3;
+
+    float **Q = allocate_matrix(qLength, width);
+    float **K = allocate_matrix(kvLength, width);
+    float **V = allocate_matrix(kvLength, width);
+    float **expected = allocate_matrix(qLength, width);
+    float **output = allocate_matrix(qLength, width);
+    for (int i = 0; i < kvLength; i++)
+    {
+        for (int j = 0; j < width; j++)
+        {
+            K[i][j] = (float)rand() / RAND_MAX * 2.0f - 1.0f;
+            V[i][j] = (float)rand() / RAND_MAX * 2.0f - 1.0f;
+            if (i < qLength)
+            {
+                Q[i][j] = (float)rand() / RAND_MAX * 2.0f - 1.0f;
+            }
+        }
+    }
+
+    KVBlockPool *pool = kv_pool_create(1, 8, KV_BLOCK_TOKENS, numHeads, headDim, KV_INT8);
+    KVCache *cache = kv_cache_create(pool);
+    kv_cache_append(cache, 0, K, V, kvLength);
+
+    multi_head_attention(Q, K, V, expected, qLength, kvLength, numHeads, headDim, 1);
+    paged_attention(Q, cache, 0, output, qLength, kvLength, numHeads, headDim, 1);
+
+    // Quantization error of 1/254 of the row range per element
+    for (int i = 0; i < qLength; i++)
+    {
+        for (int j = 0; j < width; j++)
+        {
+            UNITY_TEST_ASSERT_FLOAT_WITHIN(1e-2, expected[i][j], output[i][j], __LINE__, "Int8 paged attention mismatch");
+        }
+    }
+
+    kv_cache_free(cache);
+    kv_pool_free(pool);
+    free_matrix(Q, qLength);
+    free_matrix(K, kvLength);
+    free_matrix(V, kvLength);
+    free_matrix(expected, qLength);
+    free_matrix(output, qLength);
+}
+
+void test_paged_attention_half(void)
+{
+    int numHeads = 2;
+    int headDim = 16;
+    int width = numHeads * headDim;
+    int kvLength = ATTENTION_BLOCK_KV + 11;
+    int qLength = 3;
+
+    float **Q = allocate_matrix(qLength, width);
+    float **K = allocate_matrix(kvLength, width);
+    float **V = allocate_matrix(kvLength, width);
+    float **expected = allocate_matrix(qLength, width);
+    float **output = allocate_matrix(qLength, width);
+    for (int i = 0; i < kvLength; i++)
+    {
+        for (int j = 0; j < width; j++)
+        {
+            K[i][j] = (float)rand() / RAND_MAX * 2.0f - 1.0f;
+            V[i][j] = (float)rand() / RAND_MAX * 2.0f - 1.0f;
+            if (i < qLength)
+            {
+                Q[i][j] = (float)rand() / RAND_MAX * 2.0f - 1.0f;
+            }
+        }
+    }
+
+    KVBlockPool *pool = kv_pool_create(1, 8, KV_BLOCK_TOKENS, numHeads, headDim, KV_BFLOAT16);
+    KVCache *cache = kv_cache_create(pool);
+    kv_cache_append(cache, 0, K, V, kvLength);
+
+    multi_head_attention(Q, K, V, expected, qLength, kvLength, numHeads, headDim, 1);
+    paged_attention(Q, cache, 0, output, qLength, kvLength, numHeads, headDim, 1);
+
+    // bf16 keeps 8 significant bits of every element
+    for (int i = 0; i < qLength; i++)
+    {
+        for (int j = 0; j < width; j++)
+        {
+            UNITY_TEST_ASSERT_FLOAT_WITHIN(1e-2, expected[i][j], output[i][j], __LINE__, "bf16 paged attention mismatch");
+        }
+    }
+
+    kv_cache_free(cache);
+    kv_pool_free(pool);
+    free_matrix(Q, qLength);
+    free_matrix(K, kvLength);
+    free_matrix(V, kvLength);
+    free_matrix(expected, qLength);
+    free_matrix(output, qLength);
+}
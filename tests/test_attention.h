@@ -2,5 +2,13 @@
 #define TEST_ATTENTION_H
 
 void test_scaled_dot_product_attention(void);
+void test_flash_attention(void);
+void test_flash_attention_matches_reference(void);
+void test_flash_attention_causal(void);
+void test_multi_head_attention(void);
+void test_flash_attention_incremental(void);
+void test_paged_attention(void);
+void test_paged_attention_int8(void);
+void test_paged_attention_half(void);
 
 #endif // TEST_ATTENTION_H
\ No newline at end of file
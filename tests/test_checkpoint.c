@@ -0,0 +1,127 @@
+#include "unity/unity.h"
+#include "../utils/checkpoint.h"
+#include "test_checkpoint.h"
+#include <string.h>
+
+#define TEST_CHECKPOINT_PATH "/tmp/test_checkpoint.bin"
+
+void test_checkpoint_roundtrip(void)
+{
+    float bias[3] = {0.5f, -1.0f, 2.0f};
+    float row0[5] = {1, 2, 3, 4, 5};
+    float row1[5] = {6, 7, 8, 9, 10};
+    float *rows[2] = {row0, row1};
+    int8_t packed[7] = {-128, -1, 0, 1, 2, 3, 127};
+    int biasShape[1] = {3};
+    int packedShape[1] = {7};
+
+    CheckpointWriter *writer = checkpoint_writer_create(TEST_CHECKPOINT_PATH);
+    TEST_ASSERT_NOT_NULL(writer);
+    TEST_ASSERT_EQUAL_INT(0, checkpoint_writer_add(writer, "bias", CHECKPOINT_FLOAT32, 1, biasShape, bias));
+    TEST_ASSERT_EQUAL_INT(0, checkpoint_writer_add(writer, "packed", CHECKPOINT_INT8, 1, packedShape, packed));
+    TEST_ASSERT_EQUAL_INT(0, checkpoint_writer_add_rows(writer, "weight", 2, 5, rows));
+    TEST_ASSERT_EQUAL_INT(0, checkpoint_writer_close(writer));
+
+    Checkpoint *checkpoint = checkpoint_open(TEST_CHECKPOINT_PATH);
+    TEST_ASSERT_NOT_NULL(checkpoint);
+    TEST_ASSERT_EQUAL_UINT32(3, checkpoint->header->numTensors);
+
+    const CheckpointTensor *weight = checkpoint_find(checkpoint, "weight");
+    TEST_ASSERT_NOT_NULL(weight);
+    TEST_ASSERT_EQUAL_UINT32(2, weight->ndim);
+    TEST_ASSERT_EQUAL_UINT32(2, weight->shape[0]);
+    TEST_ASSERT_EQUAL_UINT32(5, weight->shape[1]);
+
+    // Every tensor is aligned for in-place SIMD loads
+    for (uint32_t i = 0; i < checkpoint->header->numTensors; i++)
+    {
+        TEST_ASSERT_EQUAL_UINT64(0, checkpoint->tensors[i].offset % CHECKPOINT_ALIGNMENT);
+    }
+
+    float *w = (float *)checkpoint_data(checkpoint, weight);
+    TEST_ASSERT_EQUAL_FLOAT_ARRAY(row0, w, 5);
+    TEST_ASSERT_EQUAL_FLOAT_ARRAY(row1, w + 5, 5);
+    TEST_ASSERT_EQUAL_FLOAT_ARRAY(bias, (float *)checkpoint_data(checkpoint, checkpoint_find(checkpoint, "bias")), 3);
+    TEST_ASSERT_EQUAL_INT8_ARRAY(packed, (int8_t *)checkpoint_data(checkpoint, checkpoint_find(checkpoint, "packed")), 7);
+    TEST_ASSERT_NULL(checkpoint_find(checkpoint, "missing"));
+
+    checkpoint_close(checkpoint);
+    remove(TEST_CHECKPOINT_PATH);
+}
+
+void test_checkpoint_invalid_file(void)
+{
+    FILE *file = fopen(TEST_CHECKPOINT_PATH, "wb");
+    const char junk[32] = "not a checkpoint";
+    fwrite(junk, 1, sizeof(junk), file);
+    fclose(file);
+
+    TEST_ASSERT_NULL(checkpoint_open(TEST_CHECKPOINT_PATH));
+    TEST_ASSERT_NULL(checkpoint_open("/nonexistent/checkpoint.bin"));
+    remove(TEST_CHECKPOINT_PATH);
+}
+
+// Overwrite the table entry of a one-tensor checkpoint
+static void patch_tensor(const CheckpointTensor *patched)
+{
+    FILE *file = fopen(TEST_CHECKPOINT_PATH, "r+b");
+    fseek(file, sizeof(CheckpointHeader), SEEK_SET);
+    fwrite(patched, sizeof(CheckpointTensor), 1, file);
+    fclose(file);
+}
+
+static void expect_rejected(const CheckpointTensor *patched)
+{
+    patch_tensor(patched);
+    TEST_ASSERT_NULL(checkpoint_open(TEST_CHECKPOINT_PATH));
+}
+
+void test_checkpoint_malformed_tensor(void)
+{
+    float row0[4] = {1, 2, 3, 4};
+    float row1[4] = {5, 6, 7, 8};
+    float *rows[2] = {row0, row1};
+    CheckpointWriter *writer = checkpoint_writer_create(TEST_CHECKPOINT_PATH);
+    TEST_ASSERT_EQUAL_INT(0, checkpoint_writer_add_rows(writer, "weight", 2, 4, rows));
+    TEST_ASSERT_EQUAL_INT(0, checkpoint_writer_close(writer));
+
+    Checkpoint *checkpoint = checkpoint_open(TEST_CHECKPOINT_PATH);
+    TEST_ASSERT_NOT_NULL(checkpoint);
+    CheckpointTensor valid = checkpoint->tensors[0];
+    checkpoint_close(checkpoint);
+
+    // A size too small for the shape, as left by a truncating converter
+    CheckpointTensor tensor = valid;
+    tensor.size = 16;
+    expect_rejected(&tensor);
+
+    // offset + size wraps around 2^64
+    tensor = valid;
+    tensor.offset = UINT64_MAX - 63;
+    expect_rejected(&tensor);
+
+    tensor = valid;
+    tensor.offset += 4;
+    expect_rejected(&tensor);
+
+    tensor = valid;
+    tensor.ndim = CHECKPOINT_MAX_DIMS + 1;
+    expect_rejected(&tensor);
+
+    tensor = valid;
+    tensor.dtype = CHECKPOINT_BFLOAT16 + 1;
+    expect_rejected(&tensor);
+
+    // A shape whose element count overflows 64 bits
+    tensor = valid;
+    tensor.ndim = 3;
+    tensor.shape[0] = tensor.shape[1] = tensor.shape[2] = UINT32_MAX;
+    expect_rejected(&tensor);
+
+    // The unmodified entry still opens
+    patch_tensor(&valid);
+    checkpoint = checkpoint_open(TEST_CHECKPOINT_PATH);
+    TEST_ASSERT_NOT_NULL(checkpoint);
+    checkpoint_close(checkpoint);
+    remove(TEST_CHECKPOINT_PATH);
+}
@@ -0,0 +1,8 @@
+#ifndef TEST_CHECKPOINT_H
+#define TEST_CHECKPOINT_H
+
+void test_checkpoint_roundtrip(void);
+void test_checkpoint_invalid_file(void);
+void test_checkpoint_malformed_tensor(void);
+
+#endif // TEST_CHECKPOINT_H
@@ -0,0 +1,191 @@
+#include "unity/unity.h"
+#include "../utils/convert.h"
+#include "test_convert.h"
+#include <string.h>
+
+#define TEST_NPY_PATH "/tmp/test_convert.npy"
+
+// Write a minimal version 1.0 .npy file
+static void write_npy(const char *descr, const char *fortran, const char *shape, const void *data, size_t bytes)
+{
+    char header[128];
+    int length = snprintf(header, sizeof(header), "{'descr': '%s', 'fortran_order': %s, 'shape': %s, }", descr, fortran, shape);
+    int padded = ((10 + length + 1 + 63) / 64) * 64 - 10;
+    memset(header + length, ' ', padded - length - 1);
+    header[padded - 1] = '\n';
+
+    FILE *file = fopen(TEST_NPY_PATH, "wb");
+    unsigned char preamble[10] = {0x93, 'N', 'U', 'M', 'P', 'Y', 1, 0, padded & 0xff, padded >> 8};
+    fwrite(preamble, 1, sizeof(preamble), file);
+    fwrite(header, 1, padded, file);
+    fwrite(data, 1, bytes, file);
+    fclose(file);
+}
+
+static ConvertTensor make_tensor(float *values, int rows, int cols)
+{
+    ConvertTensor tensor;
+    memset(&tensor, 0, sizeof(tensor));
+    strcpy(tensor.name, "w");
+    tensor.dtype = CHECKPOINT_FLOAT32;
+    tensor.ndim = 2;
+    tensor.shape[0] = rows;
+    tensor.shape[1] = cols;
+    tensor.data = malloc(rows * cols * sizeof(float));
+    memcpy(tensor.data, values, rows * cols * sizeof(float));
+    return tensor;
+}
+
+void test_load_npy(void)
+{
+    float values[6] = {1, 2, 3, 4, 5, 6};
+    double wide[3] = {0.5, -1.5, 2.5};
+    ConvertTensor tensor;
+
+    write_npy("<f4", "False", "(2, 3)", values, sizeof(values));
+    TEST_ASSERT_EQUAL_INT(0, load_npy(TEST_NPY_PATH, &tensor));
+    TEST_ASSERT_EQUAL_INT(2, tensor.ndim);
+    TEST_ASSERT_EQUAL_INT(2, tensor.shape[0]);
+    TEST_ASSERT_EQUAL_INT(3, tensor.shape[1]);
+    TEST_ASSERT_EQUAL_FLOAT_ARRAY(values, (float *)tensor.data, 6);
+    convert_tensor_free(&tensor);
+
+    // Column-major storage of [[1, 3, 5], [2, 4, 6]]
+    float expected[6] = {1, 3, 5, 2, 4, 6};
+    write_npy("<f4", "True", "(2, 3)", values, sizeof(values));
+    TEST_ASSERT_EQUAL_INT(0, load_npy(TEST_NPY_PATH, &tensor));
+    TEST_ASSERT_EQUAL_INT(2, tensor.shape[0]);
+    TEST_ASSERT_EQUAL_INT(3, tensor.shape[1]);
+    TEST_ASSERT_EQUAL_FLOAT_ARRAY(expected, (float *)tensor.data, 6);
+    convert_tensor_free(&tensor);
+
+    float narrowed[3] = {0.5f, -1.5f, 2.5f};
+    write_npy("<f8", "False", "(3,)", wide, sizeof(wide));
+    TEST_ASSERT_EQUAL_INT(0, load_npy(TEST_NPY_PATH, &tensor));
+    TEST_ASSERT_EQUAL_INT(1, tensor.ndim);
+    TEST_ASSERT_EQUAL_INT(3, tensor.shape[0]);
+    TEST_ASSERT_EQUAL_FLOAT_ARRAY(narrowed, (float *)tensor.data, 3);
+    convert_tensor_free(&tensor);
+
+    write_npy("<i4", "False", "(3,)", values, 12);
+    TEST_ASSERT_EQUAL_INT(-1, load_npy(TEST_NPY_PATH, &tensor));
+    remove(TEST_NPY_PATH);
+}
+
+void test_load_hdf5_dataset(void)
+{
+    const char *path = "/tmp/test_convert.h5";
+    float values[2][3] = {{1, 2, 3}, {4, 5, 6}};
+    hsize_t dims[2] = {2, 3};
+
+    hid_t file_id = H5Fcreate(path, H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+    hid_t space_id = H5Screate_simple(2, dims, NULL);
+    hid_t dataset_id = H5Dcreate2(file_id, "kernel", H5T_NATIVE_FLOAT, space_id, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    H5Dwrite(dataset_id, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT, values);
+    H5Dclose(dataset_id);
+    H5Sclose(space_id);
+
+    ConvertTensor tensor;
+    TEST_ASSERT_EQUAL_INT(0, load_hdf5_dataset(file_id, "kernel", &tensor));
+    TEST_ASSERT_EQUAL_INT(2, tensor.ndim);
+    TEST_ASSERT_EQUAL_INT(2, tensor.shape[0]);
+    TEST_ASSERT_EQUAL_INT(3, tensor.shape[1]);
+    TEST_ASSERT_EQUAL_FLOAT_ARRAY(&values[0][0], (float *)tensor.data, 6);
+    convert_tensor_free(&tensor);
+
+    H5Fclose(file_id);
+    remove(path);
+}
+
+void test_convert_transpose(void)
+{
+    // 3x2 -> transpose -> 2x3
+    float values[6] = {1, 2, 3, 4, 5, 6};
+    ConvertTensor tensor = make_tensor(values, 3, 2);
+
+    TEST_ASSERT_EQUAL_INT(0, convert_transpose(&tensor));
+    float transposed[6] = {1, 3, 5, 2, 4, 6};
+    TEST_ASSERT_EQUAL_INT(2, tensor.shape[0]);
+    TEST_ASSERT_EQUAL_INT(3, tensor.shape[1]);
+    TEST_ASSERT_EQUAL_FLOAT_ARRAY(transposed, (float *)tensor.data, 6);
+    convert_tensor_free(&tensor);
+}
+
+void test_convert_prune(void)
+{
+    float values[8] = {0.1f, -0.8f, 0.3f, -0.2f, 0.6f, 0.2f, -0.05f, 1.0f};
+    ConvertTensor tensor = make_tensor(values, 2, 4);
+
+    TEST_ASSERT_EQUAL_INT(4, convert_prune(&tensor, 0.5f));
+    float expected[8] = {0.0f, -0.8f, 0.3f, 0.0f, 0.6f, 0.0f, 0.0f, 1.0f};
+    TEST_ASSERT_EQUAL_FLOAT_ARRAY(expected, (float *)tensor.data, 8);
+    TEST_ASSERT_EQUAL_INT(-1, convert_prune(&tensor, 1.5f));
+    convert_tensor_free(&tensor);
+}
+
+void test_convert_quantize_int8(void)
+{
+    float values[8] = {0.5f, -1.0f, 0.25f, 0.0f, 2.0f, 1.0f, -2.0f, 0.1f};
+    ConvertTensor tensor = make_tensor(values, 2, 4);
+    ConvertTensor scales;
+
+    TEST_ASSERT_EQUAL_INT(0, convert_quantize_int8(&tensor, &scales));
+    TEST_ASSERT_EQUAL_INT(CHECKPOINT_INT8, tensor.dtype);
+    TEST_ASSERT_EQUAL_STRING("w.scale", scales.name);
+    TEST_ASSERT_EQUAL_INT(2, scales.shape[0]);
+
+    int8_t *q = (int8_t *)tensor.data;
+    float *s = (float *)scales.data;
+    TEST_ASSERT_EQUAL_INT8(-127, q[1]);
+    TEST_ASSERT_EQUAL_INT8(127, q[4]);
+    for (int i = 0; i < 8; i++)
+    {
+        TEST_ASSERT_FLOAT_WITHIN(s[i / 4] * 0.5f + 1e-6f, values[i], q[i] * s[i / 4]);
+    }
+    convert_tensor_free(&tensor);
+    convert_tensor_free(&scales);
+}
+
+void test_convert_ops_after_quantize(void)
+{
+    float values[6] = {1, 2, 3, 4, 5, 6};
+    ConvertTensor tensor = make_tensor(values, 3, 2);
+    ConvertTensor scales;
+
+    // The scales index the rows as quantized, so the int8 tensor can no longer be reshaped or
+    // pruned, nor quantized twice
+    TEST_ASSERT_EQUAL_INT(0, convert_quantize_int8(&tensor, &scales));
+    TEST_ASSERT_EQUAL_INT(-1, convert_transpose(&tensor));
+    TEST_ASSERT_EQUAL_INT(3, tensor.shape[0]);
+    TEST_ASSERT_EQUAL_INT(2, tensor.shape[1]);
+    TEST_ASSERT_EQUAL_INT(-1, convert_prune(&tensor, 0.5f));
+    ConvertTensor again;
+    TEST_ASSERT_EQUAL_INT(-1, convert_quantize_int8(&tensor, &again));
+    convert_tensor_free(&tensor);
+    convert_tensor_free(&scales);
+}
+
+void test_write_manifest_escapes(void)
+{
+    const char *checkpointPath = "/tmp/test_convert_manifest.bin";
+    const char *manifestPath = "/tmp/test_convert_manifest.json";
+    float values[2] = {1, 2};
+    int shape[1] = {2};
+    CheckpointWriter *writer = checkpoint_writer_create(checkpointPath);
+    TEST_ASSERT_EQUAL_INT(0, checkpoint_writer_add(writer, "w\"1\\", CHECKPOINT_FLOAT32, 1, shape, values));
+    TEST_ASSERT_EQUAL_INT(0, checkpoint_writer_close(writer));
+
+    // Names and notes come from the command line, so quotes, backslashes and control
+    // characters in them are escaped
+    const char *notes[1] = {"w=C:\\models\\\"a\"\t.npy"};
+    TEST_ASSERT_EQUAL_INT(0, write_manifest(checkpointPath, manifestPath, notes));
+    char manifest[1024];
+    FILE *file = fopen(manifestPath, "r");
+    size_t length = fread(manifest, 1, sizeof(manifest) - 1, file);
+    manifest[length] = '\0';
+    fclose(file);
+    TEST_ASSERT_NOT_NULL(strstr(manifest, "\"name\": \"w\\\"1\\\\\""));
+    TEST_ASSERT_NOT_NULL(strstr(manifest, "\"note\": \"w=C:\\\\models\\\\\\\"a\\\"\\u0009.npy\""));
+    remove(checkpointPath);
+    remove(manifestPath);
+}
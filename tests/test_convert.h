@@ -0,0 +1,12 @@
+#ifndef TEST_CONVERT_H
+#define TEST_CONVERT_H
+
+void test_load_npy(void);
+void test_load_hdf5_dataset(void);
+void test_convert_transpose(void);
+void test_convert_prune(void);
+void test_convert_quantize_int8(void);
+void test_convert_ops_after_quantize(void);
+void test_write_manifest_escapes(void);
+
+#endif // TEST_CONVERT_H
@@ -0,0 +1,238 @@
+#include "unity/unity.h"
+// Activation int8 only changes layers stored as QUANT_INT8, which only the mixed checkpoint has
+#define ACTIVATION_INT8 1
+#define GPT2_NO_MAIN
+#include "../gpt2/gpt2_optimized.c"
+#include "../utils/convert.h"
+#include "test_gpt2.h"
+
+// Two narrow blocks over a small vocabulary keep the Philox-initialized model quick to run
+static const GPT2Config TEST_CONFIG = {"test", 64, 2, 2, 32, 256};
+
+static KVBlockPool *test_pool(int numLayers)
+{
+    return kv_pool_create(numLayers, MAX_POSITION_EMBEDDINGS / KV_BLOCK_TOKENS, KV_BLOCK_TOKENS, TEST_CONFIG.numHeads,
+                          TEST_CONFIG.headDim, KV_FLOAT32);
+}
+
+static void test_prompt(int *prompt, int length)
+{
+    for (int i = 0; i < length; i++)
+    {
+        prompt[i] = (i * 37 + 11) % TEST_CONFIG.vocabSize;
+    }
+}
+
+// Logits of the last prompt token after prefilling the prompt chunkSize tokens at a time
+static float *prefill_logits(int *prompt, int promptLength, int chunkSize, GPT2Weights weights, KVBlockPool *pool)
+{
+    KVCache *cache = kv_cache_create(pool);
+    float *hidden = prefill(prompt, promptLength, weights, cache, chunkSize);
+    TEST_ASSERT_NOT_NULL(hidden);
+    TEST_ASSERT_EQUAL_INT(promptLength, cache->length);
+    LinearLayer logits_mlp = weights.logits_mlp;
+    float *logits = linear(hidden, logits_mlp.weights, logits_mlp.biases, logits_mlp.fcInputSize, logits_mlp.fcOutputSize);
+    free(hidden);
+    kv_cache_free(cache);
+    return logits;
+}
+
+void test_gpt2_chunked_prefill(void)
+{
+    GPT2Weights weights = initialize_weights(&TEST_CONFIG);
+    KVBlockPool *pool = test_pool(TEST_CONFIG.numBlocks);
+    int prompt[37];
+    test_prompt(prompt, 37);
+
+    // Chunks of 5 end inside KV blocks of 16, chunks of 16 on their boundaries; both must match
+    // a single forward over the whole prompt
+    float *whole = prefill_logits(prompt, 37, 37, weights, pool);
+    int chunkSizes[] = {1, 5, 16};
+    for (int c = 0; c < 3; c++)
+    {
+        float *chunked = prefill_logits(prompt, 37, chunkSizes[c], weights, pool);
+        TEST_ASSERT_FLOAT_ARRAY_WITHIN(1e-4f, whole, chunked, TEST_CONFIG.vocabSize);
+        free(chunked);
+    }
+    free(whole);
+
+    TEST_ASSERT_EQUAL_INT(pool->numBlocks, pool->numFree);
+    kv_pool_free(pool);
+    free_weights(&weights);
+}
+
+static int record_test_token(int token, int index, void *userData)
+{
+    ((int *)userData)[index] = token;
+    return 0;
+}
+
+void test_gpt2_speculative_full_draft(void)
+{
+    GPT2Weights weights = initialize_weights(&TEST_CONFIG);
+    KVBlockPool *pool = test_pool(TEST_CONFIG.numBlocks);
+    KVBlockPool *draftPool = test_pool(TEST_CONFIG.numBlocks);
+    SamplerConfig greedy = {0.0f, 0, 1.0f, 1.0f, 0};
+    int prompt[21];
+    test_prompt(prompt, 21);
+    int plain[24];
+    int speculative[24];
+
+    KVCache *cache = kv_cache_create(pool);
+    int numPlain = generate(prompt, 21, 24, greedy, weights, cache, record_test_token, plain, NULL);
+    kv_cache_free(cache);
+
+    // A draft with every block of the model proposes exactly what the model picks, so every
+    // proposal is accepted and the output is generate()'s
+    cache = kv_cache_create(pool);
+    KVCache *draftCache = kv_cache_create(draftPool);
+    SpeculativeStats stats;
+    int numSpeculative = generate_speculative(prompt, 21, 24, greedy, weights, cache, weights, draftCache, SPECULATIVE_TOKENS,
+                                              record_test_token, speculative, NULL, &stats);
+    TEST_ASSERT_EQUAL_INT(24, numPlain);
+    TEST_ASSERT_EQUAL_INT(numPlain, numSpeculative);
+    TEST_ASSERT_EQUAL_INT_ARRAY(plain, speculative, numPlain);
+    TEST_ASSERT_TRUE(stats.drafted > 0);
+    TEST_ASSERT_EQUAL_INT(stats.drafted, stats.accepted);
+
+    kv_cache_free(draftCache);
+    kv_cache_free(cache);
+    kv_pool_free(draftPool);
+    kv_pool_free(pool);
+    free_weights(&weights);
+}
+
+void test_gpt2_beam_search_releases_blocks(void)
+{
+    GPT2Weights weights = initialize_weights(&TEST_CONFIG);
+    KVBlockPool *pool = test_pool(TEST_CONFIG.numBlocks);
+    KVPrefixCache *prefix = kv_prefix_cache_create(pool);
+    int prompt[37];
+    test_prompt(prompt, 37);
+    int output[20];
+
+    TEST_ASSERT_TRUE(beam_search(prompt, 37, 20, 4, weights, pool, output, NULL) > 0);
+
+    // Once every beam is freed only the prompt's two full blocks stay, held by the prefix cache
+    int entries = prefix->capacity - prefix->numFreeEntries;
+    TEST_ASSERT_EQUAL_INT(2, entries);
+    TEST_ASSERT_EQUAL_INT(pool->numBlocks - entries, pool->numFree);
+    kv_prefix_cache_free(prefix);
+    TEST_ASSERT_EQUAL_INT(pool->numBlocks, pool->numFree);
+
+    kv_pool_free(pool);
+    free_weights(&weights);
+}
+
+// Copy every layer's key and value rows of positions [0, length) into rows
+static void snapshot_rows(const KVCache *cache, int length, float *rows)
+{
+    int width = cache->pool->width;
+    for (int layer = 0; layer < cache->pool->numLayers; layer++)
+    {
+        for (int p = 0; p < length; p++)
+        {
+            memcpy(rows, kv_cache_key(cache, layer, p), width * sizeof(float));
+            memcpy(rows + width, kv_cache_value(cache, layer, p), width * sizeof(float));
+            rows += 2 * width;
+        }
+    }
+}
+
+void test_gpt2_forked_cache_isolation(void)
+{
+    GPT2Weights weights = initialize_weights(&TEST_CONFIG);
+    KVBlockPool *pool = test_pool(TEST_CONFIG.numBlocks);
+    int rowsSize = TEST_CONFIG.numBlocks * 22 * 2 * TEST_CONFIG.embeddingSize;
+    float *before = (float *)malloc(rowsSize * sizeof(float));
+    float *after = (float *)malloc(rowsSize * sizeof(float));
+    int prompt[21];
+    test_prompt(prompt, 21);
+
+    // The prompt ends inside its second block, which parent and child then both write into
+    KVCache *parent = kv_cache_create(pool);
+    free(prefill(prompt, 21, weights, parent, 0));
+    KVCache *child = kv_cache_fork(parent);
+    snapshot_rows(parent, 21, before);
+
+    int childToken = 3;
+    free(forward(&childToken, 1, weights, child));
+    snapshot_rows(parent, 21, after);
+    TEST_ASSERT_EQUAL_FLOAT_ARRAY(before, after, rowsSize / 22 * 21);
+    TEST_ASSERT_NOT_EQUAL(parent->blockTable[1], child->blockTable[1]);
+
+    // The parent's own next token leaves the child's rows, its new one included, untouched
+    snapshot_rows(child, 22, before);
+    int parentToken = 200;
+    free(forward(&parentToken, 1, weights, parent));
+    snapshot_rows(child, 22, after);
+    TEST_ASSERT_EQUAL_FLOAT_ARRAY(before, after, rowsSize);
+
+    kv_cache_free(child);
+    kv_cache_free(parent);
+    TEST_ASSERT_EQUAL_INT(pool->numBlocks, pool->numFree);
+    free(before);
+    free(after);
+    kv_pool_free(pool);
+    free_weights(&weights);
+}
+
+void test_gpt2_mixed_int8_checkpoint(void)
+{
+    const char *path = "/tmp/test_gpt2_mixed.bin";
+    GPT2Weights weights = initialize_weights(&TEST_CONFIG);
+    LinearLayer *q = &weights.blocks[0].q_mlp;
+    LinearLayer *k = &weights.blocks[0].k_mlp;
+
+    // Quantize h.0.q.weight the way convert_checkpoint's q8 op does; k and v stay fp32
+    ConvertTensor tensor = {"h.0.q.weight", CHECKPOINT_FLOAT32, 2, {q->fcOutputSize, q->fcInputSize}, NULL};
+    ConvertTensor scales;
+    tensor.data = malloc(convert_tensor_count(&tensor) * sizeof(float));
+    memcpy(tensor.data, q->weights[0], convert_tensor_count(&tensor) * sizeof(float));
+    TEST_ASSERT_EQUAL_INT(0, convert_quantize_int8(&tensor, &scales));
+    CheckpointWriter *writer = checkpoint_writer_create(path);
+    TEST_ASSERT_EQUAL_INT(0, checkpoint_writer_add(writer, tensor.name, tensor.dtype, tensor.ndim, tensor.shape, tensor.data));
+    TEST_ASSERT_EQUAL_INT(0, checkpoint_writer_add(writer, scales.name, scales.dtype, scales.ndim, scales.shape, scales.data));
+    TEST_ASSERT_EQUAL_INT(0, checkpoint_writer_close(writer));
+    convert_tensor_free(&tensor);
+    convert_tensor_free(&scales);
+
+    Checkpoint *checkpoint = checkpoint_open(path);
+    TEST_ASSERT_NOT_NULL(checkpoint);
+    free(q->weights[0]);
+    free(q->weights);
+    q->weights = NULL;
+    TEST_ASSERT_EQUAL_INT(0, map_layer_weights(q, checkpoint, "h.0.q.weight"));
+    TEST_ASSERT_NOT_NULL(q->quantized);
+    TEST_ASSERT_NULL(k->quantized);
+
+    // K is handed the inputs quantized for Q and still runs its fp32 weights
+    QuantizedActivations *quantized = activations_for(q, weights.wte, 3);
+    TEST_ASSERT_NOT_NULL(quantized);
+    float **expected = linear_batch(k, weights.wte, 3);
+    float **actual = linear_rows(k, weights.wte, 3, quantized);
+    for (int i = 0; i < 3; i++)
+    {
+        TEST_ASSERT_EQUAL_FLOAT_ARRAY(expected[i], actual[i], k->fcOutputSize);
+        free(expected[i]);
+        free(actual[i]);
+    }
+    free(expected);
+    free(actual);
+    quantized_activations_free(quantized);
+
+    // A whole forward runs Q as an int8 GEMM next to the fp32 K and V
+    int prompt[21];
+    test_prompt(prompt, 21);
+    float *hidden = forward(prompt, 21, weights, NULL);
+    TEST_ASSERT_NOT_NULL(hidden);
+    for (int i = 0; i < TEST_CONFIG.embeddingSize; i++)
+    {
+        TEST_ASSERT_TRUE(isfinite(hidden[i]));
+    }
+    free(hidden);
+
+    free_weights(&weights);
+    checkpoint_close(checkpoint);
+    remove(path);
+}
@@ -0,0 +1,10 @@
+#ifndef TEST_GPT2_H
+#define TEST_GPT2_H
+
+void test_gpt2_chunked_prefill(void);
+void test_gpt2_speculative_full_draft(void);
+void test_gpt2_beam_search_releases_blocks(void);
+void test_gpt2_forked_cache_isolation(void);
+void test_gpt2_mixed_int8_checkpoint(void);
+
+#endif // TEST_GPT2_H
@@ -0,0 +1,191 @@
+#include "unity/unity.h"
+#include "../kernel/kernel.h"
+#include "test_half.h"
+
+static float **random_rows(int rows, int cols)
+{
+    float **matrix = (float **)malloc(rows * sizeof(float *));
+    for (int i = 0; i < rows; i++)
+    {
+        matrix[i] = (float *)malloc(cols * sizeof(float));
+        for (int j = 0; j < cols; j++)
+        {
+            matrix[i][j] = (float)rand() / RAND_MAX * 2.0f - 1.0f;
+        }
+    }
+    return matrix;
+}
+
+static void free_rows(float **matrix, int rows)
+{
+    for (int i = 0; i < rows; i++)
+    {
+        free(matrix[i]);
+    }
+    free(matrix);
+}
+
+static float from_bits(uint32_t bits)
+{
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+void test_half_conversions(void)
+{
+    TEST_ASSERT_EQUAL_HEX16(0x3C00, float_to_fp16(1.0f));
+    TEST_ASSERT_EQUAL_HEX16(0xC000, float_to_fp16(-2.0f));
+    TEST_ASSERT_EQUAL_HEX16(0x7BFF, float_to_fp16(65504.0f));
+    TEST_ASSERT_EQUAL_HEX16(0x0001, float_to_fp16(5.9604645e-8f)); // smallest subnormal
+    TEST_ASSERT_EQUAL_FLOAT(0.333251953125f, fp16_to_float(float_to_fp16(1.0f / 3.0f)));
+
+    TEST_ASSERT_EQUAL_HEX16(0x3F80, float_to_bf16(1.0f));
+    TEST_ASSERT_EQUAL_HEX16(0x3F80, float_to_bf16(from_bits(0x3F808000))); // tie rounds to even
+    TEST_ASSERT_EQUAL_HEX16(0x3F82, float_to_bf16(from_bits(0x3F818000)));
+    TEST_ASSERT_EQUAL_HEX16(0x3F81, float_to_bf16(from_bits(0x3F808001)));
+    TEST_ASSERT_EQUAL_HEX16(0x7F80, float_to_bf16(INFINITY));
+    TEST_ASSERT_TRUE(isnan(bf16_to_float(float_to_bf16(NAN))));
+    TEST_ASSERT_FLOAT_WITHIN(3.0e38f / 256.0f, -3.0e38f, bf16_to_float(float_to_bf16(-3.0e38f))); // fp32 range
+    TEST_ASSERT_EQUAL_HEX16(0x7C00, float_to_fp16(1.0e5f));                                     // past fp16 range
+}
+
+void test_convert_half_roundtrip(void)
+{
+    int count = 37; // not a multiple of the vector width
+    float **values = random_rows(1, count);
+    uint16_t halves[37];
+    float restored[37];
+    HalfType types[2] = {HALF_FP16, HALF_BF16};
+
+    for (int t = 0; t < 2; t++)
+    {
+        convert_to_half(values[0], halves, count, types[t]);
+        convert_from_half(halves, restored, count, types[t]);
+        // Relative rounding error of 2^-11 (fp16) or 2^-8 (bf16)
+        float tolerance = (types[t] == HALF_FP16) ? 1.0f / 2048.0f : 1.0f / 256.0f;
+        for (int i = 0; i < count; i++)
+        {
+            uint16_t expected = (types[t] == HALF_FP16) ? float_to_fp16(values[0][i]) : float_to_bf16(values[0][i]);
+            TEST_ASSERT_EQUAL_HEX16(expected, halves[i]);
+            TEST_ASSERT_FLOAT_WITHIN(fabsf(values[0][i]) * tolerance, values[0][i], restored[i]);
+        }
+    }
+
+    free_rows(values, 1);
+}
+
+// The 16-bit kernels must match an fp32 reference over the rounded weights, up to the order
+// of the fp32 sums
+static float rounded_dot(const float *x, const float *w, int n, HalfType type)
+{
+    float sum = 0.0f;
+    for (int j = 0; j < n; j++)
+    {
+        float wj = (type == HALF_BF16) ? bf16_to_float(float_to_bf16(w[j])) : fp16_to_float(float_to_fp16(w[j]));
+        sum += x[j] * wj;
+    }
+    return sum;
+}
+
+void test_linear_half(void)
+{
+    int rows = 2 * SELECT_CHUNK_ROWS + 5, cols = 75;
+    float **weights = random_rows(rows, cols);
+    float **input = random_rows(1, cols);
+    float **biases = random_rows(1, rows);
+    HalfType types[2] = {HALF_FP16, HALF_BF16};
+
+    for (int t = 0; t < 2; t++)
+    {
+        HalfMatrix *half = half_matrix_from_rows(weights, rows, cols, types[t]);
+        float *output = linear_half(input[0], half, biases[0]);
+        int expected = 0;
+        for (int i = 0; i < rows; i++)
+        {
+            TEST_ASSERT_FLOAT_WITHIN(1e-4f, rounded_dot(input[0], weights[i], cols, types[t]) + biases[0][i], output[i]);
+            expected = (output[i] > output[expected]) ? i : expected;
+        }
+
+        // The fused projection picks the same greedy token
+        SamplerConfig config = {0.0f, 0, 1.0f, 1.0f, 1};
+        TokenSelector selector;
+        selector_init(&selector, &config, rows, NULL, 0);
+        linear_select_half(input[0], half, biases[0], &selector);
+        TEST_ASSERT_EQUAL_INT(expected, selector_sample(&selector, &config));
+        selector_free(&selector);
+
+        free(output);
+        half_matrix_free(half);
+    }
+
+    free_rows(weights, rows);
+    free_rows(input, 1);
+    free_rows(biases, 1);
+}
+
+void test_linear_half_rows(void)
+{
+    int rows = 9, cols = 40, numInputs = 2 * HALF_TILE_ROWS + 1;
+    float **weights = random_rows(rows, cols);
+    float **inputs = random_rows(numInputs, cols);
+    HalfMatrix *half = half_matrix_from_rows(weights, rows, cols, HALF_BF16);
+
+    float **outputs = linear_half_rows(inputs, numInputs, half, NULL);
+    for (int t = 0; t < numInputs; t++)
+    {
+        float *single = linear_half(inputs[t], half, NULL);
+        TEST_ASSERT_FLOAT_ARRAY_WITHIN(1e-5f, single, outputs[t], rows);
+        free(single);
+    }
+
+    free_rows(outputs, numInputs);
+    half_matrix_free(half);
+    free_rows(weights, rows);
+    free_rows(inputs, numInputs);
+}
+
+void test_matmul_half(void)
+{
+    int A_rows = HALF_TILE_ROWS + 2, A_cols = 13, B_cols = 21;
+    float **A = random_rows(A_rows, A_cols);
+    float **B = random_rows(A_cols, B_cols);
+    HalfMatrix *half = half_matrix_from_rows(B, A_cols, B_cols, HALF_FP16);
+
+    float **C = matmul_half(A, half, A_rows);
+    for (int i = 0; i < A_rows; i++)
+    {
+        for (int j = 0; j < B_cols; j++)
+        {
+            float expected = 0.0f;
+            for (int k = 0; k < A_cols; k++)
+            {
+                expected += A[i][k] * fp16_to_float(half->data[k * B_cols + j]);
+            }
+            TEST_ASSERT_FLOAT_WITHIN(1e-5f, expected, C[i][j]);
+        }
+    }
+
+    free_rows(C, A_rows);
+    half_matrix_free(half);
+    free_rows(A, A_rows);
+    free_rows(B, A_cols);
+}
+
+void test_embedding_half(void)
+{
+    int rows = 6, cols = 19;
+    float **table = random_rows(rows, cols);
+    HalfMatrix *half = half_matrix_from_rows(table, rows, cols, HALF_BF16);
+    float output[19];
+
+    embedding_half(half, 4, output);
+    for (int j = 0; j < cols; j++)
+    {
+        TEST_ASSERT_EQUAL_FLOAT(bf16_to_float(float_to_bf16(table[4][j])), output[j]);
+    }
+    TEST_ASSERT_NULL(half_matrix_from_rows(table, rows, cols, HALF_NONE));
+
+    half_matrix_free(half);
+    free_rows(table, rows);
+}
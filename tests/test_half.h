@@ -0,0 +1,11 @@
+#ifndef TEST_HALF_H
+#define TEST_HALF_H
+
+void test_half_conversions(void);
+void test_convert_half_roundtrip(void);
+void test_linear_half(void);
+void test_linear_half_rows(void);
+void test_matmul_half(void);
+void test_embedding_half(void);
+
+#endif // TEST_HALF_H
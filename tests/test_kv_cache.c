@@ -0,0 +1,281 @@
+#include "unity/unity.h"
+#include "../kernel/kernel.h"
+#include "test_kv_cache.h"
+
+void test_kv_cache_append_commit(void)
+{
+    int numLayers = 2;
+    int width = 4;
+    KVBlockPool *pool = kv_pool_create(numLayers, 4, 2, 1, width, KV_FLOAT32);
+    KVCache *cache = kv_cache_create(pool);
+
+    float k_data[3][4] = {{1, 2, 3, 4}, {5, 6, 7, 8}, {9, 10, 11, 12}};
+    float v_data[3][4] = {{-1, -2, -3, -4}, {-5, -6, -7, -8}, {-9, -10, -11, -12}};
+    float *K[] = {k_data[0], k_data[1], k_data[2]};
+    float *V[] = {v_data[0], v_data[1], v_data[2]};
+
+    // Prefill two positions on every layer, then decode a third into a second block
+    for (int l = 0; l < numLayers; l++)
+    {
+        TEST_ASSERT_EQUAL_INT(0, kv_cache_append(cache, l, K, V, 2));
+    }
+    TEST_ASSERT_EQUAL_INT(0, cache->length);
+    kv_cache_commit(cache, 2);
+    TEST_ASSERT_EQUAL_INT(2, cache->length);
+    TEST_ASSERT_EQUAL_INT(1, cache->numBlocks);
+
+    for (int l = 0; l < numLayers; l++)
+    {
+        TEST_ASSERT_EQUAL_INT(0, kv_cache_append(cache, l, &K[2], &V[2], 1));
+    }
+    kv_cache_commit(cache, 1);
+    TEST_ASSERT_EQUAL_INT(3, cache->length);
+    TEST_ASSERT_EQUAL_INT(2, cache->numBlocks);
+    TEST_ASSERT_EQUAL_INT(2, pool->numFree);
+
+    for (int l = 0; l < numLayers; l++)
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            TEST_ASSERT_EQUAL_FLOAT_ARRAY(k_data[i], kv_cache_key(cache, l, i), width);
+            TEST_ASSERT_EQUAL_FLOAT_ARRAY(v_data[i], kv_cache_value(cache, l, i), width);
+        }
+    }
+
+    // Resetting returns the blocks to the pool
+    kv_cache_reset(cache);
+    TEST_ASSERT_EQUAL_INT(0, cache->length);
+    TEST_ASSERT_EQUAL_INT(4, pool->numFree);
+
+    kv_cache_free(cache);
+    kv_pool_free(pool);
+}
+
+void test_kv_cache_overflow(void)
+{
+    float row[2] = {1, 2};
+    float *K[] = {row, row, row};
+    KVBlockPool *pool = kv_pool_create(1, 2, 1, 1, 2, KV_FLOAT32);
+    KVCache *first = kv_cache_create(pool);
+    KVCache *second = kv_cache_create(pool);
+
+    TEST_ASSERT_EQUAL_INT(-1, kv_cache_append(first, 0, K, K, 3));
+    TEST_ASSERT_EQUAL_INT(0, kv_cache_append(first, 0, K, K, 2));
+    kv_cache_commit(first, 2);
+
+    // The pool is shared, so the second sequence gets a block once the first releases its own
+    TEST_ASSERT_EQUAL_INT(-1, kv_cache_append(second, 0, K, K, 1));
+    kv_cache_free(first);
+    TEST_ASSERT_EQUAL_INT(0, kv_cache_append(second, 0, K, K, 1));
+
+    kv_cache_free(second);
+    kv_pool_free(pool);
+}
+
+void test_kv_cache_int8(void)
+{
+    int numHeads = 2;
+    int headDim = 4;
+    float k_data[4][8] = {{1, -2, 3, -4, 0.5, 0.25, -0.125, 0}, {0, 0, 0, 0, 100, -50, 25, 12.5}};
+    float v_data[4][8] = {{-1, 2, -3, 4, 0, 0, 0, 0}, {7, 7, 7, 7, -0.1, 0.2, -0.3, 0.4}};
+    float *K[] = {k_data[0], k_data[1]};
+    float *V[] = {v_data[0], v_data[1]};
+
+    KVBlockPool *pool = kv_pool_create(1, 2, 2, numHeads, headDim, KV_INT8);
+    KVCache *cache = kv_cache_create(pool);
+    TEST_ASSERT_EQUAL_INT(0, kv_cache_append(cache, 0, K, V, 2));
+    kv_cache_commit(cache, 2);
+
+    // Dequantized values are within half a quantization step of the input
+    for (int i = 0; i < 2; i++)
+    {
+        size_t slot = kv_cache_slot(cache, i);
+        for (int h = 0; h < numHeads; h++)
+        {
+            float k_scale = pool->key_scales[0][slot * numHeads + h];
+            float v_scale = pool->value_scales[0][slot * numHeads + h];
+            for (int d = 0; d < headDim; d++)
+            {
+                int c = h * headDim + d;
+                TEST_ASSERT_FLOAT_WITHIN(k_scale * 0.5f + 1e-7f, k_data[i][c], pool->keys_q[0][slot * pool->width + c] * k_scale);
+                TEST_ASSERT_FLOAT_WITHIN(v_scale * 0.5f + 1e-7f, v_data[i][c], pool->values_q[0][slot * pool->width + c] * v_scale);
+            }
+        }
+    }
+
+    kv_cache_free(cache);
+    kv_pool_free(pool);
+}
+
+void test_kv_cache_half(void)
+{
+    int numHeads = 2;
+    int headDim = 4;
+    float k_data[2][8] = {{1, -2, 3, -4, 0.5, 0.25, -0.125, 0}, {0, 0, 0, 0, 100, -50, 25, 12.5}};
+    float v_data[2][8] = {{-1, 2, -3, 4, 0, 0, 0, 0}, {7, 7, 7, 7, -0.1, 0.2, -0.3, 0.4}};
+    float *K[] = {k_data[0], k_data[1]};
+    float *V[] = {v_data[0], v_data[1]};
+
+    KVBlockPool *pool = kv_pool_create(1, 2, 1, numHeads, headDim, KV_FLOAT16);
+    KVCache *cache = kv_cache_create(pool);
+    TEST_ASSERT_EQUAL_INT(0, kv_cache_append(cache, 0, K, V, 2));
+    kv_cache_commit(cache, 2);
+
+    // Each position is stored as fp16 in its own block
+    for (int i = 0; i < 2; i++)
+    {
+        size_t slot = kv_cache_slot(cache, i);
+        for (int c = 0; c < pool->width; c++)
+        {
+            TEST_ASSERT_EQUAL_HEX16(float_to_fp16(k_data[i][c]), pool->keys_h[0][slot * pool->width + c]);
+            TEST_ASSERT_EQUAL_HEX16(float_to_fp16(v_data[i][c]), pool->values_h[0][slot * pool->width + c]);
+        }
+    }
+
+    kv_cache_free(cache);
+    kv_pool_free(pool);
+}
+
+void test_kv_cache_truncate(void)
+{
+    float rows[5][2] = {{1, 1}, {2, 2}, {3, 3}, {4, 4}, {5, 5}};
+    float *K[] = {rows[0], rows[1], rows[2], rows[3], rows[4]};
+    KVBlockPool *pool = kv_pool_create(1, 4, 2, 1, 2, KV_FLOAT32);
+    KVCache *cache = kv_cache_create(pool);
+
+    TEST_ASSERT_EQUAL_INT(0, kv_cache_append(cache, 0, K, K, 5));
+    kv_cache_commit(cache, 5);
+    TEST_ASSERT_EQUAL_INT(1, pool->numFree);
+
+    // Keeping three positions releases the third block; the next append overwrites position 3
+    kv_cache_truncate(cache, 3);
+    TEST_ASSERT_EQUAL_INT(3, cache->length);
+    TEST_ASSERT_EQUAL_INT(2, cache->numBlocks);
+    TEST_ASSERT_EQUAL_INT(2, pool->numFree);
+    TEST_ASSERT_EQUAL_INT(0, kv_cache_append(cache, 0, &K[0], &K[0], 1));
+    kv_cache_commit(cache, 1);
+    TEST_ASSERT_EQUAL_FLOAT_ARRAY(rows[2], kv_cache_key(cache, 0, 2), 2);
+    TEST_ASSERT_EQUAL_FLOAT_ARRAY(rows[0], kv_cache_key(cache, 0, 3), 2);
+
+    // Truncating past the end is a no-op
+    kv_cache_truncate(cache, 10);
+    TEST_ASSERT_EQUAL_INT(4, cache->length);
+
+    kv_cache_free(cache);
+    kv_pool_free(pool);
+}
+
+void test_kv_prefix_cache_reuse(void)
+{
+    int width = 2;
+    int tokens[5] = {7, 8, 9, 10, 11};
+    float rows[5][2] = {{1, 1}, {2, 2}, {3, 3}, {4, 4}, {5, 5}};
+    float *K[] = {rows[0], rows[1], rows[2], rows[3], rows[4]};
+    KVBlockPool *pool = kv_pool_create(1, 4, 2, 1, width, KV_FLOAT32);
+    KVPrefixCache *prefix = kv_prefix_cache_create(pool);
+
+    // The first request misses, prefills its prompt and records its two full blocks
+    KVCache *first = kv_cache_create(pool);
+    TEST_ASSERT_EQUAL_INT(0, kv_prefix_lookup(prefix, first, tokens, 5));
+    TEST_ASSERT_EQUAL_INT(0, kv_cache_append(first, 0, K, K, 5));
+    kv_cache_commit(first, 5);
+    kv_prefix_insert(prefix, first, tokens, 5);
+    kv_cache_free(first);
+    TEST_ASSERT_EQUAL_INT(2, pool->numFree);
+
+    // A prompt sharing three tokens reuses the first block only; the partial one is recomputed
+    int other[4] = {7, 8, 9, 42};
+    KVCache *second = kv_cache_create(pool);
+    TEST_ASSERT_EQUAL_INT(2, kv_prefix_lookup(prefix, second, other, 4));
+    TEST_ASSERT_EQUAL_INT(2, second->length);
+    TEST_ASSERT_EQUAL_FLOAT_ARRAY(rows[1], kv_cache_key(second, 0, 1), width);
+
+    // An identical prompt keeps its last token to run, so a fully cached prompt of 4 reuses 2
+    KVCache *third = kv_cache_create(pool);
+    TEST_ASSERT_EQUAL_INT(2, kv_prefix_lookup(prefix, third, tokens, 4));
+    TEST_ASSERT_EQUAL_INT(3, pool->refCounts[second->blockTable[0]]);
+    TEST_ASSERT_EQUAL_INT(0, kv_cache_append(third, 0, &K[2], &K[2], 1));
+    kv_cache_commit(third, 1);
+    TEST_ASSERT_EQUAL_FLOAT_ARRAY(rows[2], kv_cache_key(third, 0, 2), width);
+
+    kv_cache_free(second);
+    kv_cache_free(third);
+    kv_prefix_cache_free(prefix);
+    TEST_ASSERT_EQUAL_INT(4, pool->numFree);
+    kv_pool_free(pool);
+}
+
+void test_kv_prefix_cache_eviction(void)
+{
+    float row[2] = {1, 2};
+    float *K[] = {row, row, row, row};
+    int a[4] = {1, 2, 3, 4};
+    int b[4] = {5, 6, 7, 8};
+    KVBlockPool *pool = kv_pool_create(1, 4, 2, 1, 2, KV_FLOAT32);
+    KVPrefixCache *prefix = kv_prefix_cache_create(pool);
+
+    KVCache *cache = kv_cache_create(pool);
+    TEST_ASSERT_EQUAL_INT(0, kv_cache_append(cache, 0, K, K, 4));
+    kv_cache_commit(cache, 4);
+    kv_prefix_insert(prefix, cache, a, 4);
+    kv_cache_reset(cache);
+    TEST_ASSERT_EQUAL_INT(0, kv_cache_append(cache, 0, K, K, 4));
+    kv_cache_commit(cache, 4);
+    kv_prefix_insert(prefix, cache, b, 4);
+    kv_cache_reset(cache);
+    TEST_ASSERT_EQUAL_INT(0, pool->numFree);
+
+    // A holder pins prompt a's first block. Reserving then evicts the least recently used
+    // unheld entries, deepest first, until only the pinned block is left.
+    KVCache *holder = kv_cache_create(pool);
+    TEST_ASSERT_EQUAL_INT(2, kv_prefix_lookup(prefix, holder, a, 3));
+    TEST_ASSERT_EQUAL_INT(0, kv_cache_reserve(cache, 6));
+    TEST_ASSERT_EQUAL_INT(-1, kv_cache_reserve(cache, 8));
+
+    KVCache *probe = kv_cache_create(pool);
+    TEST_ASSERT_EQUAL_INT(0, kv_prefix_lookup(prefix, probe, b, 4));
+    kv_cache_free(cache);
+    TEST_ASSERT_EQUAL_INT(2, kv_prefix_lookup(prefix, probe, a, 4));
+
+    kv_cache_free(probe);
+    kv_cache_free(holder);
+    kv_prefix_cache_free(prefix);
+    TEST_ASSERT_EQUAL_INT(4, pool->numFree);
+    kv_pool_free(pool);
+}
+
+void test_kv_cache_fork_copy_on_write(void)
+{
+    float rows[4][2] = {{1, 1}, {2, 2}, {3, 3}, {4, 4}};
+    float *K[] = {rows[0], rows[1], rows[2], rows[3]};
+    KVBlockPool *pool = kv_pool_create(1, 4, 2, 1, 2, KV_FLOAT32);
+    KVCache *cache = kv_cache_create(pool);
+    TEST_ASSERT_EQUAL_INT(0, kv_cache_append(cache, 0, K, K, 3));
+    kv_cache_commit(cache, 3);
+
+    // The fork shares both blocks, including the partly filled one
+    KVCache *fork = kv_cache_fork(cache);
+    TEST_ASSERT_EQUAL_INT(3, fork->length);
+    TEST_ASSERT_EQUAL_INT(2, pool->numFree);
+    TEST_ASSERT_EQUAL_INT(2, pool->refCounts[cache->blockTable[1]]);
+
+    // Writing position 3 copies the partly filled block; the full one stays shared
+    TEST_ASSERT_EQUAL_INT(0, kv_cache_append(fork, 0, &K[3], &K[3], 1));
+    kv_cache_commit(fork, 1);
+    TEST_ASSERT_EQUAL_INT(1, pool->numFree);
+    TEST_ASSERT_EQUAL_INT(cache->blockTable[0], fork->blockTable[0]);
+    TEST_ASSERT_NOT_EQUAL(cache->blockTable[1], fork->blockTable[1]);
+    TEST_ASSERT_EQUAL_FLOAT_ARRAY(rows[2], kv_cache_key(fork, 0, 2), 2);
+    TEST_ASSERT_EQUAL_FLOAT_ARRAY(rows[3], kv_cache_key(fork, 0, 3), 2);
+
+    // The original writes its own position 3 in place
+    TEST_ASSERT_EQUAL_INT(0, kv_cache_append(cache, 0, &K[0], &K[0], 1));
+    kv_cache_commit(cache, 1);
+    TEST_ASSERT_EQUAL_FLOAT_ARRAY(rows[0], kv_cache_key(cache, 0, 3), 2);
+    TEST_ASSERT_EQUAL_FLOAT_ARRAY(rows[3], kv_cache_key(fork, 0, 3), 2);
+
+    kv_cache_free(cache);
+    kv_cache_free(fork);
+    TEST_ASSERT_EQUAL_INT(4, pool->numFree);
+    kv_pool_free(pool);
+}
@@ -0,0 +1,13 @@
+#ifndef TEST_KV_CACHE_H
+#define TEST_KV_CACHE_H
+
+void test_kv_cache_append_commit(void);
+void test_kv_cache_overflow(void);
+void test_kv_cache_int8(void);
+void test_kv_cache_half(void);
+void test_kv_cache_truncate(void);
+void test_kv_cache_fork_copy_on_write(void);
+void test_kv_prefix_cache_reuse(void);
+void test_kv_prefix_cache_eviction(void);
+
+#endif // TEST_KV_CACHE_H
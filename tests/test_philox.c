@@ -0,0 +1,54 @@
+#include "unity/unity.h"
+#include "../utils/philox.h"
+#include "test_philox.h"
+
+// Known-answer vectors from the Random123 distribution
+void test_philox_known_answers(void)
+{
+    uint32_t output[4];
+
+    uint32_t zeroCounter[4] = {0, 0, 0, 0};
+    uint32_t zeroKey[2] = {0, 0};
+    uint32_t zeroExpected[4] = {0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8};
+    philox4x32(zeroCounter, zeroKey, output);
+    TEST_ASSERT_EQUAL_HEX32_ARRAY(zeroExpected, output, 4);
+
+    uint32_t onesCounter[4] = {0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff};
+    uint32_t onesKey[2] = {0xffffffff, 0xffffffff};
+    uint32_t onesExpected[4] = {0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd};
+    philox4x32(onesCounter, onesKey, output);
+    TEST_ASSERT_EQUAL_HEX32_ARRAY(onesExpected, output, 4);
+
+    uint32_t piCounter[4] = {0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344};
+    uint32_t piKey[2] = {0xa4093822, 0x299f31d0};
+    uint32_t piExpected[4] = {0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1};
+    philox4x32(piCounter, piKey, output);
+    TEST_ASSERT_EQUAL_HEX32_ARRAY(piExpected, output, 4);
+}
+
+// Any slice of a stream matches the same elements generated in one call
+void test_philox_fill_offsets(void)
+{
+    float whole[103];
+    float pieces[103];
+    philox_fill_uniform(whole, 103, 7, 3, 0, -1.0f, 1.0f);
+    philox_fill_uniform(pieces, 5, 7, 3, 0, -1.0f, 1.0f);
+    philox_fill_uniform(pieces + 5, 2, 7, 3, 5, -1.0f, 1.0f);
+    philox_fill_uniform(pieces + 7, 96, 7, 3, 7, -1.0f, 1.0f);
+    TEST_ASSERT_EQUAL_FLOAT_ARRAY(whole, pieces, 103);
+
+    for (int i = 0; i < 103; i++)
+    {
+        TEST_ASSERT_TRUE(whole[i] >= -1.0f && whole[i] < 1.0f);
+    }
+
+    // Different streams are independent
+    float other[103];
+    philox_fill_uniform(other, 103, 7, 4, 0, -1.0f, 1.0f);
+    int same = 0;
+    for (int i = 0; i < 103; i++)
+    {
+        same += (other[i] == whole[i]);
+    }
+    TEST_ASSERT_TRUE(same < 5);
+}
@@ -0,0 +1,7 @@
+#ifndef TEST_PHILOX_H
+#define TEST_PHILOX_H
+
+void test_philox_known_answers(void);
+void test_philox_fill_offsets(void);
+
+#endif // TEST_PHILOX_H
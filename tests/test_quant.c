@@ -0,0 +1,300 @@
+#include "unity/unity.h"
+#include "../kernel/kernel.h"
+#include "test_quant.h"
+
+static float **random_weights(int rows, int cols)
+{
+    float **weights = (float **)malloc(rows * sizeof(float *));
+    for (int i = 0; i < rows; i++)
+    {
+        weights[i] = (float *)malloc(cols * sizeof(float));
+        for (int j = 0; j < cols; j++)
+        {
+            weights[i][j] = (float)rand() / RAND_MAX * 2.0f - 1.0f;
+        }
+    }
+    return weights;
+}
+
+static void free_weights(float **weights, int rows)
+{
+    for (int i = 0; i < rows; i++)
+    {
+        free(weights[i]);
+    }
+    free(weights);
+}
+
+static float reference_dot(const float *x, const float *w, int n)
+{
+    float sum = 0.0f;
+    for (int j = 0; j < n; j++)
+    {
+        sum += x[j] * w[j];
+    }
+    return sum;
+}
+
+void test_quantize_int8(void)
+{
+    int rows = 5, cols = 64;
+    float **weights = random_weights(rows, cols);
+
+    int groupSizes[2] = {0, 16};
+    for (int s = 0; s < 2; s++)
+    {
+        QuantizedMatrix *q = quantize_int8(weights, rows, cols, groupSizes[s]);
+        TEST_ASSERT_NOT_NULL(q);
+        TEST_ASSERT_EQUAL_INT(groupSizes[s] ? cols / groupSizes[s] : 1, q->numGroups);
+
+        // Every weight is reconstructed within half a quantization step
+        for (int i = 0; i < rows; i++)
+        {
+            for (int j = 0; j < cols; j++)
+            {
+                float scale = q->scales[i * q->numGroups + j / q->groupSize];
+                TEST_ASSERT_FLOAT_WITHIN(scale * 0.5f + 1e-6f, weights[i][j], q->data[i * cols + j] * scale);
+            }
+        }
+        quantized_matrix_free(q);
+    }
+
+    TEST_ASSERT_NULL(quantize_int8(weights, rows, cols, 24));
+    free_weights(weights, rows);
+}
+
+void test_linear_int8(void)
+{
+    int rows = 37, cols = 128;
+    float **weights = random_weights(rows, cols);
+    float **input = random_weights(1, cols);
+    float biases[37];
+    for (int i = 0; i < rows; i++)
+    {
+        biases[i] = 0.1f * i;
+    }
+
+    int groupSizes[3] = {0, 32, 64};
+    for (int s = 0; s < 3; s++)
+    {
+        QuantizedMatrix *q = quantize_int8(weights, rows, cols, groupSizes[s]);
+        float *output = linear_quantized(input[0], q, biases);
+        for (int i = 0; i < rows; i++)
+        {
+            TEST_ASSERT_FLOAT_WITHIN(0.05f, reference_dot(input[0], weights[i], cols) + biases[i], output[i]);
+        }
+        free(output);
+        quantized_matrix_free(q);
+    }
+
+    free_weights(weights, rows);
+    free_weights(input, 1);
+}
+
+// A view over offline-quantized tensors computes what the owning matrix does, and freeing it
+// leaves the arrays to their owner
+void test_quantized_matrix_view_int8(void)
+{
+    int rows = 13, cols = 64;
+    float **weights = random_weights(rows, cols);
+    float **input = random_weights(1, cols);
+    QuantizedMatrix *owned = quantize_int8(weights, rows, cols, 0);
+    QuantizedMatrix *view = quantized_matrix_view_int8(owned->data, owned->scales, rows, cols);
+
+    float *expected = linear_quantized(input[0], owned, NULL);
+    float *output = linear_quantized(input[0], view, NULL);
+    TEST_ASSERT_EQUAL_FLOAT_ARRAY(expected, output, rows);
+    quantized_matrix_free(view);
+
+    free(expected);
+    free(output);
+    quantized_matrix_free(owned);
+    free_weights(weights, rows);
+    free_weights(input, 1);
+}
+
+// The batched path gives the same result as one GEMV per input, including a partial tile
+void test_linear_quantized_rows(void)
+{
+    int rows = 19, cols = 96, numInputs = 7;
+    float **weights = random_weights(rows, cols);
+    float **inputs = random_weights(numInputs, cols);
+    QuantizedMatrix *formats[2] = {quantize_int8(weights, rows, cols, 32), quantize_int4(weights, rows, cols, 32)};
+
+    for (int f = 0; f < 2; f++)
+    {
+        float **outputs = linear_quantized_rows(inputs, numInputs, formats[f], NULL);
+        for (int t = 0; t < numInputs; t++)
+        {
+            float *expected = linear_quantized(inputs[t], formats[f], NULL);
+            TEST_ASSERT_FLOAT_ARRAY_WITHIN(1e-4f, expected, outputs[t], rows);
+            free(expected);
+        }
+        free_weights(outputs, numInputs);
+        quantized_matrix_free(formats[f]);
+    }
+
+    free_weights(inputs, numInputs);
+    free_weights(weights, rows);
+}
+
+void test_quantize_int4(void)
+{
+    int rows = 6, cols = 128;
+    float **weights = random_weights(rows, cols);
+    weights[2][5] = 3.0f; // an outlier only widens its own group
+
+    int groupSizes[3] = {32, 64, 128};
+    for (int s = 0; s < 3; s++)
+    {
+        QuantizedMatrix *q = quantize_int4(weights, rows, cols, groupSizes[s]);
+        TEST_ASSERT_NOT_NULL(q);
+        TEST_ASSERT_EQUAL_INT(QUANT_INT4, q->type);
+        TEST_ASSERT_EQUAL_INT(cols / groupSizes[s], q->numGroups);
+
+        // Dequantize through the GEMV with unit vectors: output i = w[i][j]
+        float *unit = (float *)calloc(cols, sizeof(float));
+        for (int j = 0; j < cols; j++)
+        {
+            unit[j] = 1.0f;
+            float *column = linear_quantized(unit, q, NULL);
+            for (int i = 0; i < rows; i++)
+            {
+                float range = (i == 2 && j / groupSizes[s] == 0) ? 4.0f : 2.0f;
+                TEST_ASSERT_FLOAT_WITHIN(range / 15.0f * 0.5f + 2e-3f, weights[i][j], column[i]);
+            }
+            free(column);
+            unit[j] = 0.0f;
+        }
+        free(unit);
+        quantized_matrix_free(q);
+    }
+
+    TEST_ASSERT_NULL(quantize_int4(weights, rows, cols, 48));
+    free_weights(weights, rows);
+}
+
+void test_linear_int4(void)
+{
+    int rows = 41, cols = 256;
+    float **weights = random_weights(rows, cols);
+    float **input = random_weights(1, cols);
+    float biases[41];
+    for (int i = 0; i < rows; i++)
+    {
+        biases[i] = -0.05f * i;
+    }
+
+    float bound = 0.0f;
+    for (int j = 0; j < cols; j++)
+    {
+        bound += fabsf(input[0][j]) * (1.0f / 15.0f + 2e-3f);
+    }
+
+    int groupSizes[3] = {32, 64, 128};
+    for (int s = 0; s < 3; s++)
+    {
+        QuantizedMatrix *q = quantize_int4(weights, rows, cols, groupSizes[s]);
+        float *output = linear_quantized(input[0], q, biases);
+        for (int i = 0; i < rows; i++)
+        {
+            // Each weight is off by at most half a step of a range <= 2
+            TEST_ASSERT_FLOAT_WITHIN(bound, reference_dot(input[0], weights[i], cols) + biases[i], output[i]);
+        }
+        free(output);
+        quantized_matrix_free(q);
+    }
+
+    free_weights(weights, rows);
+    free_weights(input, 1);
+}
+
+// Greedy fused selection over quantized weights picks the argmax of the quantized logits
+void test_linear_select_quantized(void)
+{
+    int rows = 2 * SELECT_CHUNK_ROWS + 3, cols = 64;
+    float **weights = random_weights(rows, cols);
+    float **input = random_weights(1, cols);
+    QuantizedMatrix *q = quantize_int4(weights, rows, cols, 32);
+
+    float *logits = linear_quantized(input[0], q, NULL);
+    int expected = 0;
+    for (int i = 1; i < rows; i++)
+    {
+        expected = (logits[i] > logits[expected]) ? i : expected;
+    }
+
+    SamplerConfig config = {0.0f, 0, 1.0f, 1.0f, 1};
+    TokenSelector selector;
+    selector_init(&selector, &config, rows, NULL, 0);
+    linear_select_quantized(input[0], q, NULL, &selector);
+    TEST_ASSERT_EQUAL_INT(expected, selector_sample(&selector, &config));
+    selector_free(&selector);
+
+    free(logits);
+    quantized_matrix_free(q);
+    free_weights(weights, rows);
+    free_weights(input, 1);
+}
+
+void test_quantize_activations(void)
+{
+    int numInputs = 3, cols = 50;
+    float **inputs = random_weights(numInputs, cols);
+    QuantizedActivations *q = quantize_activations(inputs, numInputs, cols);
+
+    for (int t = 0; t < numInputs; t++)
+    {
+        for (int j = 0; j < cols; j++)
+        {
+            TEST_ASSERT_TRUE(q->data[t * cols + j] >= -127);
+            TEST_ASSERT_FLOAT_WITHIN(q->scales[t] * 0.5f + 1e-6f, inputs[t][j], q->data[t * cols + j] * q->scales[t]);
+        }
+    }
+
+    quantized_activations_free(q);
+    free_weights(inputs, numInputs);
+}
+
+// The integer GEMM matches the fp32 product of the dequantized operands, for per-channel and
+// group-wise weights, SIMD-sized and ragged rows, and full and partial token tiles
+void test_linear_int8_gemm(void)
+{
+    int rows = 23, numInputs = 6;
+    int shapes[3][2] = {{192, 0}, {128, 32}, {40, 8}};
+    float biases[23];
+    for (int i = 0; i < rows; i++)
+    {
+        biases[i] = 0.01f * i;
+    }
+
+    for (int s = 0; s < 3; s++)
+    {
+        int cols = shapes[s][0];
+        float **weights = random_weights(rows, cols);
+        float **inputs = random_weights(numInputs, cols);
+        QuantizedMatrix *w = quantize_int8(weights, rows, cols, shapes[s][1]);
+        QuantizedActivations *x = quantize_activations(inputs, numInputs, cols);
+
+        float **outputs = linear_int8_gemm(x, w, biases);
+        for (int t = 0; t < numInputs; t++)
+        {
+            for (int i = 0; i < rows; i++)
+            {
+                float expected = biases[i];
+                for (int j = 0; j < cols; j++)
+                {
+                    float wq = w->data[i * cols + j] * w->scales[i * w->numGroups + j / w->groupSize];
+                    expected += wq * x->data[t * cols + j] * x->scales[t];
+                }
+                TEST_ASSERT_FLOAT_WITHIN(1e-3f, expected, outputs[t][i]);
+            }
+        }
+
+        free_weights(outputs, numInputs);
+        quantized_activations_free(x);
+        quantized_matrix_free(w);
+        free_weights(inputs, numInputs);
+        free_weights(weights, rows);
+    }
+}
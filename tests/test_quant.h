@@ -0,0 +1,14 @@
+#ifndef TEST_QUANT_H
+#define TEST_QUANT_H
+
+void test_quantize_int8(void);
+void test_linear_int8(void);
+void test_quantized_matrix_view_int8(void);
+void test_linear_quantized_rows(void);
+void test_quantize_int4(void);
+void test_linear_int4(void);
+void test_linear_select_quantized(void);
+void test_quantize_activations(void);
+void test_linear_int8_gemm(void);
+
+#endif // TEST_QUANT_H
@@ -0,0 +1,230 @@
+#include "unity/unity.h"
+#include "../kernel/kernel.h"
+#include "test_sampling.h"
+
+static float *random_logits(int size)
+{
+    float *logits = (float *)malloc(size * sizeof(float));
+    for (int i = 0; i < size; i++)
+    {
+        logits[i] = (float)rand() / RAND_MAX * 10.0f - 5.0f;
+    }
+    return logits;
+}
+
+void test_sample_greedy(void)
+{
+    int size = 1003;
+    float *logits = random_logits(size);
+    logits[517] = 6.0f;
+
+    SamplerConfig config = {0.0f, 0, 1.0f, 1.0f, 1};
+    TEST_ASSERT_EQUAL_INT(517, sample_logits(logits, size, &config, NULL, 0));
+
+    // top_k = 1 with any temperature is also the argmax
+    SamplerConfig top1 = {0.8f, 1, 1.0f, 1.0f, 1};
+    TEST_ASSERT_EQUAL_INT(517, sample_logits(logits, size, &top1, NULL, 0));
+
+    free(logits);
+}
+
+void test_sample_top_k(void)
+{
+    int size = 500;
+    float *logits = random_logits(size);
+    logits[3] = 9.0f;
+    logits[250] = 8.5f;
+    logits[499] = 8.0f;
+
+    // Every sample must come from the three largest logits
+    SamplerConfig config = {1.0f, 3, 1.0f, 1.0f, 7};
+    int seen[3] = {0, 0, 0};
+    for (int t = 0; t < 300; t++)
+    {
+        int token = sample_logits(logits, size, &config, NULL, 0);
+        TEST_ASSERT_TRUE(token == 3 || token == 250 || token == 499);
+        seen[token == 3 ? 0 : (token == 250 ? 1 : 2)]++;
+    }
+    TEST_ASSERT_TRUE(seen[0] > seen[2]);
+    TEST_ASSERT_TRUE(seen[2] > 0);
+
+    free(logits);
+}
+
+void test_sample_top_p(void)
+{
+    int size = 1000;
+    float *logits = (float *)calloc(size, sizeof(float));
+    logits[42] = 20.0f; // holds almost all of the probability mass
+
+    SamplerConfig config = {1.0f, 0, 0.9f, 1.0f, 3};
+    for (int t = 0; t < 50; t++)
+    {
+        TEST_ASSERT_EQUAL_INT(42, sample_logits(logits, size, &config, NULL, 0));
+    }
+
+    // With the whole distribution allowed, other tokens appear
+    logits[42] = 0.0f;
+    SamplerConfig full = {1.0f, 0, 1.0f, 1.0f, 3};
+    int distinct = 0;
+    int previous = -1;
+    for (int t = 0; t < 20; t++)
+    {
+        int token = sample_logits(logits, size, &full, NULL, 0);
+        TEST_ASSERT_TRUE(token >= 0 && token < size);
+        distinct += (token != previous);
+        previous = token;
+    }
+    TEST_ASSERT_TRUE(distinct > 1);
+
+    free(logits);
+}
+
+void test_sample_repetition_penalty(void)
+{
+    float logits[] = {1.0f, 3.0f, 2.5f, -1.0f};
+    int history[] = {1, 1};
+
+    SamplerConfig config = {0.0f, 0, 1.0f, 1.0f, 1};
+    TEST_ASSERT_EQUAL_INT(1, sample_logits(logits, 4, &config, history, 2));
+
+    // 3.0 / 1.5 = 2.0 drops below token 2
+    config.repetition_penalty = 1.5f;
+    TEST_ASSERT_EQUAL_INT(2, sample_logits(logits, 4, &config, history, 2));
+}
+
+void test_selector_merge_slices(void)
+{
+    // Pushing the logits as independent slices and merging must match a single pass
+    int size = 2000;
+    float *logits = random_logits(size);
+    SamplerConfig config = {0.7f, 20, 0.95f, 1.0f, 11};
+    SamplerConfig single = config;
+
+    TokenSelector whole;
+    selector_init(&whole, &single, size, NULL, 0);
+    selector_push(&whole, logits, 0, size);
+    int expected = selector_sample(&whole, &single);
+
+    TokenSelector merged;
+    selector_init(&merged, &config, size, NULL, 0);
+    for (int start = 0; start < size; start += 300)
+    {
+        int count = (size - start < 300) ? size - start : 300;
+        TokenSelector part;
+        selector_init_like(&part, &merged);
+        selector_push(&part, &logits[start], start, count);
+        selector_merge(&merged, &part);
+        selector_free(&part);
+    }
+    TEST_ASSERT_EQUAL_INT(expected, selector_sample(&merged, &config));
+
+    selector_free(&whole);
+    selector_free(&merged);
+    free(logits);
+}
+
+void test_selector_top_k(void)
+{
+    // Log-probabilities of the best tokens, in order, over a softmax of every pushed slice
+    float logits[6] = {1.0f, 3.0f, -2.0f, 2.0f, 0.5f, 3.0f};
+    TokenSelector selector;
+    selector_init_top_k(&selector, 3);
+    selector_push(&selector, logits, 0, 4);
+    selector_push(&selector, &logits[4], 4, 2);
+
+    int tokens[3];
+    float logprobs[3];
+    TEST_ASSERT_EQUAL_INT(3, selector_top_k(&selector, tokens, logprobs));
+    double sum = 0.0;
+    for (int i = 0; i < 6; i++)
+    {
+        sum += exp(logits[i]);
+    }
+    int expected[3] = {1, 5, 3};
+    TEST_ASSERT_EQUAL_INT_ARRAY(expected, tokens, 3);
+    TEST_ASSERT_FLOAT_WITHIN(1e-5f, 3.0f - (float)log(sum), logprobs[0]);
+    TEST_ASSERT_FLOAT_WITHIN(1e-5f, 3.0f - (float)log(sum), logprobs[1]);
+    TEST_ASSERT_FLOAT_WITHIN(1e-5f, 2.0f - (float)log(sum), logprobs[2]);
+
+    selector_free(&selector);
+}
+
+void test_linear_select(void)
+{
+    // The fused projection must select the same token as linear() followed by sampling
+    int inputSize = 37;
+    int outputSize = 3 * SELECT_CHUNK_ROWS + 5;
+    float *input = random_logits(inputSize);
+    float *biases = random_logits(outputSize);
+    float **weights = (float **)malloc(outputSize * sizeof(float *));
+    for (int i = 0; i < outputSize; i++)
+    {
+        weights[i] = random_logits(inputSize);
+    }
+    float *logits = linear(input, weights, biases, inputSize, outputSize);
+
+    SamplerConfig configs[] = {{0.0f, 0, 1.0f, 1.0f, 5}, {0.9f, 0, 1.0f, 1.0f, 5}, {0.9f, 40, 0.9f, 1.0f, 5}};
+    for (int c = 0; c < 3; c++)
+    {
+        SamplerConfig reference = configs[c];
+        int expected = sample_logits(logits, outputSize, &reference, NULL, 0);
+
+        TokenSelector selector;
+        selector_init(&selector, &configs[c], outputSize, NULL, 0);
+        linear_select(input, weights, biases, inputSize, outputSize, &selector);
+        TEST_ASSERT_EQUAL_INT(expected, selector_sample(&selector, &configs[c]));
+        selector_free(&selector);
+    }
+
+    for (int i = 0; i < outputSize; i++)
+    {
+        free(weights[i]);
+    }
+    free(weights);
+    free(input);
+    free(biases);
+    free(logits);
+}
+
+void test_linear_select_rows(void)
+{
+    // Every input of a batch selects what linear_select picks for it alone
+    int inputSize = 24;
+    int outputSize = 2 * SELECT_CHUNK_ROWS + SELECT_BATCH_ROWS / 2;
+    int numInputs = 3;
+    float *biases = random_logits(outputSize);
+    float **weights = (float **)malloc(outputSize * sizeof(float *));
+    for (int i = 0; i < outputSize; i++)
+    {
+        weights[i] = random_logits(inputSize);
+    }
+    float *inputs[3];
+    TokenSelector selectors[3];
+    SamplerConfig configs[] = {{0.0f, 0, 1.0f, 1.0f, 7}, {0.8f, 0, 1.0f, 1.0f, 7}, {0.8f, 20, 0.9f, 1.0f, 7}};
+    for (int t = 0; t < numInputs; t++)
+    {
+        inputs[t] = random_logits(inputSize);
+        selector_init(&selectors[t], &configs[t], outputSize, NULL, 0);
+    }
+
+    linear_select_rows(inputs, numInputs, weights, biases, inputSize, outputSize, selectors);
+    for (int t = 0; t < numInputs; t++)
+    {
+        SamplerConfig reference = configs[t];
+        TokenSelector single;
+        selector_init(&single, &reference, outputSize, NULL, 0);
+        linear_select(inputs[t], weights, biases, inputSize, outputSize, &single);
+        TEST_ASSERT_EQUAL_INT(selector_sample(&single, &reference), selector_sample(&selectors[t], &configs[t]));
+        selector_free(&single);
+        selector_free(&selectors[t]);
+        free(inputs[t]);
+    }
+
+    for (int i = 0; i < outputSize; i++)
+    {
+        free(weights[i]);
+    }
+    free(weights);
+    free(biases);
+}
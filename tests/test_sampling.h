@@ -0,0 +1,13 @@
+#ifndef TEST_SAMPLING_H
+#define TEST_SAMPLING_H
+
+void test_sample_greedy(void);
+void test_sample_top_k(void);
+void test_sample_top_p(void);
+void test_sample_repetition_penalty(void);
+void test_selector_merge_slices(void);
+void test_selector_top_k(void);
+void test_linear_select(void);
+void test_linear_select_rows(void);
+
+#endif // TEST_SAMPLING_H
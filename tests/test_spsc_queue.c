@@ -0,0 +1,68 @@
+#include "unity/unity.h"
+#include "../utils/spsc_queue.h"
+#include "test_spsc_queue.h"
+#include <pthread.h>
+#include <stdint.h>
+
+void test_spsc_queue_order(void)
+{
+    SpscQueue *queue = spsc_queue_create(3); // rounded up to 4 slots
+    int items[6] = {0, 1, 2, 3, 4, 5};
+
+    TEST_ASSERT_NULL(spsc_queue_pop(queue));
+    for (int i = 0; i < 4; i++)
+    {
+        TEST_ASSERT_EQUAL_INT(0, spsc_queue_push(queue, &items[i]));
+    }
+    TEST_ASSERT_EQUAL_INT(-1, spsc_queue_push(queue, &items[4]));
+
+    // Pop two and push two more so the indices wrap around the ring
+    TEST_ASSERT_EQUAL_PTR(&items[0], spsc_queue_pop(queue));
+    TEST_ASSERT_EQUAL_PTR(&items[1], spsc_queue_pop(queue));
+    TEST_ASSERT_EQUAL_INT(0, spsc_queue_push(queue, &items[4]));
+    TEST_ASSERT_EQUAL_INT(0, spsc_queue_push(queue, &items[5]));
+    for (int i = 2; i < 6; i++)
+    {
+        TEST_ASSERT_EQUAL_PTR(&items[i], spsc_queue_pop(queue));
+    }
+    TEST_ASSERT_TRUE(spsc_queue_empty(queue));
+
+    spsc_queue_free(queue);
+}
+
+#define QUEUE_TEST_ITEMS 100000
+
+static void *produce(void *arg)
+{
+    SpscQueue *queue = (SpscQueue *)arg;
+    for (uintptr_t i = 1; i <= QUEUE_TEST_ITEMS; i++)
+    {
+        while (spsc_queue_push(queue, (void *)i) != 0)
+        {
+        }
+    }
+    return NULL;
+}
+
+void test_spsc_queue_threads(void)
+{
+    // A small ring forces the producer to wait on the consumer many times
+    SpscQueue *queue = spsc_queue_create(16);
+    pthread_t producer;
+    pthread_create(&producer, NULL, produce, queue);
+
+    uintptr_t expected = 1;
+    while (expected <= QUEUE_TEST_ITEMS)
+    {
+        void *item = spsc_queue_pop(queue);
+        if (item == NULL)
+            continue;
+        if ((uintptr_t)item != expected)
+            break;
+        expected++;
+    }
+    TEST_ASSERT_EQUAL_UINT64(QUEUE_TEST_ITEMS + 1, expected);
+
+    pthread_join(producer, NULL);
+    spsc_queue_free(queue);
+}
@@ -0,0 +1,7 @@
+#ifndef TEST_SPSC_QUEUE_H
+#define TEST_SPSC_QUEUE_H
+
+void test_spsc_queue_order(void);
+void test_spsc_queue_threads(void);
+
+#endif // TEST_SPSC_QUEUE_H
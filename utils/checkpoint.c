@@ -0,0 +1,225 @@
+#include "checkpoint.h"
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static uint64_t align_up(uint64_t value)
+{
+    return (value + CHECKPOINT_ALIGNMENT - 1) & ~(uint64_t)(CHECKPOINT_ALIGNMENT - 1);
+}
+
+// A table entry is usable in place when its dtype and rank are known, its data starts on an
+// alignment boundary inside the file, and its byte size matches its shape exactly
+static int tensor_valid(const CheckpointTensor *tensor, uint64_t fileSize)
+{
+    if (tensor->dtype > CHECKPOINT_BFLOAT16 || tensor->ndim < 1 || tensor->ndim > CHECKPOINT_MAX_DIMS ||
+        tensor->offset % CHECKPOINT_ALIGNMENT != 0 || tensor->offset > fileSize || tensor->size > fileSize - tensor->offset)
+    {
+        return 0;
+    }
+    uint64_t expected = checkpoint_dtype_size((CheckpointDType)tensor->dtype);
+    for (uint32_t d = 0; d < tensor->ndim; d++)
+    {
+        // Every dimension is below 2^32, so a product that would overflow already exceeds the file
+        if (tensor->shape[d] != 0 && expected > fileSize / tensor->shape[d])
+            return 0;
+        expected *= tensor->shape[d];
+    }
+    return expected == tensor->size;
+}
+
+// Map a checkpoint read-only. Nothing is copied: pages are faulted in on first use and shared
+// with every other process mapping the same file.
+Checkpoint *checkpoint_open(const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        fprintf(stderr, "Error: Unable to open checkpoint %s\n", path);
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(CheckpointHeader))
+    {
+        fprintf(stderr, "Error: Invalid checkpoint %s\n", path);
+        close(fd);
+        return NULL;
+    }
+
+    void *base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+    {
+        fprintf(stderr, "Error: Unable to map checkpoint %s\n", path);
+        return NULL;
+    }
+
+    const CheckpointHeader *header = (const CheckpointHeader *)base;
+    size_t tableEnd = sizeof(CheckpointHeader) + (size_t)header->numTensors * sizeof(CheckpointTensor);
+    if (header->magic != CHECKPOINT_MAGIC || header->version != CHECKPOINT_VERSION || tableEnd > (size_t)st.st_size)
+    {
+        fprintf(stderr, "Error: %s is not a version %d checkpoint\n", path, CHECKPOINT_VERSION);
+        munmap(base, st.st_size);
+        return NULL;
+    }
+
+    const CheckpointTensor *tensors = (const CheckpointTensor *)((const char *)base + sizeof(CheckpointHeader));
+    for (uint32_t i = 0; i < header->numTensors; i++)
+    {
+        if (!tensor_valid(&tensors[i], (uint64_t)st.st_size))
+        {
+            fprintf(stderr, "Error: Tensor %.*s of %s is truncated or malformed\n", CHECKPOINT_NAME_LENGTH, tensors[i].name, path);
+            munmap(base, st.st_size);
+            return NULL;
+        }
+    }
+
+    Checkpoint *checkpoint = (Checkpoint *)malloc(sizeof(Checkpoint));
+    checkpoint->base = base;
+    checkpoint->length = st.st_size;
+    checkpoint->header = header;
+    checkpoint->tensors = tensors;
+    return checkpoint;
+}
+
+void checkpoint_close(Checkpoint *checkpoint)
+{
+    munmap(checkpoint->base, checkpoint->length);
+    free(checkpoint);
+}
+
+const CheckpointTensor *checkpoint_find(const Checkpoint *checkpoint, const char *name)
+{
+    for (uint32_t i = 0; i < checkpoint->header->numTensors; i++)
+    {
+        if (strncmp(checkpoint->tensors[i].name, name, CHECKPOINT_NAME_LENGTH) == 0)
+        {
+            return &checkpoint->tensors[i];
+        }
+    }
+    return NULL;
+}
+
+void *checkpoint_data(const Checkpoint *checkpoint, const CheckpointTensor *tensor)
+{
+    return (char *)checkpoint->base + tensor->offset;
+}
+
+size_t checkpoint_dtype_size(CheckpointDType dtype)
+{
+    switch (dtype)
+    {
+    case CHECKPOINT_INT8:
+    case CHECKPOINT_UINT8:
+        return 1;
+    case CHECKPOINT_FLOAT16:
+    case CHECKPOINT_BFLOAT16:
+        return 2;
+    default:
+        return 4;
+    }
+}
+
+CheckpointWriter *checkpoint_writer_create(const char *path)
+{
+    FILE *file = fopen(path, "wb");
+    if (file == NULL)
+    {
+        fprintf(stderr, "Error: Unable to create checkpoint %s\n", path);
+        return NULL;
+    }
+
+    CheckpointWriter *writer = (CheckpointWriter *)malloc(sizeof(CheckpointWriter));
+    writer->file = file;
+    writer->numTensors = 0;
+    writer->maxTensors = 64;
+    writer->tensors = (CheckpointTensor *)malloc(writer->maxTensors * sizeof(CheckpointTensor));
+    writer->data = (const void **)malloc(writer->maxTensors * sizeof(void *));
+    writer->rowCounts = (int *)malloc(writer->maxTensors * sizeof(int));
+    return writer;
+}
+
+// Queue a tensor; returns 0 on success, -1 on an invalid name or shape
+int checkpoint_writer_add(CheckpointWriter *writer, const char *name, CheckpointDType dtype, int ndim, const int *shape, const void *data)
+{
+    if (strlen(name) >= CHECKPOINT_NAME_LENGTH || ndim < 1 || ndim > CHECKPOINT_MAX_DIMS)
+        return -1;
+
+    if (writer->numTensors == writer->maxTensors)
+    {
+        writer->maxTensors *= 2;
+        writer->tensors = (CheckpointTensor *)realloc(writer->tensors, writer->maxTensors * sizeof(CheckpointTensor));
+        writer->data = (const void **)realloc(writer->data, writer->maxTensors * sizeof(void *));
+        writer->rowCounts = (int *)realloc(writer->rowCounts, writer->maxTensors * sizeof(int));
+    }
+
+    CheckpointTensor *tensor = &writer->tensors[writer->numTensors];
+    memset(tensor, 0, sizeof(CheckpointTensor));
+    strcpy(tensor->name, name);
+    tensor->dtype = dtype;
+    tensor->ndim = ndim;
+    tensor->size = checkpoint_dtype_size(dtype);
+    for (int d = 0; d < ndim; d++)
+    {
+        tensor->shape[d] = shape[d];
+        tensor->size *= shape[d];
+    }
+    writer->data[writer->numTensors] = data;
+    writer->rowCounts[writer->numTensors++] = 0;
+    return 0;
+}
+
+// Queue a rows x cols float32 matrix stored as separately allocated rows
+int checkpoint_writer_add_rows(CheckpointWriter *writer, const char *name, int rows, int cols, float **data)
+{
+    int shape[2] = {rows, cols};
+    if (checkpoint_writer_add(writer, name, CHECKPOINT_FLOAT32, 2, shape, data) != 0)
+        return -1;
+    writer->rowCounts[writer->numTensors - 1] = rows;
+    return 0;
+}
+
+// Lay out and write every queued tensor, then close the file. Returns 0 on success.
+int checkpoint_writer_close(CheckpointWriter *writer)
+{
+    CheckpointHeader header = {CHECKPOINT_MAGIC, CHECKPOINT_VERSION, (uint32_t)writer->numTensors, 0};
+    uint64_t offset = align_up(sizeof(CheckpointHeader) + writer->numTensors * sizeof(CheckpointTensor));
+    for (int i = 0; i < writer->numTensors; i++)
+    {
+        writer->tensors[i].offset = offset;
+        offset = align_up(offset + writer->tensors[i].size);
+    }
+
+    int ok = fwrite(&header, sizeof(header), 1, writer->file) == 1;
+    ok = ok && fwrite(writer->tensors, sizeof(CheckpointTensor), writer->numTensors, writer->file) == (size_t)writer->numTensors;
+
+    static const char padding[CHECKPOINT_ALIGNMENT] = {0};
+    for (int i = 0; i < writer->numTensors && ok; i++)
+    {
+        long position = ftell(writer->file);
+        ok = fwrite(padding, 1, writer->tensors[i].offset - position, writer->file) == writer->tensors[i].offset - position;
+        if (writer->rowCounts[i] > 0)
+        {
+            float **rows = (float **)writer->data[i];
+            size_t rowSize = writer->tensors[i].size / writer->rowCounts[i];
+            for (int r = 0; r < writer->rowCounts[i] && ok; r++)
+            {
+                ok = fwrite(rows[r], 1, rowSize, writer->file) == rowSize;
+            }
+        }
+        else
+        {
+            ok = ok && fwrite(writer->data[i], 1, writer->tensors[i].size, writer->file) == writer->tensors[i].size;
+        }
+    }
+
+    ok = (fclose(writer->file) == 0) && ok;
+    free(writer->tensors);
+    free(writer->data);
+    free(writer->rowCounts);
+    free(writer);
+    return ok ? 0 : -1;
+}
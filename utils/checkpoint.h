@@ -0,0 +1,74 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+// Flat binary checkpoint: header, tensor table, then tensor data. Every tensor starts on a
+// CHECKPOINT_ALIGNMENT boundary so it can be used in place from a read-only mapping.
+#define CHECKPOINT_MAGIC 0x32545047u // "GPT2"
+#define CHECKPOINT_VERSION 1
+#define CHECKPOINT_ALIGNMENT 64
+#define CHECKPOINT_NAME_LENGTH 64
+#define CHECKPOINT_MAX_DIMS 4
+
+typedef enum
+{
+    CHECKPOINT_FLOAT32,
+    CHECKPOINT_INT8,
+    CHECKPOINT_UINT8,
+    CHECKPOINT_FLOAT16,
+    CHECKPOINT_BFLOAT16
+} CheckpointDType;
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t numTensors;
+    uint32_t reserved;
+} CheckpointHeader;
+
+typedef struct
+{
+    char name[CHECKPOINT_NAME_LENGTH];
+    uint32_t dtype;
+    uint32_t ndim;
+    uint32_t shape[CHECKPOINT_MAX_DIMS];
+    uint64_t offset; // bytes from the start of the file
+    uint64_t size;   // bytes
+} CheckpointTensor;
+
+// A checkpoint mapped read-only; tensor data points into the shared page cache
+typedef struct
+{
+    void *base;
+    size_t length;
+    const CheckpointHeader *header;
+    const CheckpointTensor *tensors;
+} Checkpoint;
+
+// Tensors queued for writing; data must stay valid until checkpoint_writer_close
+typedef struct
+{
+    FILE *file;
+    int numTensors;
+    int maxTensors;
+    CheckpointTensor *tensors;
+    const void **data; // contiguous data, or an array of row pointers when rowCounts[i] > 0
+    int *rowCounts;
+} CheckpointWriter;
+
+Checkpoint *checkpoint_open(const char *path);
+void checkpoint_close(Checkpoint *checkpoint);
+const CheckpointTensor *checkpoint_find(const Checkpoint *checkpoint, const char *name);
+void *checkpoint_data(const Checkpoint *checkpoint, const CheckpointTensor *tensor);
+
+size_t checkpoint_dtype_size(CheckpointDType dtype);
+CheckpointWriter *checkpoint_writer_create(const char *path);
+int checkpoint_writer_add(CheckpointWriter *writer, const char *name, CheckpointDType dtype, int ndim, const int *shape, const void *data);
+int checkpoint_writer_add_rows(CheckpointWriter *writer, const char *name, int rows, int cols, float **data);
+int checkpoint_writer_close(CheckpointWriter *writer);
+
+#endif // CHECKPOINT_H
@@ -0,0 +1,387 @@
+#include "convert.h"
+#include <string.h>
+#include <math.h>
+
+size_t convert_tensor_count(const ConvertTensor *tensor)
+{
+    size_t count = 1;
+    for (int d = 0; d < tensor->ndim; d++)
+    {
+        count *= tensor->shape[d];
+    }
+    return count;
+}
+
+static void set_name(ConvertTensor *tensor, const char *name)
+{
+    strncpy(tensor->name, name, CHECKPOINT_NAME_LENGTH - 1);
+    tensor->name[CHECKPOINT_NAME_LENGTH - 1] = '\0';
+}
+
+// Parse the shape tuple of a .npy header dictionary, e.g. "(768, 2304)" or "(50257,)"
+static int parse_npy_shape(const char *header, ConvertTensor *tensor)
+{
+    const char *p = strstr(header, "'shape'");
+    if (p == NULL || (p = strchr(p, '(')) == NULL)
+        return -1;
+
+    tensor->ndim = 0;
+    p++;
+    while (*p != ')' && *p != '\0')
+    {
+        char *end;
+        long dim = strtol(p, &end, 10);
+        if (end == p)
+        {
+            p++; // skip ',' and spaces
+            continue;
+        }
+        if (tensor->ndim == CHECKPOINT_MAX_DIMS || dim < 0)
+            return -1;
+        tensor->shape[tensor->ndim++] = (int)dim;
+        p = end;
+    }
+    return (*p == ')') ? 0 : -1;
+}
+
+// Read a NumPy .npy file (format 1.0-3.0) holding little-endian float32 or float64 data.
+// Fortran-ordered 2D arrays are transposed into row-major order on load.
+int load_npy(const char *path, ConvertTensor *tensor)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        fprintf(stderr, "Error: Unable to open %s\n", path);
+        return -1;
+    }
+
+    unsigned char preamble[10];
+    uint32_t headerLength = 0;
+    if (fread(preamble, 1, 8, file) != 8 || memcmp(preamble, "\x93NUMPY", 6) != 0)
+    {
+        fprintf(stderr, "Error: %s is not a .npy file\n", path);
+        fclose(file);
+        return -1;
+    }
+    if (preamble[6] == 1)
+    {
+        unsigned char length[2];
+        if (fread(length, 1, 2, file) == 2)
+            headerLength = length[0] | (length[1] << 8);
+    }
+    else
+    {
+        unsigned char length[4];
+        if (fread(length, 1, 4, file) == 4)
+            headerLength = length[0] | (length[1] << 8) | (length[2] << 16) | ((uint32_t)length[3] << 24);
+    }
+
+    char *header = (char *)calloc(headerLength + 1, 1);
+    int fortran = 0;
+    int wordSize = 0;
+    if (headerLength == 0 || fread(header, 1, headerLength, file) != headerLength || parse_npy_shape(header, tensor) != 0)
+    {
+        fprintf(stderr, "Error: Unable to parse the header of %s\n", path);
+        free(header);
+        fclose(file);
+        return -1;
+    }
+    if (strstr(header, "'<f4'") != NULL)
+        wordSize = 4;
+    else if (strstr(header, "'<f8'") != NULL)
+        wordSize = 8;
+    fortran = strstr(header, "'fortran_order': True") != NULL;
+    free(header);
+    if (wordSize == 0 || (fortran && tensor->ndim > 2))
+    {
+        fprintf(stderr, "Error: %s must hold little-endian float32/float64 data in C order\n", path);
+        fclose(file);
+        return -1;
+    }
+
+    size_t count = convert_tensor_count(tensor);
+    void *raw = malloc(count * wordSize);
+    if (fread(raw, wordSize, count, file) != count)
+    {
+        fprintf(stderr, "Error: %s is truncated\n", path);
+        free(raw);
+        fclose(file);
+        return -1;
+    }
+    fclose(file);
+
+    float *data = (float *)raw;
+    if (wordSize == 8)
+    {
+        data = (float *)malloc(count * sizeof(float));
+        for (size_t i = 0; i < count; i++)
+        {
+            data[i] = (float)((double *)raw)[i];
+        }
+        free(raw);
+    }
+
+    set_name(tensor, path);
+    tensor->dtype = CHECKPOINT_FLOAT32;
+    tensor->data = data;
+    if (fortran && tensor->ndim == 2)
+    {
+        // Column-major [a][b] is row-major [b][a]; transpose it back
+        int rows = tensor->shape[0];
+        tensor->shape[0] = tensor->shape[1];
+        tensor->shape[1] = rows;
+        convert_transpose(tensor);
+    }
+    return 0;
+}
+
+// Read a float dataset of any rank up to CHECKPOINT_MAX_DIMS
+int load_hdf5_dataset(hid_t file_id, const char *datasetname, ConvertTensor *tensor)
+{
+    hsize_t dims_out[CHECKPOINT_MAX_DIMS];
+    hid_t dataset_id = H5Dopen2(file_id, datasetname, H5P_DEFAULT);
+    if (dataset_id < 0)
+    {
+        fprintf(stderr, "Error: Unable to open dataset %s\n", datasetname);
+        return -1;
+    }
+
+    hid_t space_id = H5Dget_space(dataset_id);
+    int ndim = H5Sget_simple_extent_ndims(space_id);
+    if (ndim < 1 || ndim > CHECKPOINT_MAX_DIMS)
+    {
+        fprintf(stderr, "Error: Dataset %s has unsupported rank %d\n", datasetname, ndim);
+        H5Sclose(space_id);
+        H5Dclose(dataset_id);
+        return -1;
+    }
+    H5Sget_simple_extent_dims(space_id, dims_out, NULL);
+
+    tensor->ndim = ndim;
+    for (int d = 0; d < ndim; d++)
+    {
+        tensor->shape[d] = (int)dims_out[d];
+    }
+    tensor->dtype = CHECKPOINT_FLOAT32;
+    tensor->data = malloc(convert_tensor_count(tensor) * sizeof(float));
+    set_name(tensor, datasetname);
+
+    herr_t status = H5Dread(dataset_id, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT, tensor->data);
+    H5Sclose(space_id);
+    H5Dclose(dataset_id);
+    if (status < 0)
+    {
+        fprintf(stderr, "Error: Unable to read dataset %s\n", datasetname);
+        convert_tensor_free(tensor);
+        return -1;
+    }
+    return 0;
+}
+
+// Transpose a 2D float32 tensor, e.g. [in][out] HDF5 weights into the [out][in] rows the
+// GEMV kernels stream. A quantized tensor is rejected: its per-row scales would no longer
+// match the rows.
+int convert_transpose(ConvertTensor *tensor)
+{
+    if (tensor->ndim != 2 || tensor->dtype != CHECKPOINT_FLOAT32)
+        return -1;
+
+    int rows = tensor->shape[0];
+    int cols = tensor->shape[1];
+    size_t width = sizeof(float);
+    char *src = (char *)tensor->data;
+    char *dst = (char *)malloc((size_t)rows * cols * width);
+
+    // Tile so both the reads and the writes stay within a few cache lines
+    const int tile = 32;
+    for (int i0 = 0; i0 < rows; i0 += tile)
+    {
+        for (int j0 = 0; j0 < cols; j0 += tile)
+        {
+            for (int i = i0; i < i0 + tile && i < rows; i++)
+            {
+                for (int j = j0; j < j0 + tile && j < cols; j++)
+                {
+                    memcpy(dst + ((size_t)j * rows + i) * width, src + ((size_t)i * cols + j) * width, width);
+                }
+            }
+        }
+    }
+
+    free(tensor->data);
+    tensor->data = dst;
+    tensor->shape[0] = cols;
+    tensor->shape[1] = rows;
+    return 0;
+}
+
+static int compare_float(const void *a, const void *b)
+{
+    float x = *(const float *)a;
+    float y = *(const float *)b;
+    return (x > y) - (x < y);
+}
+
+// Magnitude pruning: zero the given fraction of smallest-magnitude float32 weights.
+// Returns the number of zeros in the result, or -1 on error.
+long convert_prune(ConvertTensor *tensor, float sparsity)
+{
+    if (tensor->dtype != CHECKPOINT_FLOAT32 || sparsity < 0.0f || sparsity > 1.0f)
+        return -1;
+
+    size_t count = convert_tensor_count(tensor);
+    size_t cut = (size_t)(sparsity * count);
+    float *data = (float *)tensor->data;
+    if (cut == 0)
+        return 0;
+
+    float *magnitudes = (float *)malloc(count * sizeof(float));
+    for (size_t i = 0; i < count; i++)
+    {
+        magnitudes[i] = fabsf(data[i]);
+    }
+    qsort(magnitudes, count, sizeof(float), compare_float);
+    float threshold = magnitudes[cut - 1];
+    free(magnitudes);
+
+    // Ties at the threshold are pruned only until the requested count is reached
+    long zeros = 0;
+    size_t ties = cut;
+    for (size_t i = 0; i < count; i++)
+    {
+        float magnitude = fabsf(data[i]);
+        if (magnitude < threshold)
+        {
+            data[i] = 0.0f;
+            ties--;
+        }
+    }
+    for (size_t i = 0; i < count && ties > 0; i++)
+    {
+        if (fabsf(data[i]) == threshold)
+        {
+            data[i] = 0.0f;
+            ties--;
+        }
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        zeros += (data[i] == 0.0f);
+    }
+    return zeros;
+}
+
+// Symmetric per-row int8 quantization of a float32 tensor viewed as [shape[0]][rest]:
+// w ~= q * scales[row] with q in [-127, 127]. The tensor becomes int8 in place and
+// scales receives a float32 [shape[0]] tensor named "<name>.scale".
+int convert_quantize_int8(ConvertTensor *tensor, ConvertTensor *scales)
+{
+    if (tensor->dtype != CHECKPOINT_FLOAT32 || tensor->ndim < 1)
+        return -1;
+
+    int rows = tensor->shape[0];
+    size_t cols = convert_tensor_count(tensor) / (rows > 0 ? rows : 1);
+    float *data = (float *)tensor->data;
+    int8_t *quantized = (int8_t *)malloc(convert_tensor_count(tensor));
+    float *rowScales = (float *)malloc(rows * sizeof(float));
+
+    for (int i = 0; i < rows; i++)
+    {
+        float *row = data + i * cols;
+        float maxAbs = 0.0f;
+        for (size_t j = 0; j < cols; j++)
+        {
+            maxAbs = fmaxf(maxAbs, fabsf(row[j]));
+        }
+        rowScales[i] = maxAbs / 127.0f;
+        float inverse = (maxAbs > 0.0f) ? 127.0f / maxAbs : 0.0f;
+        for (size_t j = 0; j < cols; j++)
+        {
+            quantized[i * cols + j] = (int8_t)lrintf(row[j] * inverse);
+        }
+    }
+
+    free(tensor->data);
+    tensor->data = quantized;
+    tensor->dtype = CHECKPOINT_INT8;
+
+    snprintf(scales->name, CHECKPOINT_NAME_LENGTH, "%.*s.scale", CHECKPOINT_NAME_LENGTH - 7, tensor->name);
+    scales->dtype = CHECKPOINT_FLOAT32;
+    scales->ndim = 1;
+    scales->shape[0] = rows;
+    scales->data = rowScales;
+    return 0;
+}
+
+void convert_tensor_free(ConvertTensor *tensor)
+{
+    free(tensor->data);
+    tensor->data = NULL;
+}
+
+static const char *dtype_name(uint32_t dtype)
+{
+    static const char *names[] = {"float32", "int8", "uint8", "float16", "bfloat16"};
+    return (dtype < sizeof(names) / sizeof(names[0])) ? names[dtype] : "unknown";
+}
+
+// Write at most length bytes of text as a JSON string, escaping quotes, backslashes and
+// control characters
+static void write_json_string(FILE *file, const char *text, size_t length)
+{
+    fputc('"', file);
+    for (size_t i = 0; i < length && text[i] != '\0'; i++)
+    {
+        unsigned char c = (unsigned char)text[i];
+        if (c == '"' || c == '\\')
+            fprintf(file, "\\%c", c);
+        else if (c < 0x20)
+            fprintf(file, "\\u%04x", c);
+        else
+            fputc(c, file);
+    }
+    fputc('"', file);
+}
+
+// Describe a written checkpoint as JSON: one entry per tensor with its dtype, shape, byte
+// range and an optional free-form note (e.g. source and applied transforms); notes may be NULL.
+int write_manifest(const char *checkpointPath, const char *manifestPath, const char **notes)
+{
+    Checkpoint *checkpoint = checkpoint_open(checkpointPath);
+    if (checkpoint == NULL)
+        return -1;
+
+    FILE *file = fopen(manifestPath, "w");
+    if (file == NULL)
+    {
+        fprintf(stderr, "Error: Unable to write manifest %s\n", manifestPath);
+        checkpoint_close(checkpoint);
+        return -1;
+    }
+
+    fprintf(file, "{\n  \"format\": \"gpt2-checkpoint\",\n  \"version\": %u,\n  \"alignment\": %d,\n  \"bytes\": %zu,\n  \"tensors\": [\n",
+            checkpoint->header->version, CHECKPOINT_ALIGNMENT, checkpoint->length);
+    for (uint32_t i = 0; i < checkpoint->header->numTensors; i++)
+    {
+        const CheckpointTensor *tensor = &checkpoint->tensors[i];
+        fprintf(file, "    {\"name\": ");
+        write_json_string(file, tensor->name, sizeof(tensor->name));
+        fprintf(file, ", \"dtype\": \"%s\", \"shape\": [", dtype_name(tensor->dtype));
+        for (uint32_t d = 0; d < tensor->ndim; d++)
+        {
+            fprintf(file, "%s%u", d ? ", " : "", tensor->shape[d]);
+        }
+        fprintf(file, "], \"offset\": %llu, \"size\": %llu", (unsigned long long)tensor->offset, (unsigned long long)tensor->size);
+        if (notes != NULL && notes[i] != NULL)
+        {
+            fprintf(file, ", \"note\": ");
+            write_json_string(file, notes[i], strlen(notes[i]));
+        }
+        fprintf(file, "}%s\n", (i + 1 < checkpoint->header->numTensors) ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+
+    int ok = fclose(file) == 0;
+    checkpoint_close(checkpoint);
+    return ok ? 0 : -1;
+}
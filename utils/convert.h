@@ -0,0 +1,32 @@
+#ifndef CONVERT_H
+#define CONVERT_H
+
+#include "checkpoint.h"
+#include "hdf5.h"
+
+// Offline conversion of trained parameters into checkpoint layouts, so the serving process
+// maps ready-to-use tensors instead of transposing or quantizing them at startup.
+
+// A contiguous row-major tensor being converted
+typedef struct
+{
+    char name[CHECKPOINT_NAME_LENGTH];
+    CheckpointDType dtype;
+    int ndim;
+    int shape[CHECKPOINT_MAX_DIMS];
+    void *data;
+} ConvertTensor;
+
+// Loaders return 0 on success; float64 sources are narrowed to float32
+int load_npy(const char *path, ConvertTensor *tensor);
+int load_hdf5_dataset(hid_t file_id, const char *datasetname, ConvertTensor *tensor);
+
+size_t convert_tensor_count(const ConvertTensor *tensor);
+int convert_transpose(ConvertTensor *tensor);
+long convert_prune(ConvertTensor *tensor, float sparsity);
+int convert_quantize_int8(ConvertTensor *tensor, ConvertTensor *scales);
+void convert_tensor_free(ConvertTensor *tensor);
+
+int write_manifest(const char *checkpointPath, const char *manifestPath, const char **notes);
+
+#endif // CONVERT_H
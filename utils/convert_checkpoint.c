@@ -0,0 +1,202 @@
+#include "convert.h"
+#include <string.h>
+
+// Offline checkpoint converter.
+//
+//   convert_checkpoint [-m manifest.json] [-f specs.txt] output.bin [spec ...]
+//
+// Each spec is name[:ops]=source, where source is file.npy or file.h5:/dataset and ops is a
+// comma-separated list applied left to right:
+//   t          transpose a 2D tensor (e.g. [in][out] -> [out][in])
+//   prune<f>   zero the smallest-magnitude fraction f of weights
+//   q8         symmetric per-row int8; also writes "<name>.scale". gptop maps such linear
+//              weights directly as per-output-channel int8 instead of quantizing at startup.
+//              t and prune work on float32 only, so q8 comes last.
+// e.g. h.0.q.weight:t,q8=model.h5:/h0/attn/q/kernel. A spec file holds one spec per line;
+// blank lines and lines starting with '#' are ignored.
+
+#define MAX_SPEC_LENGTH 1024
+
+typedef struct
+{
+    ConvertTensor *tensors;
+    char **notes;
+    int count;
+    int capacity;
+} TensorList;
+
+static ConvertTensor *list_push(TensorList *list, const char *note)
+{
+    if (list->count == list->capacity)
+    {
+        list->capacity = list->capacity ? list->capacity * 2 : 64;
+        list->tensors = (ConvertTensor *)realloc(list->tensors, list->capacity * sizeof(ConvertTensor));
+        list->notes = (char **)realloc(list->notes, list->capacity * sizeof(char *));
+    }
+    memset(&list->tensors[list->count], 0, sizeof(ConvertTensor));
+    list->notes[list->count] = strdup(note);
+    return &list->tensors[list->count++];
+}
+
+static int load_source(const char *source, ConvertTensor *tensor)
+{
+    const char *dataset = strstr(source, ".h5:");
+    if (dataset == NULL)
+    {
+        return load_npy(source, tensor);
+    }
+
+    char path[MAX_SPEC_LENGTH];
+    int pathLength = (int)(dataset - source) + 3;
+    snprintf(path, sizeof(path), "%.*s", pathLength, source);
+    hid_t file_id = H5Fopen(path, H5F_ACC_RDONLY, H5P_DEFAULT);
+    if (file_id < 0)
+    {
+        fprintf(stderr, "Error: Unable to open %s\n", path);
+        return -1;
+    }
+    int status = load_hdf5_dataset(file_id, dataset + 4, tensor);
+    H5Fclose(file_id);
+    return status;
+}
+
+static int apply_op(TensorList *list, int index, const char *op, const char *note)
+{
+    ConvertTensor *tensor = &list->tensors[index];
+    if ((strcmp(op, "t") == 0 || strncmp(op, "prune", 5) == 0) && tensor->dtype != CHECKPOINT_FLOAT32)
+    {
+        fprintf(stderr, "Error: %s must come before q8\n", op);
+        return -1;
+    }
+    if (strcmp(op, "t") == 0)
+    {
+        return convert_transpose(tensor);
+    }
+    if (strncmp(op, "prune", 5) == 0)
+    {
+        long zeros = convert_prune(tensor, strtof(op + 5, NULL));
+        if (zeros >= 0)
+            printf("  %s: %.1f%% zeros\n", tensor->name, 100.0 * zeros / convert_tensor_count(tensor));
+        return zeros >= 0 ? 0 : -1;
+    }
+    if (strcmp(op, "q8") == 0)
+    {
+        ConvertTensor scales;
+        if (convert_quantize_int8(tensor, &scales) != 0)
+            return -1;
+        // Pushing may move the list, so the tensor pointer is not used afterwards
+        *list_push(list, note) = scales;
+        return 0;
+    }
+    fprintf(stderr, "Error: Unknown op %s\n", op);
+    return -1;
+}
+
+static int convert_spec(TensorList *list, const char *spec)
+{
+    char buffer[MAX_SPEC_LENGTH];
+    snprintf(buffer, sizeof(buffer), "%s", spec);
+
+    char *source = strchr(buffer, '=');
+    if (source == NULL)
+    {
+        fprintf(stderr, "Error: Spec %s is not name[:ops]=source\n", spec);
+        return -1;
+    }
+    *source++ = '\0';
+    char *ops = strchr(buffer, ':');
+    if (ops != NULL)
+        *ops++ = '\0';
+
+    int index = list->count;
+    ConvertTensor *tensor = list_push(list, spec);
+    if (load_source(source, tensor) != 0)
+        return -1;
+    snprintf(tensor->name, CHECKPOINT_NAME_LENGTH, "%s", buffer);
+
+    for (char *op = ops ? strtok(ops, ",") : NULL; op != NULL; op = strtok(NULL, ","))
+    {
+        if (apply_op(list, index, op, spec) != 0)
+        {
+            fprintf(stderr, "Error: %s failed on %s\n", op, buffer);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int convert_spec_file(TensorList *list, const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+    {
+        fprintf(stderr, "Error: Unable to open %s\n", path);
+        return -1;
+    }
+
+    char line[MAX_SPEC_LENGTH];
+    int status = 0;
+    while (status == 0 && fgets(line, sizeof(line), file) != NULL)
+    {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] != '\0' && line[0] != '#')
+            status = convert_spec(list, line);
+    }
+    fclose(file);
+    return status;
+}
+
+int main(int argc, char **argv)
+{
+    const char *manifest = NULL;
+    const char *output = NULL;
+    TensorList list = {NULL, NULL, 0, 0};
+    int status = 0;
+
+    for (int i = 1; i < argc && status == 0; i++)
+    {
+        if (strcmp(argv[i], "-m") == 0 && i + 1 < argc)
+            manifest = argv[++i];
+        else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc)
+            status = convert_spec_file(&list, argv[++i]);
+        else if (output == NULL)
+            output = argv[i];
+        else
+            status = convert_spec(&list, argv[i]);
+    }
+    if (output == NULL || (status == 0 && list.count == 0))
+    {
+        fprintf(stderr, "Usage: %s [-m manifest.json] [-f specs.txt] output.bin [name[:ops]=source ...]\n", argv[0]);
+        status = -1;
+    }
+
+    if (status == 0)
+    {
+        CheckpointWriter *writer = checkpoint_writer_create(output);
+        status = (writer == NULL) ? -1 : 0;
+        for (int i = 0; i < list.count && status == 0; i++)
+        {
+            ConvertTensor *tensor = &list.tensors[i];
+            status = checkpoint_writer_add(writer, tensor->name, tensor->dtype, tensor->ndim, tensor->shape, tensor->data);
+        }
+        if (writer != NULL && checkpoint_writer_close(writer) != 0)
+            status = -1;
+    }
+    if (status == 0 && manifest != NULL)
+    {
+        status = write_manifest(output, manifest, (const char **)list.notes);
+    }
+    if (status == 0)
+    {
+        printf("Wrote %d tensors to %s.\n", list.count, output);
+    }
+
+    for (int i = 0; i < list.count; i++)
+    {
+        convert_tensor_free(&list.tensors[i]);
+        free(list.notes[i]);
+    }
+    free(list.tensors);
+    free(list.notes);
+    return status == 0 ? 0 : 1;
+}
@@ -0,0 +1,72 @@
+#include "philox.h"
+
+#define PHILOX_M0 0xD2511F53u
+#define PHILOX_M1 0xCD9E8D57u
+#define PHILOX_W0 0x9E3779B9u
+#define PHILOX_W1 0xBB67AE85u
+#define PHILOX_ROUNDS 10
+
+void philox4x32(const uint32_t counter[4], const uint32_t key[2], uint32_t output[4])
+{
+    uint32_t c0 = counter[0], c1 = counter[1], c2 = counter[2], c3 = counter[3];
+    uint32_t k0 = key[0], k1 = key[1];
+
+    for (int round = 0; round < PHILOX_ROUNDS; round++)
+    {
+        uint64_t p0 = (uint64_t)PHILOX_M0 * c0;
+        uint64_t p1 = (uint64_t)PHILOX_M1 * c2;
+        uint32_t n0 = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+        uint32_t n2 = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+        c1 = (uint32_t)p1;
+        c3 = (uint32_t)p0;
+        c0 = n0;
+        c2 = n2;
+        k0 += PHILOX_W0;
+        k1 += PHILOX_W1;
+    }
+
+    output[0] = c0;
+    output[1] = c1;
+    output[2] = c2;
+    output[3] = c3;
+}
+
+void philox_fill_uniform(float *output, size_t count, uint64_t seed, uint64_t stream, uint64_t offset, float low, float high)
+{
+    const uint32_t key[2] = {(uint32_t)seed, (uint32_t)(seed >> 32)};
+    const float scale = (high - low) * (1.0f / 16777216.0f); // 24 random bits per float
+
+    // Each counter value yields 4 consecutive elements of the stream. Partial blocks at the
+    // ends go through a scratch block; whole blocks in between are written directly.
+    size_t i = 0;
+    while (i < count)
+    {
+        uint64_t element = offset + i;
+        uint64_t block = element >> 2;
+        uint32_t counter[4] = {(uint32_t)block, (uint32_t)(block >> 32), (uint32_t)stream, (uint32_t)(stream >> 32)};
+        uint32_t bits[4];
+
+        if ((element & 3) == 0 && count - i >= 4)
+        {
+            size_t blocks = (count - i) >> 2;
+            for (size_t b = 0; b < blocks; b++)
+            {
+                counter[0] = (uint32_t)(block + b);
+                counter[1] = (uint32_t)((block + b) >> 32);
+                philox4x32(counter, key, bits);
+                for (int lane = 0; lane < 4; lane++)
+                {
+                    output[i + 4 * b + lane] = low + (float)(bits[lane] >> 8) * scale;
+                }
+            }
+            i += blocks << 2;
+            continue;
+        }
+
+        philox4x32(counter, key, bits);
+        for (int lane = (int)(element & 3); lane < 4 && i < count; lane++, i++)
+        {
+            output[i] = low + (float)(bits[lane] >> 8) * scale;
+        }
+    }
+}
@@ -0,0 +1,16 @@
+#ifndef PHILOX_H
+#define PHILOX_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Philox4x32-10 counter-based RNG (Salmon et al., "Parallel Random Numbers: As Easy as 1, 2, 3").
+// Output is a pure function of (key, counter), so any element of a random stream can be
+// generated independently on any thread, in any order, with no shared state.
+void philox4x32(const uint32_t counter[4], const uint32_t key[2], uint32_t output[4]);
+
+// Fill output[i] with uniform values in [low, high) for stream elements offset..offset+count-1.
+// seed selects the key and stream the counter's high word, so distinct streams never overlap.
+void philox_fill_uniform(float *output, size_t count, uint64_t seed, uint64_t stream, uint64_t offset, float low, float high);
+
+#endif // PHILOX_H
@@ -0,0 +1,55 @@
+#include "spsc_queue.h"
+#include <stdlib.h>
+
+SpscQueue *spsc_queue_create(size_t capacity)
+{
+    size_t size = 1;
+    while (size < capacity)
+    {
+        size <<= 1;
+    }
+
+    SpscQueue *queue = (SpscQueue *)aligned_alloc(64, (sizeof(SpscQueue) + 63) & ~(size_t)63);
+    queue->slots = (void **)calloc(size, sizeof(void *));
+    queue->mask = size - 1;
+    atomic_init(&queue->head, 0);
+    atomic_init(&queue->tail, 0);
+    return queue;
+}
+
+void spsc_queue_free(SpscQueue *queue)
+{
+    free(queue->slots);
+    free(queue);
+}
+
+// The release store of tail publishes the slot to the consumer; the acquire load of head
+// makes sure the consumer is done with a slot before it is reused.
+int spsc_queue_push(SpscQueue *queue, void *item)
+{
+    size_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&queue->head, memory_order_acquire);
+    if (tail - head > queue->mask)
+        return -1;
+
+    queue->slots[tail & queue->mask] = item;
+    atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+    return 0;
+}
+
+void *spsc_queue_pop(SpscQueue *queue)
+{
+    size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+    if (head == tail)
+        return NULL;
+
+    void *item = queue->slots[head & queue->mask];
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+    return item;
+}
+
+int spsc_queue_empty(SpscQueue *queue)
+{
+    return atomic_load(&queue->head) == atomic_load(&queue->tail);
+}
@@ -0,0 +1,29 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <stddef.h>
+#include <stdatomic.h>
+
+// Bounded lock-free single-producer, single-consumer ring of pointers. Each side only writes
+// its own index, and the two indices live on separate cache lines, so a push and a pop never
+// contend on a lock or bounce the same line between cores.
+typedef struct
+{
+    void **slots;
+    size_t mask; // capacity - 1, capacity is a power of two
+    _Alignas(64) atomic_size_t head; // next slot to pop, written by the consumer only
+    _Alignas(64) atomic_size_t tail; // next slot to push, written by the producer only
+} SpscQueue;
+
+// capacity is rounded up to a power of two
+SpscQueue *spsc_queue_create(size_t capacity);
+void spsc_queue_free(SpscQueue *queue);
+
+// Returns 0 on success, -1 if the queue is full
+int spsc_queue_push(SpscQueue *queue, void *item);
+
+// Returns the oldest item, or NULL if the queue is empty
+void *spsc_queue_pop(SpscQueue *queue);
+int spsc_queue_empty(SpscQueue *queue);
+
+#endif // SPSC_QUEUE_H